@@ -0,0 +1,64 @@
+#include "arena.hpp"
+#include "profile.hpp"
+#include <cstdlib>
+
+Arena::~Arena() { release(chunks); }
+
+Arena::Arena(Arena &&other) noexcept { *this = std::move(other); }
+
+Arena &Arena::operator=(Arena &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    release(chunks);
+    chunks = std::exchange(other.chunks, nullptr);
+    cursor = std::exchange(other.cursor, nullptr);
+    limit = std::exchange(other.limit, nullptr);
+    used = std::exchange(other.used, 0);
+    reserved = std::exchange(other.reserved, 0);
+    return *this;
+}
+
+void Arena::reset()
+{
+    if (!chunks)
+        return;
+    // Keep the newest chunk for reuse and drop the rest.
+    release(chunks->next);
+    chunks->next = nullptr;
+    cursor = reinterpret_cast<char *>(chunks + 1);
+    limit = reinterpret_cast<char *>(chunks) + chunks->size;
+    used = 0;
+    reserved = chunks->size;
+}
+
+void *Arena::allocateSlow(size_t size, size_t align)
+{
+    size_t chunkSize = chunks ? chunks->size * 2 : FirstChunkSize;
+    if (chunkSize > MaxChunkSize)
+        chunkSize = MaxChunkSize;
+    size_t needed = sizeof(Chunk) + size + align;
+    if (chunkSize < needed)
+        chunkSize = needed;
+    Chunk *chunk = static_cast<Chunk *>(std::malloc(chunkSize));
+    if (!chunk)
+        throw std::bad_alloc();
+    chunk->next = chunks;
+    chunk->size = chunkSize;
+    chunks = chunk;
+    cursor = reinterpret_cast<char *>(chunk + 1);
+    limit = reinterpret_cast<char *>(chunk) + chunkSize;
+    reserved += chunkSize;
+    BASE_COUNT_ALLOCATION(chunkSize);
+    return allocate(size, align);
+}
+
+void Arena::release(Chunk *chunk)
+{
+    while (chunk)
+    {
+        Chunk *next = chunk->next;
+        std::free(chunk);
+        chunk = next;
+    }
+}
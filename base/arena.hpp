@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <utility>
+
+// Fixed-size array that lives in an Arena.
+template <typename T>
+struct ArenaList
+{
+    T *items = nullptr;
+    uint32_t count = 0;
+
+    T *begin() const { return items; }
+    T *end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T &operator[](size_t index) const { return items[index]; }
+};
+
+// Bump allocator for AST nodes and their strings and lists. Everything is
+// released at once when the arena is destroyed or reset; destructors of the
+// objects placed in it are never run, so they must not own other memory.
+class Arena
+{
+public:
+    Arena() = default;
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(Arena &&other) noexcept;
+
+    void *allocate(size_t size, size_t align)
+    {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~static_cast<uintptr_t>(align - 1);
+        if (aligned + size > reinterpret_cast<uintptr_t>(limit))
+            return allocateSlow(size, align);
+        cursor = reinterpret_cast<char *>(aligned + size);
+        used += size;
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    ArenaList<T> copyList(const T *items, size_t count)
+    {
+        ArenaList<T> list;
+        if (count == 0)
+            return list;
+        list.items = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++)
+            new (list.items + i) T(items[i]);
+        list.count = static_cast<uint32_t>(count);
+        return list;
+    }
+
+    std::string_view copyString(std::string_view text)
+    {
+        if (text.empty())
+            return std::string_view();
+        char *copy = static_cast<char *>(allocate(text.size(), 1));
+        std::memcpy(copy, text.data(), text.size());
+        return std::string_view(copy, text.size());
+    }
+
+    // Releases everything allocated so far, keeping one chunk for reuse.
+    void reset();
+
+    // Bytes handed out to callers, and bytes obtained from the system.
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    struct Chunk
+    {
+        Chunk *next;
+        size_t size;
+    };
+
+    static constexpr size_t FirstChunkSize = 64 * 1024;
+    static constexpr size_t MaxChunkSize = 4 * 1024 * 1024;
+
+    Chunk *chunks = nullptr;
+    char *cursor = nullptr;
+    char *limit = nullptr;
+    size_t used = 0;
+    size_t reserved = 0;
+
+    void *allocateSlow(size_t size, size_t align);
+    void release(Chunk *chunk);
+};
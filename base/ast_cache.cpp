@@ -0,0 +1,708 @@
+#include "ast_cache.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "ast_visitor.hpp"
+#include "source_buffer.hpp"
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+const char ImageMagic[4] = {'B', 'A', 'S', 'T'};
+constexpr size_t ImageAlignment = 8;
+
+struct ImageHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t layout;
+    uint64_t key;
+    uint64_t sourceSize;
+    uint32_t symbolCount;     // followed by symbolCount uint32 name lengths
+    uint32_t symbolBytes;     // then the names back to back, padded to 8
+    uint32_t nodeBytes;       // then the node image
+    uint32_t relocationCount; // then the offsets of its pointers as uint32
+    uint32_t bodyOffset;
+    uint32_t bodyCount;
+};
+
+// Changes whenever the size or alignment of a serialized type does.
+constexpr uint64_t layoutFingerprint()
+{
+    uint64_t h = sizeof(void *);
+#define BASE_NODE_LAYOUT(type) h = h * 31 + sizeof(type) * 16 + alignof(type);
+    BASE_AST_NODES(BASE_NODE_LAYOUT)
+    BASE_NODE_LAYOUT(VariableDeclarator)
+    BASE_NODE_LAYOUT(Parameter)
+    BASE_NODE_LAYOUT(Binding)
+    BASE_NODE_LAYOUT(TemplateSegment)
+    BASE_NODE_LAYOUT(ArenaList<ASTNode *>)
+#undef BASE_NODE_LAYOUT
+    return h;
+}
+
+size_t alignUp(size_t n) { return (n + ImageAlignment - 1) & ~(ImageAlignment - 1); }
+
+// Copies nodes into the image bottom-up, so that every pointer field can be
+// stored as the image offset of a node already written. Entries start out
+// zeroed and are filled in field by field: copying whole structs would carry
+// their padding, which is uninitialized, into the file.
+class ImageWriter : public ASTVisitor<ImageWriter, uint32_t>
+{
+public:
+    // Offset 0 is left unused so that no encoded pointer reads as null.
+    std::string image = std::string(ImageAlignment, '\0');
+    std::vector<uint32_t> relocations;
+
+    // Appends a zeroed entry for a T and returns its offset.
+    template <typename T>
+    uint32_t reserve()
+    {
+        static_assert(alignof(T) <= ImageAlignment, "image entries are 8-byte aligned");
+        image.resize(alignUp(image.size()));
+        uint32_t offset = static_cast<uint32_t>(image.size());
+        image.resize(offset + sizeof(T));
+        return offset;
+    }
+
+    // Stores field, a member of object, at its place in the entry for object
+    // at offset.
+    template <typename T, typename F>
+    void put(uint32_t offset, const T &object, const F &field)
+    {
+        static_assert(std::is_arithmetic_v<F> || std::is_enum_v<F>, "pointers go through putPointer");
+        std::memcpy(&image[offset + fieldOffset(object, field)], &field, sizeof(F));
+    }
+
+    // Stores target, an image offset or 0 for null, in the pointer field of
+    // object and lists it for relocation.
+    template <typename T, typename P>
+    void putPointer(uint32_t offset, const T &object, P *const &field, uint32_t target)
+    {
+        putOffset(offset + fieldOffset(object, field), target);
+    }
+
+    template <typename T>
+    void putBinding(uint32_t offset, const T &object, const Binding &binding)
+    {
+        put(offset, object, binding.kind);
+        put(offset, object, binding.slot);
+    }
+
+    // Appends the ASTNode fields common to every node.
+    template <typename T>
+    uint32_t reserveNode(const T &node)
+    {
+        uint32_t at = reserve<T>();
+        put(at, node, node.line);
+        put(at, node, node.offset);
+        put(at, node, node.length);
+        put(at, node, node.nodeKind);
+        put(at, node, node.valueType);
+        return at;
+    }
+
+    // Writes the nodes of list and then their pointers; returns the offset of
+    // the first pointer, or 0 for an empty list.
+    uint32_t nodeList(const ArenaList<ASTNode *> &list)
+    {
+        std::vector<uint32_t> children;
+        for (const ASTNode *node : list)
+            children.push_back(visit(node));
+        uint32_t first = 0;
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            uint32_t at = reserve<ASTNode *>();
+            putOffset(at, children[i]);
+            if (i == 0)
+                first = at;
+        }
+        return first;
+    }
+
+    template <typename T>
+    void putList(uint32_t offset, const T &object, const ArenaList<ASTNode *> &list, uint32_t first)
+    {
+        putPointer(offset, object, list.items, first);
+        put(offset, object, list.count);
+    }
+
+    uint32_t visitProgram(const Program *) { return 0; }
+    uint32_t visitLiteralExpression(const LiteralExpression *node)
+    {
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->isString);
+        if (node->isString)
+            put(at, *node, node->strValue);
+        else
+            put(at, *node, node->numValue);
+        return at;
+    }
+    uint32_t visitIdentifierExpression(const IdentifierExpression *node)
+    {
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->name);
+        putBinding(at, *node, node->binding);
+        return at;
+    }
+    uint32_t visitVariableDeclaration(const VariableDeclaration *node)
+    {
+        std::vector<uint32_t> inits;
+        for (const VariableDeclarator &decl : node->declarations)
+            inits.push_back(decl.init ? visit(decl.init) : 0);
+        uint32_t first = 0;
+        for (size_t i = 0; i < inits.size(); i++)
+        {
+            const VariableDeclarator &decl = node->declarations[i];
+            uint32_t at = reserve<VariableDeclarator>();
+            put(at, decl, decl.name);
+            putPointer(at, decl, decl.init, inits[i]);
+            put(at, decl, decl.type);
+            putBinding(at, decl, decl.binding);
+            if (i == 0)
+                first = at;
+        }
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->kind);
+        putPointer(at, *node, node->declarations.items, first);
+        put(at, *node, node->declarations.count);
+        return at;
+    }
+    uint32_t visitFunctionDeclaration(const FunctionDeclaration *node)
+    {
+        uint32_t body = visit(node->body);
+        uint32_t first = 0;
+        for (size_t i = 0; i < node->params.size(); i++)
+        {
+            const Parameter &param = node->params[i];
+            uint32_t at = reserve<Parameter>();
+            put(at, param, param.name);
+            put(at, param, param.type);
+            if (i == 0)
+                first = at;
+        }
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->returnType);
+        put(at, *node, node->name);
+        putPointer(at, *node, node->params.items, first);
+        put(at, *node, node->params.count);
+        putPointer(at, *node, node->body, body);
+        put(at, *node, node->index);
+        return at;
+    }
+    uint32_t visitBlockStatement(const BlockStatement *node)
+    {
+        uint32_t first = nodeList(node->body);
+        uint32_t at = reserveNode(*node);
+        putList(at, *node, node->body, first);
+        return at;
+    }
+    uint32_t visitReturnStatement(const ReturnStatement *node)
+    {
+        uint32_t argument = node->argument ? visit(node->argument) : 0;
+        uint32_t at = reserveNode(*node);
+        putPointer(at, *node, node->argument, argument);
+        return at;
+    }
+    uint32_t visitExpressionStatement(const ExpressionStatement *node)
+    {
+        uint32_t expression = visit(node->expression);
+        uint32_t at = reserveNode(*node);
+        putPointer(at, *node, node->expression, expression);
+        return at;
+    }
+    uint32_t visitBinaryExpression(const BinaryExpression *node)
+    {
+        uint32_t left = visit(node->left);
+        uint32_t right = visit(node->right);
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->op);
+        putPointer(at, *node, node->left, left);
+        putPointer(at, *node, node->right, right);
+        return at;
+    }
+    uint32_t visitAssignmentExpression(const AssignmentExpression *node)
+    {
+        uint32_t value = visit(node->value);
+        uint32_t at = reserveNode(*node);
+        put(at, *node, node->op);
+        put(at, *node, node->name);
+        putBinding(at, *node, node->binding);
+        putPointer(at, *node, node->value, value);
+        return at;
+    }
+    uint32_t visitCallExpression(const CallExpression *node)
+    {
+        uint32_t callee = visit(node->callee);
+        uint32_t first = nodeList(node->arguments);
+        uint32_t at = reserveNode(*node);
+        putPointer(at, *node, node->callee, callee);
+        putList(at, *node, node->arguments, first);
+        return at;
+    }
+    uint32_t visitTemplateLiteral(const TemplateLiteral *node)
+    {
+        uint32_t firstSegment = 0;
+        for (size_t i = 0; i < node->segments.size(); i++)
+        {
+            const TemplateSegment &segment = node->segments[i];
+            uint32_t at = reserve<TemplateSegment>();
+            put(at, segment, segment.text);
+            put(at, segment, segment.length);
+            if (i == 0)
+                firstSegment = at;
+        }
+        uint32_t firstExpression = nodeList(node->expressions);
+        uint32_t at = reserveNode(*node);
+        putPointer(at, *node, node->segments.items, firstSegment);
+        put(at, *node, node->segments.count);
+        putList(at, *node, node->expressions, firstExpression);
+        put(at, *node, node->textLength);
+        return at;
+    }
+
+private:
+    // Stores target at offset as a pointer the loader relocates.
+    void putOffset(uint32_t offset, uint32_t target)
+    {
+        if (!target)
+            return;
+        uintptr_t encoded = target;
+        static_assert(sizeof(encoded) == sizeof(void *), "pointers are stored as uintptr_t");
+        std::memcpy(&image[offset], &encoded, sizeof(encoded));
+        relocations.push_back(offset);
+    }
+
+    template <typename T, typename F>
+    static uint32_t fieldOffset(const T &object, const F &field)
+    {
+        return static_cast<uint32_t>(reinterpret_cast<const char *>(&field) -
+                                     reinterpret_cast<const char *>(&object));
+    }
+};
+
+
+size_t nodeSize(NodeKind kind)
+{
+    switch (kind)
+    {
+#define BASE_NODE_SIZE(type) \
+    case NodeKind::type:     \
+        return sizeof(type);
+        BASE_AST_NODES(BASE_NODE_SIZE)
+#undef BASE_NODE_SIZE
+    }
+    return 0;
+}
+
+// Checks a relocated node image before anything reads it as a tree, since
+// an image is only a file and may be damaged or planted. Every pointer must
+// land inside the image, aligned, on a node of a kind its field can hold.
+// The writer works bottom-up, so a node must also lie before whatever
+// points to it, which rules out cycles, and no node may be reached twice.
+// Lists must fit in the image, and enums, symbols and spans must be in range.
+class ImageValidator : public ASTVisitor<ImageValidator, bool>
+{
+public:
+    ImageValidator(const char *base, uint32_t size, const Interner &symbols, uint64_t sourceSize)
+        : base(reinterpret_cast<uintptr_t>(base)), end(base + size), symbols(symbols), sourceSize(sourceSize),
+          seen(size / ImageAlignment + 1)
+    {
+    }
+
+    bool program(const ArenaList<ASTNode *> &body) { return nodeList(body, end, Expect::Statement); }
+
+    bool visitProgram(const Program *) { return false; }
+    bool visitLiteralExpression(const LiteralExpression *node)
+    {
+        unsigned char isString;
+        std::memcpy(&isString, &node->isString, sizeof(isString));
+        return isString == 0 || (isString == 1 && symbol(node->strValue));
+    }
+    bool visitIdentifierExpression(const IdentifierExpression *node)
+    {
+        return symbol(node->name) && binding(node->binding);
+    }
+    bool visitVariableDeclaration(const VariableDeclaration *node)
+    {
+        if (node->kind > DeclarationKind::Const || !fits(node->declarations, node))
+            return false;
+        for (const VariableDeclarator &decl : node->declarations)
+            if (!symbol(decl.name) || !type(decl.type) || !binding(decl.binding) ||
+                !child(decl.init, node->declarations.items, Expect::Expression))
+                return false;
+        return true;
+    }
+    bool visitFunctionDeclaration(const FunctionDeclaration *node)
+    {
+        if (!type(node->returnType) || !symbol(node->name) || !fits(node->params, node))
+            return false;
+        for (const Parameter &param : node->params)
+            if (!symbol(param.name) || !type(param.type))
+                return false;
+        return child(node->body, node, Expect::Block);
+    }
+    bool visitBlockStatement(const BlockStatement *node) { return nodeList(node->body, node, Expect::Statement); }
+    bool visitReturnStatement(const ReturnStatement *node)
+    {
+        return !node->argument || child(node->argument, node, Expect::Expression);
+    }
+    bool visitExpressionStatement(const ExpressionStatement *node)
+    {
+        return child(node->expression, node, Expect::Expression);
+    }
+    bool visitBinaryExpression(const BinaryExpression *node)
+    {
+        switch (node->op)
+        {
+        case TokenKind::Plus:
+        case TokenKind::Minus:
+        case TokenKind::Star:
+        case TokenKind::Slash:
+        case TokenKind::EqualEqual:
+        case TokenKind::BangEqual:
+        case TokenKind::Less:
+        case TokenKind::LessEqual:
+        case TokenKind::Greater:
+        case TokenKind::GreaterEqual:
+            return child(node->left, node, Expect::Expression) && child(node->right, node, Expect::Expression);
+        default:
+            return false;
+        }
+    }
+    bool visitAssignmentExpression(const AssignmentExpression *node)
+    {
+        if (node->op != TokenKind::Equal && node->binaryOperator() == TokenKind::Equal)
+            return false;
+        return symbol(node->name) && binding(node->binding) && child(node->value, node, Expect::Expression);
+    }
+    bool visitCallExpression(const CallExpression *node)
+    {
+        return child(node->callee, node, Expect::Expression) && nodeList(node->arguments, node, Expect::Expression);
+    }
+    bool visitTemplateLiteral(const TemplateLiteral *node)
+    {
+        if (node->segments.count != uint64_t(node->expressions.count) + 1 || !fits(node->segments, node))
+            return false;
+        uint64_t textLength = 0;
+        for (const TemplateSegment &segment : node->segments)
+        {
+            if (!symbol(segment.text) || symbols.name(segment.text).size() != segment.length)
+                return false;
+            textLength += segment.length;
+        }
+        return textLength == node->textLength && nodeList(node->expressions, node, Expect::Expression);
+    }
+
+private:
+    enum class Expect
+    {
+        Statement,
+        Expression,
+        Block
+    };
+
+    uintptr_t base;
+    const char *end;
+    const Interner &symbols;
+    uint64_t sourceSize;
+    std::vector<bool> seen; // by 8-byte slot of the image
+
+    bool symbol(Symbol symbol) const { return symbol != NoSymbol && symbol <= symbols.size(); }
+    static bool type(TypeName type) { return type <= TypeName::Void; }
+    static bool binding(Binding binding) { return binding.kind <= BindingKind::Print; }
+
+    static bool expected(NodeKind kind, Expect expect)
+    {
+        switch (kind)
+        {
+        case NodeKind::BlockStatement:
+            return expect != Expect::Expression;
+        case NodeKind::VariableDeclaration:
+        case NodeKind::FunctionDeclaration:
+        case NodeKind::ReturnStatement:
+        case NodeKind::ExpressionStatement:
+            return expect == Expect::Statement;
+        case NodeKind::LiteralExpression:
+        case NodeKind::IdentifierExpression:
+        case NodeKind::BinaryExpression:
+        case NodeKind::AssignmentExpression:
+        case NodeKind::CallExpression:
+        case NodeKind::TemplateLiteral:
+            return expect == Expect::Expression;
+        default:
+            return false;
+        }
+    }
+
+    // Whether size bytes at item lie in the image before limit, aligned.
+    bool fits(const void *item, uint64_t size, size_t alignment, const void *limit) const
+    {
+        uintptr_t at = reinterpret_cast<uintptr_t>(item);
+        uintptr_t before = reinterpret_cast<uintptr_t>(limit);
+        return at >= base && at <= before && at % alignment == 0 && size <= before - at;
+    }
+
+    template <typename T>
+    bool fits(const ArenaList<T> &list, const void *limit) const
+    {
+        return list.count == 0 || fits(list.items, uint64_t(list.count) * sizeof(T), alignof(T), limit);
+    }
+
+    bool nodeList(const ArenaList<ASTNode *> &list, const void *limit, Expect expect)
+    {
+        if (!fits(list, limit))
+            return false;
+        for (const ASTNode *node : list)
+            if (!child(node, list.items, expect))
+                return false;
+        return true;
+    }
+
+    bool child(const ASTNode *node, const void *limit, Expect expect)
+    {
+        if (!node || !fits(node, sizeof(ASTNode), ImageAlignment, limit) || !expected(node->nodeKind, expect) ||
+            !fits(node, nodeSize(node->nodeKind), ImageAlignment, limit))
+            return false;
+        size_t slot = (reinterpret_cast<uintptr_t>(node) - base) / ImageAlignment;
+        if (seen[slot])
+            return false;
+        seen[slot] = true;
+        return type(node->valueType) && uint64_t(node->offset) + node->length <= sourceSize && visit(node);
+    }
+};
+
+// Whether directory is a directory of this user that no one else can write
+// to. Anyone who can put an image there can make it load as any program.
+bool privateDirectory(const std::filesystem::path &directory)
+{
+    std::error_code ec;
+#ifdef _WIN32
+    return std::filesystem::is_directory(directory, ec);
+#else
+    struct stat info;
+    return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && info.st_uid == geteuid() &&
+           (info.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+// Creates directory, readable by this user only, unless it exists.
+void createPrivateDirectory(const std::filesystem::path &directory)
+{
+    std::error_code ec;
+#ifdef _WIN32
+    std::filesystem::create_directories(directory, ec);
+#else
+    if (directory.has_parent_path())
+        std::filesystem::create_directories(directory.parent_path(), ec);
+    mkdir(directory.c_str(), 0700);
+#endif
+}
+
+} // namespace
+
+uint64_t hashBytes(std::string_view data, uint64_t seed)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t h = (seed ^ data.size()) * multiplier;
+    const char *p = data.data();
+    size_t n = data.size();
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    if (n > 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, p, n);
+        h = (h ^ word) * multiplier;
+    }
+    return h ^ (h >> 32);
+}
+
+std::string writeProgramImage(const Program &program, uint64_t key, uint64_t sourceSize)
+{
+    ImageWriter writer;
+    uint32_t body = writer.nodeList(program.body);
+
+    ImageHeader header{};
+    std::memcpy(header.magic, ImageMagic, sizeof(ImageMagic));
+    header.version = ImageFormatVersion;
+    header.layout = layoutFingerprint();
+    header.key = key;
+    header.sourceSize = sourceSize;
+    header.symbolCount = static_cast<uint32_t>(program.symbols.size());
+    header.nodeBytes = static_cast<uint32_t>(writer.image.size());
+    header.relocationCount = static_cast<uint32_t>(writer.relocations.size());
+    header.bodyOffset = body;
+    header.bodyCount = program.body.count;
+
+    std::vector<uint32_t> lengths;
+    std::string names;
+    for (Symbol symbol = 1; symbol <= header.symbolCount; symbol++)
+    {
+        std::string_view name = program.symbols.name(symbol);
+        lengths.push_back(static_cast<uint32_t>(name.size()));
+        names += name;
+    }
+    header.symbolBytes = static_cast<uint32_t>(names.size());
+
+    std::string out(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(lengths.data()), lengths.size() * sizeof(uint32_t));
+    out += names;
+    out.resize(alignUp(out.size()));
+    out += writer.image;
+    out.append(reinterpret_cast<const char *>(writer.relocations.data()), writer.relocations.size() * sizeof(uint32_t));
+    return out;
+}
+
+// Checks that image belongs to this build and source and that its sections
+// add up to its size.
+static bool readHeader(std::string_view image, uint64_t key, uint64_t sourceSize, ImageHeader &header)
+{
+    if (image.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, ImageMagic, sizeof(ImageMagic)) != 0 || header.version != ImageFormatVersion ||
+        header.layout != layoutFingerprint() || header.key != key || header.sourceSize != sourceSize)
+        return false;
+    uint64_t namesAt = sizeof(header) + uint64_t(header.symbolCount) * sizeof(uint32_t);
+    uint64_t relocationsAt = alignUp(namesAt + header.symbolBytes) + header.nodeBytes;
+    return relocationsAt + uint64_t(header.relocationCount) * sizeof(uint32_t) == image.size() &&
+           uint64_t(header.bodyOffset) + uint64_t(header.bodyCount) * sizeof(ASTNode *) <= header.nodeBytes;
+}
+
+std::unique_ptr<Program> readProgramImage(std::string_view image, uint64_t key, uint64_t sourceSize)
+{
+    ImageHeader header;
+    if (!readHeader(image, key, sourceSize, header))
+        return nullptr;
+    uint64_t namesAt = sizeof(header) + uint64_t(header.symbolCount) * sizeof(uint32_t);
+    uint64_t nodesAt = alignUp(namesAt + header.symbolBytes);
+    uint64_t relocationsAt = nodesAt + header.nodeBytes;
+
+    auto program = std::make_unique<Program>();
+    const char *names = image.data() + namesAt;
+    uint64_t namesLeft = header.symbolBytes;
+    for (Symbol symbol = 1; symbol <= header.symbolCount; symbol++)
+    {
+        uint32_t length;
+        std::memcpy(&length, image.data() + sizeof(header) + (symbol - 1) * sizeof(uint32_t), sizeof(length));
+        if (length > namesLeft || program->symbols.intern(std::string_view(names, length)) != symbol)
+            return nullptr;
+        names += length;
+        namesLeft -= length;
+    }
+
+    char *base = static_cast<char *>(program->arena.allocate(header.nodeBytes, ImageAlignment));
+    if (header.nodeBytes > 0)
+        std::memcpy(base, image.data() + nodesAt, header.nodeBytes);
+    const char *relocations = image.data() + relocationsAt;
+    for (uint32_t i = 0; i < header.relocationCount; i++)
+    {
+        uint32_t at;
+        std::memcpy(&at, relocations + i * sizeof(uint32_t), sizeof(at));
+        uintptr_t target;
+        if (uint64_t(at) + sizeof(target) > header.nodeBytes)
+            return nullptr;
+        std::memcpy(&target, base + at, sizeof(target));
+        if (target >= header.nodeBytes)
+            return nullptr;
+        target += reinterpret_cast<uintptr_t>(base);
+        std::memcpy(base + at, &target, sizeof(target));
+    }
+    if (header.bodyCount > 0)
+        program->body = {reinterpret_cast<ASTNode **>(base + header.bodyOffset), header.bodyCount};
+    ImageValidator validator(base, header.nodeBytes, program->symbols, sourceSize);
+    if (!validator.program(program->body))
+        return nullptr;
+    return program;
+}
+
+AstCache::AstCache(std::filesystem::path directory, std::string_view compilerVersion)
+    : directory(std::move(directory)), seed(hashBytes(compilerVersion, ImageFormatVersion))
+{
+}
+
+std::filesystem::path AstCache::defaultDirectory()
+{
+    if (const char *dir = std::getenv("BASE_CACHE_DIR"))
+        return dir;
+#ifdef _WIN32
+    if (const char *local = std::getenv("LOCALAPPDATA"); local && *local)
+        return std::filesystem::path(local) / "base";
+#else
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg == '/')
+        return std::filesystem::path(xdg) / "base";
+    if (const char *home = std::getenv("HOME"); home && *home)
+        return std::filesystem::path(home) / ".cache" / "base";
+#endif
+    return {};
+}
+
+std::filesystem::path AstCache::pathFor(uint64_t key) const
+{
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bast", static_cast<unsigned long long>(key));
+    return directory / name;
+}
+
+std::unique_ptr<Program> AstCache::load(std::string_view source) const
+{
+    if (directory.empty() || !privateDirectory(directory))
+        return nullptr;
+    uint64_t key = hashBytes(source, seed);
+    SourceBuffer file;
+    if (!file.open(pathFor(key).string()))
+        return nullptr;
+    return readProgramImage(file.view(), key, source.size());
+}
+
+bool AstCache::contains(std::string_view source) const
+{
+    return load(source) != nullptr;
+}
+
+void AstCache::store(std::string_view source, const Program &program) const
+{
+    if (directory.empty())
+        return;
+    createPrivateDirectory(directory);
+    if (!privateDirectory(directory))
+        return;
+    uint64_t key = hashBytes(source, seed);
+    std::string image = writeProgramImage(program, key, source.size());
+    std::error_code ec;
+    // Write under a unique name and rename, so readers never see a partly
+    // written image and concurrent writers of the same key do not collide.
+    static std::atomic<uint32_t> counter{0};
+    static const uint32_t process = std::random_device()();
+    std::filesystem::path path = pathFor(key);
+    std::filesystem::path temp = path;
+    temp += "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        if (!out.write(image.data(), static_cast<std::streamsize>(image.size())))
+        {
+            out.close();
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+        std::filesystem::remove(temp, ec);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "parser.hpp"
+
+// Binary images of parsed programs, so unchanged sources skip lexing and
+// parsing. An image holds the interned names in Symbol order and a copy of
+// the program's nodes laid out as in memory, with pointers stored as offsets
+// into the image and listed in a relocation table. Loading copies the nodes
+// into the program's arena in one block and adds the block address to every
+// listed pointer; nothing is parsed or visited.
+//
+// Images are only valid for the build that wrote them: the header records
+// the format version and a fingerprint of the node layouts. Bump
+// ImageFormatVersion whenever a node type changes.
+constexpr uint32_t ImageFormatVersion = 4;
+
+// 64-bit content hash, seeded so that different compiler versions key the
+// same source differently.
+uint64_t hashBytes(std::string_view data, uint64_t seed = 0);
+
+// Serializes program. key and sourceSize identify the source it came from
+// and are checked again on load.
+std::string writeProgramImage(const Program &program, uint64_t key, uint64_t sourceSize);
+
+// Rebuilds a program from an image. Returns null if the image is damaged,
+// from another build, or for another source. Every node is checked before
+// the program is returned, so no image can make it unsafe to use.
+std::unique_ptr<Program> readProgramImage(std::string_view image, uint64_t key, uint64_t sourceSize);
+
+// A directory of program images named by the hash of their source and the
+// compiler version. Any number of threads and processes may share one. The
+// directory is created readable by its user only, and one that is not the
+// user's own or that others can write to is not used.
+class AstCache
+{
+public:
+    AstCache(std::filesystem::path directory, std::string_view compilerVersion);
+
+    // $BASE_CACHE_DIR if set, otherwise base in $XDG_CACHE_HOME or ~/.cache
+    // (%LOCALAPPDATA% on Windows). Empty, which disables the cache, if none
+    // of them is set.
+    static std::filesystem::path defaultDirectory();
+
+    // Returns the cached tree of source, or null on a miss.
+    std::unique_ptr<Program> load(std::string_view source) const;
+    // Whether a valid tree of source is cached, which also means it parses.
+    bool contains(std::string_view source) const;
+    // Caches the tree of source. Errors are ignored; the cache only saves
+    // time. Store trees before optimization passes rewrite them.
+    void store(std::string_view source, const Program &program) const;
+
+private:
+    std::filesystem::path directory;
+    uint64_t seed;
+
+    std::filesystem::path pathFor(uint64_t key) const;
+};
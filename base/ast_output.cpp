@@ -0,0 +1,540 @@
+#include "ast_output.hpp"
+#include "ast_printer.hpp"
+#include "ast_visitor.hpp"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+bool parseAstFormat(const std::string &name, AstFormat &format)
+{
+    for (AstFormat candidate : {AstFormat::Text, AstFormat::Json, AstFormat::Binary})
+        if (name == astFormatName(candidate))
+        {
+            format = candidate;
+            return true;
+        }
+    return false;
+}
+
+const char *astFormatName(AstFormat format)
+{
+    switch (format)
+    {
+    case AstFormat::Text:
+        return "text";
+    case AstFormat::Json:
+        return "json";
+    case AstFormat::Binary:
+        return "binary";
+    }
+    return "?";
+}
+
+namespace
+{
+const char *nodeKindName(NodeKind kind)
+{
+    switch (kind)
+    {
+#define BASE_NODE_NAME(type) \
+    case NodeKind::type:     \
+        return #type;
+        BASE_AST_NODES(BASE_NODE_NAME)
+#undef BASE_NODE_NAME
+    }
+    return "?";
+}
+
+// Pending work of a tree walk. Lists are resumed one entry at a time, so
+// the stack is as deep as the tree rather than as wide.
+struct WalkItem
+{
+    enum Kind : uint8_t
+    {
+        Node,        // target: ASTNode, possibly null
+        Text,        // target: string literal
+        NodeList,    // target: ArenaList<ASTNode *>
+        Declarators, // target: VariableDeclaration
+        Statements,  // target: Program (binary only)
+        EndFrame     // index: position of a statement's length (binary only)
+    };
+    Kind kind;
+    uint32_t index;
+    const void *target;
+};
+
+class JsonWriter : public ASTVisitor<JsonWriter>
+{
+public:
+    JsonWriter(OutputBuffer &out, const Interner &symbols) : out(out), symbols(symbols) {}
+
+    void run(const ASTNode *root)
+    {
+        stack.push_back({WalkItem::Node, 0, root});
+        while (!stack.empty())
+        {
+            WalkItem item = stack.back();
+            stack.pop_back();
+            step(item);
+            out.flushIfFull();
+        }
+        out.put('\n');
+    }
+
+    void visitProgram(const Program *node)
+    {
+        begin(node, "\"body\":[");
+        then("]}");
+        pushList(node->body);
+    }
+
+    void visitLiteralExpression(const LiteralExpression *node)
+    {
+        begin(node, "\"value\":");
+        if (node->isString)
+            string(symbols.name(node->strValue));
+        else if (std::isfinite(node->numValue))
+            out.appendShortest(node->numValue);
+        else
+            out.append("null");
+        out.put('}');
+    }
+
+    void visitIdentifierExpression(const IdentifierExpression *node)
+    {
+        begin(node, "\"name\":");
+        string(symbols.name(node->name));
+        out.put('}');
+    }
+
+    void visitVariableDeclaration(const VariableDeclaration *node)
+    {
+        begin(node, "\"kind\":");
+        string(declarationKindSpelling(node->kind));
+        out.append(",\"declarations\":[");
+        then("]}");
+        stack.push_back({WalkItem::Declarators, 0, node});
+    }
+
+    void visitFunctionDeclaration(const FunctionDeclaration *node)
+    {
+        begin(node, "\"name\":");
+        string(symbols.name(node->name));
+        out.append(",\"returnType\":");
+        string(typeNameSpelling(node->returnType));
+        out.append(",\"params\":[");
+        for (size_t i = 0; i < node->params.size(); i++)
+        {
+            out.append(i ? ",{\"name\":" : "{\"name\":");
+            string(symbols.name(node->params[i].name));
+            out.append(",\"valueType\":");
+            string(typeNameSpelling(node->params[i].type));
+            out.put('}');
+        }
+        out.append("],\"body\":");
+        then("}");
+        push(node->body);
+    }
+
+    void visitBlockStatement(const BlockStatement *node)
+    {
+        begin(node, "\"body\":[");
+        then("]}");
+        pushList(node->body);
+    }
+
+    void visitReturnStatement(const ReturnStatement *node)
+    {
+        begin(node, "\"argument\":");
+        then("}");
+        push(node->argument);
+    }
+
+    void visitExpressionStatement(const ExpressionStatement *node)
+    {
+        begin(node, "\"expression\":");
+        then("}");
+        push(node->expression);
+    }
+
+    void visitBinaryExpression(const BinaryExpression *node)
+    {
+        begin(node, "\"operator\":");
+        string(tokenKindSpelling(node->op));
+        out.append(",\"left\":");
+        then("}");
+        push(node->right);
+        then(",\"right\":");
+        push(node->left);
+    }
+
+    void visitAssignmentExpression(const AssignmentExpression *node)
+    {
+        begin(node, "\"operator\":");
+        string(tokenKindSpelling(node->op));
+        out.append(",\"name\":");
+        string(symbols.name(node->name));
+        out.append(",\"value\":");
+        then("}");
+        push(node->value);
+    }
+
+    void visitCallExpression(const CallExpression *node)
+    {
+        begin(node, "\"callee\":");
+        then("]}");
+        pushList(node->arguments);
+        then(",\"arguments\":[");
+        push(node->callee);
+    }
+
+    void visitTemplateLiteral(const TemplateLiteral *node)
+    {
+        begin(node, "\"segments\":[");
+        for (size_t i = 0; i < node->segments.size(); i++)
+        {
+            if (i)
+                out.put(',');
+            string(symbols.name(node->segments[i].text));
+        }
+        out.append("],\"expressions\":[");
+        then("]}");
+        pushList(node->expressions);
+    }
+
+private:
+    OutputBuffer &out;
+    const Interner &symbols;
+    std::vector<WalkItem> stack;
+
+    void push(const ASTNode *node) { stack.push_back({WalkItem::Node, 0, node}); }
+    void pushList(const ArenaList<ASTNode *> &list) { stack.push_back({WalkItem::NodeList, 0, &list}); }
+    // Text written once everything pushed after it is done.
+    void then(const char *text) { stack.push_back({WalkItem::Text, 0, text}); }
+
+    // Children are pushed last first, so they are written in order.
+    void step(const WalkItem &item)
+    {
+        WalkItem next = item;
+        next.index++;
+        switch (item.kind)
+        {
+        case WalkItem::Node:
+            if (item.target)
+                visit(static_cast<const ASTNode *>(item.target));
+            else
+                out.append("null");
+            break;
+        case WalkItem::Text:
+            out.append(static_cast<const char *>(item.target));
+            break;
+        case WalkItem::NodeList:
+        {
+            const auto &list = *static_cast<const ArenaList<ASTNode *> *>(item.target);
+            if (item.index >= list.size())
+                break;
+            if (item.index)
+                out.put(',');
+            stack.push_back(next);
+            push(list[item.index]);
+            break;
+        }
+        case WalkItem::Declarators:
+        {
+            const auto *node = static_cast<const VariableDeclaration *>(item.target);
+            if (item.index >= node->declarations.size())
+                break;
+            const VariableDeclarator &decl = node->declarations[item.index];
+            out.append(item.index ? ",{\"name\":" : "{\"name\":");
+            string(symbols.name(decl.name));
+            out.append(",\"valueType\":");
+            string(typeNameSpelling(decl.type));
+            out.append(",\"init\":");
+            stack.push_back(next);
+            then("}");
+            push(decl.init);
+            break;
+        }
+        case WalkItem::Statements:
+        case WalkItem::EndFrame:
+            break;
+        }
+    }
+
+    // Opens the node's object up to its first field.
+    void begin(const ASTNode *node, const char *firstField)
+    {
+        out.append("{\"type\":\"");
+        out.append(nodeKindName(node->nodeKind));
+        out.append("\",\"line\":");
+        out.appendInt(node->line);
+        out.put(',');
+        out.append(firstField);
+    }
+
+    void string(std::string_view text)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out.put('"');
+        size_t plain = 0;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            out.append(text.substr(plain, i - plain));
+            plain = i + 1;
+            out.put('\\');
+            switch (c)
+            {
+            case '"':
+            case '\\':
+                out.put(static_cast<char>(c));
+                break;
+            case '\n':
+                out.put('n');
+                break;
+            case '\r':
+                out.put('r');
+                break;
+            case '\t':
+                out.put('t');
+                break;
+            default:
+                out.append("u00");
+                out.put(hex[c >> 4]);
+                out.put(hex[c & 15]);
+            }
+        }
+        out.append(text.substr(plain));
+        out.put('"');
+    }
+};
+
+class BinaryWriter : public ASTVisitor<BinaryWriter>
+{
+public:
+    BinaryWriter(OutputBuffer &out, const Interner &symbols) : out(out), symbols(symbols) {}
+
+    void run(const ASTNode *root)
+    {
+        out.append("BAST");
+        out.put(static_cast<char>(AstBinaryVersion));
+        out.appendVarint(symbols.size());
+        for (Symbol symbol = 1; symbol <= symbols.size(); symbol++)
+        {
+            string(symbols.name(symbol));
+            out.flushIfFull();
+        }
+        stack.push_back({WalkItem::Node, 0, root});
+        while (!stack.empty())
+        {
+            WalkItem item = stack.back();
+            stack.pop_back();
+            step(item);
+            // A statement's length is patched in once it is complete.
+            if (openFrames == 0)
+                out.flushIfFull();
+        }
+    }
+
+    void visitProgram(const Program *node)
+    {
+        begin(node);
+        out.appendVarint(node->body.size());
+        stack.push_back({WalkItem::Statements, 0, node});
+    }
+
+    void visitLiteralExpression(const LiteralExpression *node)
+    {
+        begin(node);
+        if (node->isString)
+        {
+            out.put(1);
+            out.appendVarint(node->strValue);
+            return;
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &node->numValue, sizeof(bits));
+        out.put(0);
+        out.appendU32(static_cast<uint32_t>(bits));
+        out.appendU32(static_cast<uint32_t>(bits >> 32));
+    }
+
+    void visitIdentifierExpression(const IdentifierExpression *node)
+    {
+        begin(node);
+        out.appendVarint(node->name);
+    }
+
+    void visitVariableDeclaration(const VariableDeclaration *node)
+    {
+        begin(node);
+        out.put(static_cast<char>(node->kind));
+        out.appendVarint(node->declarations.size());
+        stack.push_back({WalkItem::Declarators, 0, node});
+    }
+
+    void visitFunctionDeclaration(const FunctionDeclaration *node)
+    {
+        begin(node);
+        out.appendVarint(node->name);
+        out.put(static_cast<char>(node->returnType));
+        out.appendVarint(node->params.size());
+        for (const Parameter &param : node->params)
+        {
+            out.appendVarint(param.name);
+            out.put(static_cast<char>(param.type));
+        }
+        push(node->body);
+    }
+
+    void visitBlockStatement(const BlockStatement *node)
+    {
+        begin(node);
+        out.appendVarint(node->body.size());
+        pushList(node->body);
+    }
+
+    void visitReturnStatement(const ReturnStatement *node)
+    {
+        begin(node);
+        push(node->argument);
+    }
+
+    void visitExpressionStatement(const ExpressionStatement *node)
+    {
+        begin(node);
+        push(node->expression);
+    }
+
+    void visitBinaryExpression(const BinaryExpression *node)
+    {
+        begin(node);
+        out.put(static_cast<char>(node->op));
+        push(node->right);
+        push(node->left);
+    }
+
+    void visitAssignmentExpression(const AssignmentExpression *node)
+    {
+        begin(node);
+        out.put(static_cast<char>(node->op));
+        out.appendVarint(node->name);
+        push(node->value);
+    }
+
+    void visitCallExpression(const CallExpression *node)
+    {
+        begin(node);
+        out.appendVarint(node->arguments.size());
+        pushList(node->arguments);
+        push(node->callee);
+    }
+
+    void visitTemplateLiteral(const TemplateLiteral *node)
+    {
+        begin(node);
+        out.appendVarint(node->segments.size());
+        for (const TemplateSegment &segment : node->segments)
+            out.appendVarint(segment.text);
+        out.appendVarint(node->expressions.size());
+        pushList(node->expressions);
+    }
+
+private:
+    static constexpr char Absent = static_cast<char>(0xFF);
+
+    OutputBuffer &out;
+    const Interner &symbols;
+    std::vector<WalkItem> stack;
+    size_t openFrames = 0;
+
+    void push(const ASTNode *node) { stack.push_back({WalkItem::Node, 0, node}); }
+    void pushList(const ArenaList<ASTNode *> &list) { stack.push_back({WalkItem::NodeList, 0, &list}); }
+
+    // Children are pushed last first, so they are written in order.
+    void step(const WalkItem &item)
+    {
+        WalkItem next = item;
+        next.index++;
+        switch (item.kind)
+        {
+        case WalkItem::Node:
+            if (item.target)
+                visit(static_cast<const ASTNode *>(item.target));
+            else
+                out.put(Absent);
+            break;
+        case WalkItem::NodeList:
+        {
+            const auto &list = *static_cast<const ArenaList<ASTNode *> *>(item.target);
+            if (item.index >= list.size())
+                break;
+            stack.push_back(next);
+            push(list[item.index]);
+            break;
+        }
+        case WalkItem::Declarators:
+        {
+            const auto *node = static_cast<const VariableDeclaration *>(item.target);
+            if (item.index >= node->declarations.size())
+                break;
+            const VariableDeclarator &decl = node->declarations[item.index];
+            out.appendVarint(decl.name);
+            out.put(static_cast<char>(decl.type));
+            stack.push_back(next);
+            push(decl.init);
+            break;
+        }
+        case WalkItem::Statements:
+        {
+            const auto *node = static_cast<const Program *>(item.target);
+            if (item.index >= node->body.size())
+                break;
+            stack.push_back(next);
+            uint32_t lengthAt = static_cast<uint32_t>(out.pending());
+            out.appendU32(0);
+            openFrames++;
+            stack.push_back({WalkItem::EndFrame, lengthAt, nullptr});
+            push(node->body[item.index]);
+            break;
+        }
+        case WalkItem::EndFrame:
+            out.patchU32(item.index, static_cast<uint32_t>(out.pending() - item.index - 4));
+            openFrames--;
+            break;
+        case WalkItem::Text:
+            break;
+        }
+    }
+
+    void begin(const ASTNode *node)
+    {
+        out.put(static_cast<char>(node->nodeKind));
+        out.appendVarint(static_cast<uint32_t>(node->line));
+    }
+
+    void string(std::string_view text)
+    {
+        out.appendVarint(text.size());
+        out.append(text);
+    }
+};
+} // namespace
+
+void writeAst(OutputBuffer &out, AstFormat format, const ASTNode *root, const Interner &symbols, int indent)
+{
+    switch (format)
+    {
+    case AstFormat::Text:
+        ASTPrinter::print(out, root, symbols, indent);
+        break;
+    case AstFormat::Json:
+        JsonWriter(out, symbols).run(root);
+        break;
+    case AstFormat::Binary:
+        BinaryWriter(out, symbols).run(root);
+        break;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "output_buffer.hpp"
+#include "parser.hpp"
+
+// Ways to get a tree out of the tool, for people (text) and for other
+// programs (JSON and binary). Every backend walks the tree with an explicit
+// stack and writes through an OutputBuffer.
+//
+// Text is the ASTPrinter format.
+//
+// JSON is one object per node on a single line:
+//   {"type": "<NodeKind>", "line": n, ...fields}
+// with the fields named as in parser.hpp, except that a literal has
+// "value" and an operator is "operator". Absent children are null, as are
+// numbers beyond the double range. Declarators and parameters are
+// {"name", "valueType"[, "init"]} objects; template segments are strings.
+//
+// Binary is little-endian. Counts, lines and symbols are unsigned LEB128
+// varints, strings are a varint length followed by the bytes:
+//   "BAST", u8 version, varint symbol count, each symbol's string
+//   (Symbol 1 first), then the root node.
+// A node is u8 NodeKind, varint line and the node's fields in declaration
+// order, except that lists are preceded by their count and a node's
+// scalars come before its children:
+//   Program              count, then per statement: u32 byte length, node
+//   LiteralExpression    u8 0 and f64, or u8 1 and symbol
+//   IdentifierExpression symbol
+//   VariableDeclaration  u8 DeclarationKind, count, per declarator:
+//                        symbol, u8 TypeName, node
+//   FunctionDeclaration  symbol, u8 TypeName, count, per parameter:
+//                        symbol, u8 TypeName, then the body node
+//   BlockStatement       count, nodes
+//   ReturnStatement      node
+//   ExpressionStatement  node
+//   BinaryExpression     u8 TokenKind, left node, right node
+//   AssignmentExpression u8 TokenKind, symbol, node
+//   CallExpression       count, callee node, argument nodes
+//   TemplateLiteral      count, segment symbols, count, nodes
+// An absent child is the single byte 0xFF. The statement lengths let a
+// reader skip statements. Bump AstBinaryVersion when the layout changes.
+constexpr uint8_t AstBinaryVersion = 1;
+
+enum class AstFormat : uint8_t
+{
+    Text,
+    Json,
+    Binary
+};
+
+// "text", "json" or "binary".
+bool parseAstFormat(const std::string &name, AstFormat &format);
+const char *astFormatName(AstFormat format);
+
+// Writes the tree under root. JSON ends with a newline; text is indented
+// by indent levels.
+void writeAst(OutputBuffer &out, AstFormat format, const ASTNode *root, const Interner &symbols, int indent = 0);
@@ -1,122 +1,218 @@
 #include "ast_printer.hpp"
 
-void ASTPrinter::print(const ASTNode *node, int indent)
-{
-    if (!node)
-        return;
-    if (auto p = dynamic_cast<const Program *>(node))
-        printProgram(p, indent);
-    else if (auto p = dynamic_cast<const LiteralExpression *>(node))
-        printLiteral(p, indent);
-    else if (auto p = dynamic_cast<const IdentifierExpression *>(node))
-        printIdentifier(p, indent);
-    else if (auto p = dynamic_cast<const VariableDeclaration *>(node))
-        printVarDecl(p, indent);
-    else if (auto p = dynamic_cast<const FunctionDeclaration *>(node))
-        printFuncDecl(p, indent);
-    else if (auto p = dynamic_cast<const BlockStatement *>(node))
-        printBlock(p, indent);
-    else if (auto p = dynamic_cast<const ReturnStatement *>(node))
-        printReturn(p, indent);
-    else if (auto p = dynamic_cast<const ExpressionStatement *>(node))
-        printExprStmt(p, indent);
-    else if (auto p = dynamic_cast<const BinaryExpression *>(node))
-        printBinary(p, indent);
-    else if (auto p = dynamic_cast<const CallExpression *>(node))
-        printCall(p, indent);
-    else
-        printIndent(indent), std::cout << "(Unknown AST node)\n";
+ASTPrinter::ASTPrinter(OutputBuffer &out, const Interner &symbols) : out(out), symbols(symbols) {}
+
+void ASTPrinter::print(const ASTNode *node, const Interner &symbols, int indent)
+{
+    OutputBuffer out(std::cout);
+    print(out, node, symbols, indent);
+}
+
+void ASTPrinter::print(OutputBuffer &out, const ASTNode *node, const Interner &symbols, int indent)
+{
+    ASTPrinter printer(out, symbols);
+    printer.run(node, indent);
+}
+
+void ASTPrinter::run(const ASTNode *root, int indent)
+{
+    push(root, indent);
+    while (!stack.empty())
+    {
+        Item item = stack.back();
+        stack.pop_back();
+        step(item);
+        out.flushIfFull();
+    }
+}
+
+void ASTPrinter::push(const ASTNode *node, int indent)
+{
+    if (node)
+        stack.push_back({Item::Node, 0, indent, node});
+}
+
+void ASTPrinter::pushList(const ArenaList<ASTNode *> &list, int indent)
+{
+    stack.push_back({Item::NodeList, 0, indent, &list});
+}
+
+// Children are pushed last first, so they print in order.
+void ASTPrinter::step(const Item &item)
+{
+    Item next = item;
+    next.index++;
+    switch (item.kind)
+    {
+    case Item::Node:
+        visit(static_cast<const ASTNode *>(item.target), item.indent);
+        break;
+    case Item::NodeList:
+    {
+        const auto &list = *static_cast<const ArenaList<ASTNode *> *>(item.target);
+        if (item.index >= list.size())
+            break;
+        stack.push_back(next);
+        push(list[item.index], item.indent);
+        break;
+    }
+    case Item::Declarators:
+    {
+        const auto *node = static_cast<const VariableDeclaration *>(item.target);
+        if (item.index >= node->declarations.size())
+            break;
+        stack.push_back(next);
+        const VariableDeclarator &decl = node->declarations[item.index];
+        printIndent(item.indent + 1);
+        out.append(typeNameSpelling(decl.type));
+        out.put(' ');
+        printName(decl.name);
+        out.append(" =\n");
+        push(decl.init, item.indent + 2);
+        break;
+    }
+    case Item::Segments:
+    {
+        const auto *node = static_cast<const TemplateLiteral *>(item.target);
+        if (item.index >= node->segments.size())
+            break;
+        stack.push_back(next);
+        const TemplateSegment &segment = node->segments[item.index];
+        if (segment.length > 0)
+        {
+            printIndent(item.indent + 1);
+            out.append("Text: \"");
+            printName(segment.text);
+            out.append("\"\n");
+        }
+        if (item.index < node->expressions.size())
+            push(node->expressions[item.index], item.indent + 1);
+        break;
+    }
+    }
 }
 
 void ASTPrinter::printIndent(int indent)
 {
-    for (int i = 0; i < indent; ++i)
-        std::cout << "  ";
+    out.appendSpaces(2 * static_cast<size_t>(indent));
 }
 
-void ASTPrinter::printProgram(const Program *node, int indent)
+void ASTPrinter::visitProgram(const Program *node, int indent)
 {
     printIndent(indent);
-    std::cout << "Program\n";
-    for (const auto &stmt : node->body)
-        print(stmt.get(), indent + 1);
+    out.append("Program\n");
+    pushList(node->body, indent + 1);
 }
 
-void ASTPrinter::printLiteral(const LiteralExpression *node, int indent)
+void ASTPrinter::visitLiteralExpression(const LiteralExpression *node, int indent)
 {
     printIndent(indent);
     if (node->isString)
-        std::cout << "StringLiteral: \"" << node->strValue << "\"\n";
-    else if (node->isNumber)
-        std::cout << "NumberLiteral: " << node->numValue << "\n";
+    {
+        out.append("StringLiteral: \"");
+        printName(node->strValue);
+        out.append("\"\n");
+    }
+    else
+    {
+        out.append("NumberLiteral: ");
+        out.appendGeneral(node->numValue);
+        out.put('\n');
+    }
 }
 
-void ASTPrinter::printIdentifier(const IdentifierExpression *node, int indent)
+void ASTPrinter::visitIdentifierExpression(const IdentifierExpression *node, int indent)
 {
     printIndent(indent);
-    std::cout << "Identifier: " << node->name << "\n";
+    out.append("Identifier: ");
+    printName(node->name);
+    out.put('\n');
 }
 
-void ASTPrinter::printVarDecl(const VariableDeclaration *node, int indent)
+void ASTPrinter::visitVariableDeclaration(const VariableDeclaration *node, int indent)
 {
     printIndent(indent);
-    std::cout << node->kind << " VariableDeclaration\n";
-    for (const auto &decl : node->declarations)
-    {
-        printIndent(indent + 1);
-        std::cout << decl.type << " " << decl.name << " =\n";
-        print(decl.init.get(), indent + 2);
-    }
+    out.append(declarationKindSpelling(node->kind));
+    out.append(" VariableDeclaration\n");
+    stack.push_back({Item::Declarators, 0, indent, node});
 }
 
-void ASTPrinter::printFuncDecl(const FunctionDeclaration *node, int indent)
+void ASTPrinter::visitFunctionDeclaration(const FunctionDeclaration *node, int indent)
 {
     printIndent(indent);
-    std::cout << "FunctionDeclaration: " << node->name << " -> " << node->returnType << "\n";
+    out.append("FunctionDeclaration: ");
+    printName(node->name);
+    out.append(" -> ");
+    out.append(typeNameSpelling(node->returnType));
+    out.put('\n');
     printIndent(indent + 1);
-    std::cout << "Params:";
+    out.append("Params:");
     for (const auto &param : node->params)
-        std::cout << " " << param.type << " " << param.name;
-    std::cout << "\n";
-    print(node->body.get(), indent + 1);
+    {
+        out.put(' ');
+        out.append(typeNameSpelling(param.type));
+        out.put(' ');
+        printName(param.name);
+    }
+    out.put('\n');
+    push(node->body, indent + 1);
+}
+
+void ASTPrinter::visitBlockStatement(const BlockStatement *node, int indent)
+{
+    printIndent(indent);
+    out.append("Block\n");
+    pushList(node->body, indent + 1);
 }
 
-void ASTPrinter::printBlock(const BlockStatement *node, int indent)
+void ASTPrinter::visitReturnStatement(const ReturnStatement *node, int indent)
 {
     printIndent(indent);
-    std::cout << "Block\n";
-    for (const auto &stmt : node->body)
-        print(stmt.get(), indent + 1);
+    out.append("ReturnStatement\n");
+    push(node->argument, indent + 1);
 }
 
-void ASTPrinter::printReturn(const ReturnStatement *node, int indent)
+void ASTPrinter::visitExpressionStatement(const ExpressionStatement *node, int indent)
 {
     printIndent(indent);
-    std::cout << "ReturnStatement\n";
-    if (node->argument)
-        print(node->argument.get(), indent + 1);
+    out.append("ExpressionStatement\n");
+    push(node->expression, indent + 1);
 }
 
-void ASTPrinter::printExprStmt(const ExpressionStatement *node, int indent)
+void ASTPrinter::visitBinaryExpression(const BinaryExpression *node, int indent)
 {
     printIndent(indent);
-    std::cout << "ExpressionStatement\n";
-    print(node->expression.get(), indent + 1);
+    out.append("BinaryExpression: ");
+    out.append(tokenKindSpelling(node->op));
+    out.put('\n');
+    push(node->right, indent + 1);
+    push(node->left, indent + 1);
 }
 
-void ASTPrinter::printBinary(const BinaryExpression *node, int indent)
+void ASTPrinter::visitAssignmentExpression(const AssignmentExpression *node, int indent)
 {
     printIndent(indent);
-    std::cout << "BinaryExpression: " << node->op << "\n";
-    print(node->left.get(), indent + 1);
-    print(node->right.get(), indent + 1);
+    out.append("AssignmentExpression: ");
+    out.append(tokenKindSpelling(node->op));
+    out.put('\n');
+    printIndent(indent + 1);
+    out.append("Identifier: ");
+    printName(node->name);
+    out.put('\n');
+    push(node->value, indent + 1);
 }
 
-void ASTPrinter::printCall(const CallExpression *node, int indent)
+void ASTPrinter::visitCallExpression(const CallExpression *node, int indent)
 {
     printIndent(indent);
-    std::cout << "CallExpression\n";
-    print(node->callee.get(), indent + 1);
-    for (const auto &arg : node->arguments)
-        print(arg.get(), indent + 2);
-}
\ No newline at end of file
+    out.append("CallExpression\n");
+    pushList(node->arguments, indent + 2);
+    push(node->callee, indent + 1);
+}
+
+void ASTPrinter::visitTemplateLiteral(const TemplateLiteral *node, int indent)
+{
+    printIndent(indent);
+    out.append("TemplateLiteral\n");
+    stack.push_back({Item::Segments, 0, indent, node});
+}
@@ -2,24 +2,60 @@
 #include <iostream>
 #include <memory>
 #include <vector>
-#include "parser.hpp"
+#include "ast_visitor.hpp"
+#include "output_buffer.hpp"
 
-// AST pretty printer for debugging
-class ASTPrinter
+// AST pretty printer for debugging, and the text backend of writeAst()
+// (ast_output.hpp). The tree is walked with an explicit stack, so nesting
+// depth is bounded by memory rather than by the call stack.
+class ASTPrinter : public ASTVisitor<ASTPrinter>
 {
 public:
-    static void print(const ASTNode *node, int indent = 0);
+    static void print(const ASTNode *node, const Interner &symbols, int indent = 0);
+    static void print(OutputBuffer &out, const ASTNode *node, const Interner &symbols, int indent = 0);
 
 private:
-    static void printIndent(int indent);
-    static void printProgram(const Program *node, int indent);
-    static void printLiteral(const LiteralExpression *node, int indent);
-    static void printIdentifier(const IdentifierExpression *node, int indent);
-    static void printVarDecl(const VariableDeclaration *node, int indent);
-    static void printFuncDecl(const FunctionDeclaration *node, int indent);
-    static void printBlock(const BlockStatement *node, int indent);
-    static void printReturn(const ReturnStatement *node, int indent);
-    static void printExprStmt(const ExpressionStatement *node, int indent);
-    static void printBinary(const BinaryExpression *node, int indent);
-    static void printCall(const CallExpression *node, int indent);
-};
\ No newline at end of file
+    friend ASTVisitor<ASTPrinter>;
+
+    // Pending work: a node, or the rest of a list that prints one entry at
+    // a time so that the stack stays as deep as the tree, not as wide.
+    struct Item
+    {
+        enum Kind : uint8_t
+        {
+            Node,
+            NodeList,    // target: ArenaList<ASTNode *>
+            Declarators, // target: VariableDeclaration
+            Segments     // target: TemplateLiteral
+        };
+        Kind kind;
+        uint32_t index;
+        int indent;
+        const void *target;
+    };
+
+    OutputBuffer &out;
+    const Interner &symbols;
+    std::vector<Item> stack;
+
+    ASTPrinter(OutputBuffer &out, const Interner &symbols);
+
+    void run(const ASTNode *root, int indent);
+    void push(const ASTNode *node, int indent);
+    void pushList(const ArenaList<ASTNode *> &list, int indent);
+    void step(const Item &item);
+    void printIndent(int indent);
+    void printName(Symbol symbol) { out.append(symbols.name(symbol)); }
+    void visitProgram(const Program *node, int indent);
+    void visitLiteralExpression(const LiteralExpression *node, int indent);
+    void visitIdentifierExpression(const IdentifierExpression *node, int indent);
+    void visitVariableDeclaration(const VariableDeclaration *node, int indent);
+    void visitFunctionDeclaration(const FunctionDeclaration *node, int indent);
+    void visitBlockStatement(const BlockStatement *node, int indent);
+    void visitReturnStatement(const ReturnStatement *node, int indent);
+    void visitExpressionStatement(const ExpressionStatement *node, int indent);
+    void visitBinaryExpression(const BinaryExpression *node, int indent);
+    void visitAssignmentExpression(const AssignmentExpression *node, int indent);
+    void visitCallExpression(const CallExpression *node, int indent);
+    void visitTemplateLiteral(const TemplateLiteral *node, int indent);
+};
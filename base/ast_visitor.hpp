@@ -0,0 +1,37 @@
+#pragma once
+#include <type_traits>
+#include <utility>
+#include "parser.hpp"
+
+// CRTP visitor: visit() switches once on ASTNode::nodeKind and calls the
+// derived class handler named after the node type (visitBinaryExpression(),
+// visitCallExpression(), ...), forwarding any extra arguments.
+// Derived classes implement a handler for every node type they can reach.
+template <typename Derived, typename Result, bool IsConst>
+class ASTVisitorBase
+{
+    template <typename T>
+    using NodePtr = std::conditional_t<IsConst, const T *, T *>;
+
+public:
+    template <typename... Args>
+    Result visit(NodePtr<ASTNode> node, Args &&...args)
+    {
+        Derived &self = static_cast<Derived &>(*this);
+        switch (node->nodeKind)
+        {
+#define BASE_VISIT_CASE(type) \
+    case NodeKind::type:      \
+        return self.visit##type(static_cast<NodePtr<type>>(node), std::forward<Args>(args)...);
+            BASE_AST_NODES(BASE_VISIT_CASE)
+#undef BASE_VISIT_CASE
+        }
+        return Result();
+    }
+};
+
+template <typename Derived, typename Result = void>
+using ASTVisitor = ASTVisitorBase<Derived, Result, true>;
+
+template <typename Derived, typename Result = void>
+using MutableASTVisitor = ASTVisitorBase<Derived, Result, false>;
@@ -0,0 +1,161 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <system_error>
+#include "checker.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include "source_buffer.hpp"
+
+namespace fs = std::filesystem;
+
+bool matchGlob(std::string_view pattern, std::string_view path)
+{
+    while (!pattern.empty())
+    {
+        if (pattern.substr(0, 3) == "**/")
+        {
+            // Zero or more whole directories.
+            std::string_view rest = pattern.substr(3);
+            for (size_t i = 0;; i = path.find('/', i) + 1)
+            {
+                if (matchGlob(rest, path.substr(i)))
+                    return true;
+                if (path.find('/', i) == std::string_view::npos)
+                    return false;
+            }
+        }
+        if (pattern.substr(0, 2) == "**")
+        {
+            std::string_view rest = pattern.substr(2);
+            for (size_t i = 0; i <= path.size(); i++)
+                if (matchGlob(rest, path.substr(i)))
+                    return true;
+            return false;
+        }
+        if (pattern[0] == '*')
+        {
+            std::string_view rest = pattern.substr(1);
+            for (size_t i = 0; i <= path.size(); i++)
+            {
+                if (matchGlob(rest, path.substr(i)))
+                    return true;
+                if (i < path.size() && path[i] == '/')
+                    return false;
+            }
+            return false;
+        }
+        if (path.empty() || (pattern[0] == '?' ? path[0] == '/' : pattern[0] != path[0]))
+            return false;
+        pattern.remove_prefix(1);
+        path.remove_prefix(1);
+    }
+    return path.empty();
+}
+
+static bool isSourceFile(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext == ".base" || ext == ".bxml";
+}
+
+static void collectDirectory(const fs::path &root, std::string_view pattern, bool recursive, std::vector<std::string> &files)
+{
+    std::error_code ec;
+    auto consider = [&](const fs::directory_entry &entry)
+    {
+        std::error_code fileError;
+        if (!entry.is_regular_file(fileError) || !isSourceFile(entry.path()))
+            return;
+        if (pattern.empty())
+        {
+            files.push_back(entry.path().generic_string());
+            return;
+        }
+        std::string relative = entry.path().lexically_relative(root).generic_string();
+        if (matchGlob(pattern, relative))
+            files.push_back(root == "." ? relative : (root / relative).generic_string());
+    };
+    if (recursive)
+    {
+        fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+        for (; !ec && it != end; it.increment(ec))
+            consider(*it);
+    }
+    else
+    {
+        fs::directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+        for (; !ec && it != end; it.increment(ec))
+            consider(*it);
+    }
+}
+
+std::vector<std::string> collectSourceFiles(const std::vector<std::string> &args, std::vector<std::string> &unmatched)
+{
+    std::vector<std::string> files;
+    for (std::string arg : args)
+    {
+#ifdef _WIN32
+        std::replace(arg.begin(), arg.end(), '\\', '/');
+#endif
+        size_t before = files.size();
+        size_t wildcard = arg.find_first_of("*?");
+        std::error_code ec;
+        if (wildcard != std::string::npos)
+        {
+            // Search from the deepest directory without wildcards.
+            size_t slash = arg.rfind('/', wildcard);
+            fs::path root = slash == std::string::npos ? fs::path(".") : fs::path(arg.substr(0, slash + 1));
+            std::string_view pattern = std::string_view(arg).substr(slash == std::string::npos ? 0 : slash + 1);
+            bool recursive = pattern.find('/') != std::string_view::npos || pattern.find("**") != std::string_view::npos;
+            collectDirectory(root, pattern, recursive, files);
+        }
+        else if (fs::is_directory(arg, ec))
+            collectDirectory(arg, {}, true, files);
+        else if (fs::exists(arg, ec))
+            files.push_back(arg);
+        if (files.size() == before)
+            unmatched.push_back(arg);
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+std::vector<CheckResult> checkFiles(const std::vector<std::string> &paths, WorkStealingPool &pool,
+                                    const AstCache *cache)
+{
+    std::vector<CheckResult> results(paths.size());
+    pool.run(paths.size(), [&](size_t i)
+    {
+        // Every file gets its own lexer, parser, arena and interner, so the
+        // workers share nothing but the read-only character tables and the
+        // cache directory.
+        BASE_TRACE_SCOPE("checkFile", "check");
+        CheckResult &result = results[i];
+        result.path = paths[i];
+        SourceBuffer source;
+        if (!source.open(paths[i]))
+        {
+            result.error = "Cannot open file";
+            return;
+        }
+        result.bytes = source.size();
+        if (cache && cache->contains(source.view()))
+            return;
+        Diagnostics diagnostics;
+        Lexer lexer(source.view());
+        Parser parser(lexer, diagnostics);
+        std::unique_ptr<Program> program = parser.parse();
+        if (!diagnostics.hasErrors())
+            Checker::check(*program, diagnostics);
+        if (diagnostics.hasErrors())
+            result.diagnostics = diagnostics.all();
+        else if (cache)
+            cache->store(source.view(), *program);
+    });
+    return results;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast_cache.hpp"
+#include "diagnostics.hpp"
+#include "thread_pool.hpp"
+
+// base check: lexes and parses many source files in parallel and reports the
+// errors of all of them in path order.
+
+// Outcome of checking one file: every syntax error in it or, if it parsed,
+// every error the Checker found; or an error that kept it from being parsed
+// at all (it could not be read).
+struct CheckResult
+{
+    std::string path;
+    uint64_t bytes = 0;
+    std::string error;
+    std::vector<Diagnostic> diagnostics;
+
+    bool failed() const { return !error.empty() || !diagnostics.empty(); }
+};
+
+// Matches a path against a glob pattern with '/' as separator. '*' and '?'
+// match within one path component; "**/" matches any number of directories.
+bool matchGlob(std::string_view pattern, std::string_view path);
+
+// Expands the command line arguments into a sorted, duplicate-free list of
+// files. Directories are searched recursively and globs are matched, both for
+// .base and .bxml files; plain file names are taken as given. Arguments that
+// match nothing are appended to unmatched.
+std::vector<std::string> collectSourceFiles(const std::vector<std::string> &args, std::vector<std::string> &unmatched);
+
+// Lexes, parses and checks every file on the pool. Results are in the order
+// of paths whatever order the workers finished in. With a cache, files with
+// a cached tree are known to be free of errors and are not read further;
+// new trees that check are stored.
+std::vector<CheckResult> checkFiles(const std::vector<std::string> &paths, WorkStealingPool &pool,
+                                    const AstCache *cache = nullptr);
@@ -0,0 +1,104 @@
+#include "bytecode.hpp"
+#include <utility>
+
+const char *opcodeName(Opcode op)
+{
+    switch (op)
+    {
+#define BASE_OPCODE_NAME(name) \
+    case Opcode::name:         \
+        return #name;
+        BASE_OPCODES(BASE_OPCODE_NAME)
+#undef BASE_OPCODE_NAME
+    }
+    return "?";
+}
+
+Module::~Module() { releaseConstants(); }
+
+Module::Module(Module &&other) noexcept { *this = std::move(other); }
+
+Module &Module::operator=(Module &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    releaseConstants();
+    functions = std::move(other.functions);
+    constants = std::move(other.constants);
+    templates = std::move(other.templates);
+    globalNames = std::move(other.globalNames);
+    other.constants.clear();
+    return *this;
+}
+
+void Module::releaseConstants()
+{
+    for (const Value &value : constants)
+        if (value.isString())
+            release(value.string);
+    constants.clear();
+}
+
+static void printConstant(std::ostream &out, const Value &value)
+{
+    if (value.isString())
+        out << '"' << value.string->view() << '"';
+    else if (value.isNumber())
+        out << formatNumber(value.number);
+    else
+        out << "void";
+}
+
+void Module::disassemble(std::ostream &out) const
+{
+    for (size_t f = 0; f < functions.size(); f++)
+    {
+        const Function &fn = functions[f];
+        out << "function " << f << " " << fn.name << " (params " << fn.numParams
+            << ", registers " << fn.numRegisters << ")\n";
+        for (size_t i = 0; i < fn.code.size(); i++)
+        {
+            const Instruction &ins = fn.code[i];
+            out << "  " << i << "\t[" << fn.lines[i] << "]\t" << opcodeName(ins.op) << "\t";
+            switch (ins.op)
+            {
+            case Opcode::LoadK:
+                out << "r" << ins.a << ", ";
+                printConstant(out, constants[ins.bx()]);
+                break;
+            case Opcode::LoadVoid:
+            case Opcode::Print:
+            case Opcode::Return:
+                out << "r" << ins.a;
+                break;
+            case Opcode::Move:
+                out << "r" << ins.a << ", r" << ins.b;
+                break;
+            case Opcode::GetGlobal:
+            case Opcode::SetGlobal:
+                out << "r" << ins.a << ", " << globalNames[ins.bx()];
+                break;
+            case Opcode::AddK:
+            case Opcode::SubK:
+            case Opcode::MulK:
+            case Opcode::DivK:
+                out << "r" << ins.a << ", r" << ins.b << ", ";
+                printConstant(out, constants[ins.c]);
+                break;
+            case Opcode::Call:
+                out << "r" << ins.a << ", " << functions[ins.bx()].name;
+                break;
+            case Opcode::Template:
+                out << "r" << ins.a << ", `" << templates[ins.bx()].text << "` (" << templates[ins.bx()].segmentLengths.size() - 1
+                    << " values)";
+                break;
+            case Opcode::ReturnVoid:
+                break;
+            default:
+                out << "r" << ins.a << ", r" << ins.b << ", r" << ins.c;
+                break;
+            }
+            out << "\n";
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "value.hpp"
+
+// Register bytecode. Every function owns a window of registers; locals live
+// in fixed registers chosen by the compiler and temporaries are stacked above
+// them. Operands named R are registers, K are constant pool indices, G are
+// global slots, F are function indices and T are template indices.
+#define BASE_OPCODES(X)                                        \
+    X(LoadK)      /* R[a] = K[bx]                            */ \
+    X(LoadVoid)   /* R[a] = void                             */ \
+    X(Move)       /* R[a] = R[b]                             */ \
+    X(GetGlobal)  /* R[a] = G[bx]                            */ \
+    X(SetGlobal)  /* G[bx] = R[a]                            */ \
+    X(Add)        /* R[a] = R[b] + R[c]                      */ \
+    X(Sub)        /* R[a] = R[b] - R[c]                      */ \
+    X(Mul)        /* R[a] = R[b] * R[c]                      */ \
+    X(Div)        /* R[a] = R[b] / R[c]                      */ \
+    X(AddK)       /* R[a] = R[b] + K[c]                      */ \
+    X(SubK)       /* R[a] = R[b] - K[c]                      */ \
+    X(MulK)       /* R[a] = R[b] * K[c]                      */ \
+    X(DivK)       /* R[a] = R[b] / K[c]                      */ \
+    X(Concat)     /* R[a] = text(R[b]) then text(R[c])       */ \
+    X(Eq)         /* R[a] = R[b] == R[c] ? 1 : 0             */ \
+    X(Ne)         /* R[a] = R[b] != R[c] ? 1 : 0             */ \
+    X(Lt)         /* R[a] = R[b] < R[c] ? 1 : 0              */ \
+    X(Le)         /* R[a] = R[b] <= R[c] ? 1 : 0             */ \
+    X(Gt)         /* R[a] = R[b] > R[c] ? 1 : 0              */ \
+    X(Ge)         /* R[a] = R[b] >= R[c] ? 1 : 0             */ \
+    X(Call)       /* R[a] = F[bx](R[a], R[a+1], ...)         */ \
+    X(Template)   /* R[a] = T[bx] filled with R[a], R[a+1].. */ \
+    X(Print)      /* print R[a]                              */ \
+    X(Return)     /* return R[a]                             */ \
+    X(ReturnVoid) /* return void                             */
+
+enum class Opcode : uint8_t
+{
+#define BASE_OPCODE_ENUM(name) name,
+    BASE_OPCODES(BASE_OPCODE_ENUM)
+#undef BASE_OPCODE_ENUM
+};
+
+const char *opcodeName(Opcode op);
+
+struct Instruction
+{
+    Opcode op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    // b and c read together as one 32-bit operand.
+    uint32_t bx() const { return b | (static_cast<uint32_t>(c) << 16); }
+
+    static Instruction abc(Opcode op, uint32_t a, uint32_t b = 0, uint32_t c = 0)
+    {
+        return {op, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c)};
+    }
+    static Instruction abx(Opcode op, uint32_t a, uint32_t bx)
+    {
+        return {op, static_cast<uint16_t>(a), static_cast<uint16_t>(bx & 0xFFFF), static_cast<uint16_t>(bx >> 16)};
+    }
+};
+
+static_assert(sizeof(Instruction) == 8, "Instruction should stay one 64-bit word");
+
+constexpr uint32_t MaxRegisters = 0xFFFF;
+
+struct Function
+{
+    std::string name;
+    uint32_t numParams = 0;
+    uint32_t numRegisters = 0;
+    std::vector<Instruction> code;
+    std::vector<int> lines; // source line of each instruction
+};
+
+// Constant text of a template literal. The values of its n placeholders go
+// between n + 1 segments stored back to back in text.
+struct Template
+{
+    std::string text;
+    std::vector<uint32_t> segmentLengths;
+};
+
+// A compiled program. Function 0 is the top-level code.
+class Module
+{
+public:
+    Module() = default;
+    ~Module();
+    Module(const Module &) = delete;
+    Module &operator=(const Module &) = delete;
+    Module(Module &&other) noexcept;
+    Module &operator=(Module &&other) noexcept;
+
+    std::vector<Function> functions;
+    std::vector<Value> constants; // strings here are owned by the module
+    std::vector<Template> templates;
+    std::vector<std::string> globalNames;
+
+    static constexpr uint32_t MainFunction = 0;
+
+    void disassemble(std::ostream &out) const;
+
+private:
+    void releaseConstants();
+};
@@ -0,0 +1,848 @@
+#include "c_generator.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include "profile.hpp"
+#ifdef _WIN32
+#include <process.h>
+#include <random>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#endif
+
+namespace
+{
+
+// Everything a generated program needs besides the C library. Strings with
+// refs == 0 are literals and never freed. Numbers are formatted as the VM's
+// formatNumber() does, and runtime errors read as the VM's.
+const char *const RuntimeSource = R"c(#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct BaseString
+{
+    size_t refs;
+    size_t length;
+    const char *chars;
+} BaseString;
+
+/* A template placeholder value. */
+typedef struct BasePart
+{
+    int isString;
+    double number;
+    const BaseString *string;
+} BasePart;
+
+/* count placeholders go between count + 1 segments stored back to back. */
+typedef struct BaseTemplate
+{
+    size_t count;
+    const size_t *lengths;
+    const char *text;
+} BaseTemplate;
+
+#define BASE_MAX_DEPTH 65536
+#define BASE_NUMBER_BUFFER 32
+
+static unsigned long base_depth;
+
+static void base_fail(int line, const char *before, const char *name, const char *after)
+{
+    fflush(stdout);
+    fprintf(stderr, "Runtime error at line %d: %s%s%s\n", line, before, name, after);
+    exit(1);
+}
+
+/* A return at the top level ends the program, whichever base_main chunk
+   it is in. */
+static void base_exit(void)
+{
+    fflush(stdout);
+    exit(0);
+}
+
+static void base_uninitialized(int line, const char *name)
+{
+    base_fail(line, "Global '", name, "' is used before its declaration has run");
+}
+
+static void base_enter(int line, const char *name)
+{
+    if (base_depth >= BASE_MAX_DEPTH)
+        base_fail(line, "Stack overflow in call to '", name, "'");
+    base_depth++;
+}
+
+static BaseString *base_allocate(size_t length, char **chars)
+{
+    BaseString *s = (BaseString *)malloc(sizeof(BaseString) + length);
+    if (!s)
+    {
+        fflush(stdout);
+        fputs("Out of memory\n", stderr);
+        exit(1);
+    }
+    s->refs = 1;
+    s->length = length;
+    *chars = (char *)(s + 1);
+    s->chars = *chars;
+    return s;
+}
+
+static void base_retain(BaseString *s)
+{
+    if (s->refs)
+        s->refs++;
+}
+
+static void base_release(BaseString *s)
+{
+    if (s && s->refs && --s->refs == 0)
+        free(s);
+}
+
+static size_t base_format_number(double value, char *buffer)
+{
+    const char *special = 0;
+    if (isnan(value))
+        special = "NaN";
+    else if (isinf(value))
+        special = value > 0 ? "Infinity" : "-Infinity";
+    else if (value == 0)
+        special = "0";
+    if (special)
+    {
+        strcpy(buffer, special);
+        return strlen(special);
+    }
+    if (value == trunc(value) && fabs(value) < 1e15)
+        return (size_t)snprintf(buffer, BASE_NUMBER_BUFFER, "%.0f", value);
+    return (size_t)snprintf(buffer, BASE_NUMBER_BUFFER, "%.15g", value);
+}
+
+static void base_print_string(const BaseString *s)
+{
+    fwrite(s->chars, 1, s->length, stdout);
+    putchar('\n');
+}
+
+static void base_print_number(double value)
+{
+    char buffer[BASE_NUMBER_BUFFER + 1];
+    size_t length = base_format_number(value, buffer);
+    buffer[length] = '\n';
+    fwrite(buffer, 1, length + 1, stdout);
+}
+
+static BaseString *base_concat(const char *a, size_t aLength, const char *b, size_t bLength)
+{
+    char *chars;
+    BaseString *s = base_allocate(aLength + bLength, &chars);
+    memcpy(chars, a, aLength);
+    memcpy(chars + aLength, b, bLength);
+    return s;
+}
+
+static BaseString *base_concat_ss(const BaseString *a, const BaseString *b)
+{
+    return base_concat(a->chars, a->length, b->chars, b->length);
+}
+
+static BaseString *base_concat_sn(const BaseString *a, double b)
+{
+    char buffer[BASE_NUMBER_BUFFER];
+    return base_concat(a->chars, a->length, buffer, base_format_number(b, buffer));
+}
+
+static BaseString *base_concat_ns(double a, const BaseString *b)
+{
+    char buffer[BASE_NUMBER_BUFFER];
+    size_t length = base_format_number(a, buffer);
+    return base_concat(buffer, length, b->chars, b->length);
+}
+
+/* Bytewise, as std::string_view::compare. */
+static int base_compare(const BaseString *a, const BaseString *b)
+{
+    size_t length = a->length < b->length ? a->length : b->length;
+    int order = length ? memcmp(a->chars, b->chars, length) : 0;
+    if (order)
+        return order;
+    return a->length < b->length ? -1 : a->length > b->length;
+}
+
+/* Numbers are formatted twice, once to measure and once to copy, so the
+   result is allocated once at its exact size. */
+static BaseString *base_template(const BaseTemplate *t, const BasePart *parts)
+{
+    char buffer[BASE_NUMBER_BUFFER];
+    size_t length = 0, i;
+    char *out;
+    const char *text = t->text;
+    BaseString *s;
+    for (i = 0; i <= t->count; i++)
+        length += t->lengths[i];
+    for (i = 0; i < t->count; i++)
+        length += parts[i].isString ? parts[i].string->length : base_format_number(parts[i].number, buffer);
+    s = base_allocate(length, &out);
+    for (i = 0;; i++)
+    {
+        memcpy(out, text, t->lengths[i]);
+        out += t->lengths[i];
+        text += t->lengths[i];
+        if (i == t->count)
+            break;
+        if (parts[i].isString)
+        {
+            memcpy(out, parts[i].string->chars, parts[i].string->length);
+            out += parts[i].string->length;
+        }
+        else
+        {
+            size_t n = base_format_number(parts[i].number, buffer);
+            memcpy(out, buffer, n);
+            out += n;
+        }
+    }
+    return s;
+}
+)c";
+
+const char *cType(TypeName type)
+{
+    switch (type)
+    {
+    case TypeName::Number:
+        return "double";
+    case TypeName::String:
+        return "BaseString *";
+    default:
+        return "void";
+    }
+}
+
+// A declaration of variable with type, spaced as C is usually written.
+std::string declare(TypeName type, const std::string &variable)
+{
+    return type == TypeName::String ? "BaseString *" + variable : std::string(cType(type)) + " " + variable;
+}
+
+// A C string literal for text. Octal escapes always have three digits, so
+// a digit after one cannot extend it, and ? is escaped against trigraphs.
+std::string cString(std::string_view text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n')
+            out += "\\n";
+        else if (u < 0x20 || u >= 0x7F)
+        {
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", u);
+            out += escape;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+// A C double constant that reads back as exactly value.
+std::string numberLiteral(double value)
+{
+    if (std::isnan(value))
+        return "NAN";
+    if (std::isinf(value))
+        return value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.17g", value);
+    std::string out = text;
+    if (out.find_first_of(".e") == std::string::npos)
+        out += ".0";
+    return value < 0 ? "(" + out + ")" : out;
+}
+
+const char *cOperator(TokenKind op)
+{
+    switch (op)
+    {
+    case TokenKind::Plus:
+        return "+";
+    case TokenKind::Minus:
+        return "-";
+    case TokenKind::Star:
+        return "*";
+    case TokenKind::Slash:
+        return "/";
+    default:
+        return tokenKindSpelling(op);
+    }
+}
+
+std::string localName(uint32_t slot)
+{
+    return "l" + std::to_string(slot);
+}
+
+std::string globalName(uint32_t slot)
+{
+    return "g" + std::to_string(slot);
+}
+
+std::string functionName(uint32_t index)
+{
+    return "f" + std::to_string(index);
+}
+
+} // namespace
+
+CGenerator::CGenerator(const Program *program)
+    : symbols(program->symbols),
+      stringConstants(program->symbols.size() + 1, -1),
+      globalTypes(program->globalCount),
+      globalNames(program->globalCount),
+      globalReady(program->globalCount, false)
+{
+}
+
+std::string CGenerator::generate(const Program *program)
+{
+    BASE_TRACE_SCOPE("CGenerator::generate", "codegen");
+    CGenerator generator(program);
+    generator.visit(program);
+    return std::move(generator.definitions);
+}
+
+void CGenerator::line(const std::string &text)
+{
+    current->body.append(static_cast<size_t>(current->indent) * 4, ' ');
+    current->body += text;
+    current->body += '\n';
+}
+
+void CGenerator::release(const CValue &value)
+{
+    if (value.owned)
+        line("base_release(" + value.text + ");");
+}
+
+void CGenerator::releaseLocals(size_t mark)
+{
+    for (size_t i = current->stringLocals.size(); i-- > mark;)
+        line("base_release(" + current->stringLocals[i] + ");");
+}
+
+std::string CGenerator::stringConstant(Symbol value)
+{
+    int32_t &index = stringConstants[value];
+    if (index < 0)
+    {
+        index = static_cast<int32_t>(stringCount++);
+        std::string_view text = symbols.name(value);
+        constants += "static BaseString k" + std::to_string(index) + " = {0, " + std::to_string(text.size()) + ", " +
+                     cString(text) + "};\n";
+    }
+    return "&k" + std::to_string(index);
+}
+
+CValue CGenerator::valueNow(const ASTNode *node) { return copyLocal(visit(node), node->valueType); }
+
+CValue CGenerator::copyLocal(CValue value, TypeName type)
+{
+    if (!value.local)
+        return value;
+    std::string copy = temp();
+    line(declare(type, copy) + " = " + value.text + ";");
+    if (type != TypeName::String)
+        return {copy};
+    line("base_retain(" + copy + ");");
+    return {copy, true};
+}
+
+CValue CGenerator::readGlobal(uint32_t slot, int sourceLine)
+{
+    std::string global = globalName(slot);
+    bool isString = globalTypes[slot] == TypeName::String;
+    // Top-level code after the declaration always finds it run; functions
+    // may be called before it.
+    if (current->declaration || !globalReady[slot])
+        line("if (!" + (isString ? global : global + "_set") + ") base_uninitialized(" + std::to_string(sourceLine) +
+             ", " + cString(globalNames[slot]) + ");");
+    std::string copy = temp();
+    line(declare(globalTypes[slot], copy) + " = " + global + ";");
+    if (!isString)
+        return {copy};
+    line("base_retain(" + copy + ");");
+    return {copy, true};
+}
+
+void CGenerator::storeGlobal(uint32_t slot, const CValue &value)
+{
+    std::string global = globalName(slot);
+    if (globalTypes[slot] == TypeName::String)
+        storeString(global, value);
+    else
+        line(global + " = " + value.text + ", " + global + "_set = 1;");
+}
+
+void CGenerator::storeString(const std::string &variable, const CValue &value)
+{
+    // Retained before the old string goes, which may be the same one.
+    if (!value.owned)
+        line("base_retain(" + value.text + ");");
+    line("base_release(" + variable + ");");
+    line(variable + " = " + value.text + ";");
+}
+
+CValue CGenerator::operation(TokenKind op, TypeName type, const CValue &left, TypeName leftType, const CValue &right,
+                             TypeName rightType)
+{
+    std::string result = temp();
+    if (type == TypeName::String)
+    {
+        const char *concat = leftType != TypeName::String    ? "base_concat_ns"
+                             : rightType != TypeName::String ? "base_concat_sn"
+                                                             : "base_concat_ss";
+        line("BaseString *" + result + " = " + concat + "(" + left.text + ", " + right.text + ");");
+        release(left);
+        release(right);
+        return {result, true};
+    }
+    std::string value;
+    bool comparison = op != TokenKind::Plus && op != TokenKind::Minus && op != TokenKind::Star &&
+                      op != TokenKind::Slash;
+    if (leftType == rightType && leftType == TypeName::String)
+        value = "base_compare(" + left.text + ", " + right.text + ") " + cOperator(op) + " 0";
+    else if (leftType != rightType && comparison)
+        value = op == TokenKind::BangEqual ? "1" : "0"; // a string never equals a number
+    else
+        value = left.text + " " + cOperator(op) + " " + right.text;
+    line("double " + result + " = " + value + ";");
+    release(left);
+    release(right);
+    return {result};
+}
+
+void CGenerator::generateBlock(const ArenaList<ASTNode *> &body)
+{
+    size_t mark = current->stringLocals.size();
+    for (const ASTNode *stmt : body)
+        visit(stmt);
+    releaseLocals(mark);
+    current->stringLocals.resize(mark);
+}
+
+CValue CGenerator::visitProgram(const Program *node)
+{
+    for (const ASTNode *stmt : node->body)
+        if (const auto *decl = nodeCast<VariableDeclaration>(stmt))
+            for (const VariableDeclarator &declarator : decl->declarations)
+            {
+                globalTypes[declarator.binding.slot] = declarator.type;
+                globalNames[declarator.binding.slot] = symbols.name(declarator.name);
+            }
+
+    // The top level goes into a run of functions of bounded size, as C
+    // compilers slow down badly on one huge function. Temporaries never
+    // outlive their statement, so any statement boundary will do.
+    const size_t ChunkSize = 32 * 1024;
+    std::string chunks, calls;
+    uint32_t chunkCount = 0;
+    FunctionState state;
+    current = &state;
+    auto flush = [&]()
+    {
+        std::string name = "base_main" + std::to_string(chunkCount++);
+        chunks += "static void " + name + "(void)\n{\n" + state.body + "}\n\n";
+        calls += "    " + name + "();\n";
+        state.body.clear();
+        state.temps = 0;
+    };
+    for (const ASTNode *stmt : node->body)
+    {
+        visit(stmt);
+        if (state.body.size() >= ChunkSize)
+            flush();
+    }
+    if (!state.body.empty() || chunkCount == 0)
+        flush();
+    current = nullptr;
+
+    std::string globals;
+    for (uint32_t slot = 0; slot < node->globalCount; slot++)
+    {
+        std::string global = globalName(slot);
+        if (globalTypes[slot] == TypeName::String)
+            globals += "static BaseString *" + global + ";";
+        else
+            globals += "static double " + global + ";\nstatic int " + global + "_set;";
+        globals += " /* " + globalNames[slot] + " */\n";
+    }
+
+    std::string out = "/* Generated by base build. */\n";
+    out += RuntimeSource;
+    out += "\n" + constants + "\n" + globals + "\n" + prototypes + "\n" + definitions;
+    out += chunks;
+    out += "int main(void)\n"
+           "{\n"
+           "    static char buffer[64 * 1024];\n"
+           "    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));\n" +
+           calls +
+           "    fflush(stdout);\n"
+           "    return 0;\n"
+           "}\n";
+    definitions = std::move(out);
+    return {};
+}
+
+CValue CGenerator::visitLiteralExpression(const LiteralExpression *node)
+{
+    if (node->isString)
+        return {stringConstant(node->strValue)};
+    return {numberLiteral(node->numValue)};
+}
+
+CValue CGenerator::visitIdentifierExpression(const IdentifierExpression *node)
+{
+    if (node->binding.kind == BindingKind::Global)
+        return readGlobal(node->binding.slot, node->line);
+    return {localName(node->binding.slot), false, true};
+}
+
+CValue CGenerator::visitVariableDeclaration(const VariableDeclaration *node)
+{
+    for (const VariableDeclarator &declarator : node->declarations)
+    {
+        if (!declarator.init)
+            continue;
+        CValue value = visit(declarator.init);
+        uint32_t slot = declarator.binding.slot;
+        if (declarator.binding.kind == BindingKind::Global)
+        {
+            storeGlobal(slot, value);
+            globalReady[slot] = true;
+            continue;
+        }
+        std::string local = localName(slot);
+        line(declare(declarator.type, local) + " = " + value.text + ";");
+        if (declarator.type == TypeName::String)
+        {
+            if (!value.owned)
+                line("base_retain(" + local + ");");
+            current->stringLocals.push_back(local);
+        }
+    }
+    return {};
+}
+
+CValue CGenerator::visitFunctionDeclaration(const FunctionDeclaration *node)
+{
+    std::string signature = "static " + std::string(cType(node->returnType)) +
+                            (node->returnType == TypeName::String ? "" : " ") + functionName(node->index) + "(";
+    for (uint32_t i = 0; i < node->params.count; i++)
+        signature += (i ? ", " : "") + declare(node->params[i].type, localName(i));
+    signature += node->params.count ? ")" : "void)";
+    prototypes += signature + "; /* " + std::string(symbols.name(node->name)) + " */\n";
+
+    FunctionState state;
+    state.declaration = node;
+    FunctionState *enclosing = current;
+    current = &state;
+    // Parameters are owned by the callee, which may assign to them.
+    for (uint32_t i = 0; i < node->params.count; i++)
+        if (node->params[i].type == TypeName::String)
+        {
+            line("base_retain(" + localName(i) + ");");
+            state.stringLocals.push_back(localName(i));
+        }
+    generateBlock(node->body->body);
+    releaseLocals(0);
+    // The checker proved the end unreachable when a value is due.
+    if (node->returnType != TypeName::Void)
+        line("return 0;");
+    current = enclosing;
+
+    definitions += signature + "\n{\n" + state.body + "}\n\n";
+    return {};
+}
+
+CValue CGenerator::visitBlockStatement(const BlockStatement *node)
+{
+    line("{");
+    current->indent++;
+    generateBlock(node->body);
+    current->indent--;
+    line("}");
+    return {};
+}
+
+CValue CGenerator::visitReturnStatement(const ReturnStatement *node)
+{
+    CValue value = node->argument ? visit(node->argument) : CValue();
+    if (!current->declaration)
+    {
+        // The top level may return a value, which is dropped.
+        release(value);
+        line("base_exit();");
+        return {};
+    }
+    if (current->declaration->returnType == TypeName::Void)
+    {
+        release(value);
+        releaseLocals(0);
+        line("return;");
+        return {};
+    }
+    if (current->declaration->returnType == TypeName::String && !value.owned)
+        line("base_retain(" + value.text + ");");
+    releaseLocals(0);
+    line("return " + value.text + ";");
+    return {};
+}
+
+CValue CGenerator::visitExpressionStatement(const ExpressionStatement *node)
+{
+    release(visit(node->expression));
+    return {};
+}
+
+CValue CGenerator::visitBinaryExpression(const BinaryExpression *node)
+{
+    CValue left = visit(node->left);
+    // A variable or an assignment to one leaves the local itself as the
+    // value; copy it if the right operand assigns it.
+    const Binding *binding = nullptr;
+    if (const auto *ident = nodeCast<IdentifierExpression>(node->left))
+        binding = &ident->binding;
+    else if (const auto *assignment = nodeCast<AssignmentExpression>(node->left))
+        binding = &assignment->binding;
+    if (left.local && binding && assignsLocal(node->right, binding->slot))
+        left = copyLocal(left, node->left->valueType);
+    CValue right = visit(node->right);
+    return operation(node->op, node->valueType, left, node->left->valueType, right, node->right->valueType);
+}
+
+// As in the VM, a local is updated in place and read by later operands. A
+// compound assignment reads the variable before the value, so a value that
+// assigns the local works on a copy.
+CValue CGenerator::visitAssignmentExpression(const AssignmentExpression *node)
+{
+    TokenKind op = node->binaryOperator();
+    TypeName type = node->valueType;
+    uint32_t slot = node->binding.slot;
+    if (node->binding.kind == BindingKind::Local)
+    {
+        std::string local = localName(slot);
+        CValue previous{local, false, true};
+        if (op != TokenKind::Equal && assignsLocal(node->value, slot))
+            previous = copyLocal(previous, type);
+        CValue value = visit(node->value);
+        if (op != TokenKind::Equal)
+            value = operation(op, type, previous, type, value, node->value->valueType);
+        if (type == TypeName::String)
+            storeString(local, value);
+        else
+            line(local + " = " + value.text + ";");
+        return {local, false, true};
+    }
+
+    CValue value;
+    if (op == TokenKind::Equal)
+        value = valueNow(node->value);
+    else
+    {
+        CValue previous = readGlobal(slot, node->line);
+        CValue right = visit(node->value);
+        value = operation(op, type, previous, type, right, node->value->valueType);
+    }
+    storeGlobal(slot, value);
+    if (type != TypeName::String)
+        return value;
+    std::string copy = temp();
+    line("BaseString *" + copy + " = " + globalName(slot) + ";");
+    line("base_retain(" + copy + ");");
+    return {copy, true};
+}
+
+CValue CGenerator::visitCallExpression(const CallExpression *node)
+{
+    const Binding &callee = static_cast<const IdentifierExpression *>(node->callee)->binding;
+    if (callee.kind == BindingKind::Print)
+    {
+        const ASTNode *argument = node->arguments[0];
+        CValue value = visit(argument);
+        line((argument->valueType == TypeName::String ? "base_print_string(" : "base_print_number(") + value.text +
+             ");");
+        release(value);
+        return {};
+    }
+
+    std::vector<CValue> arguments;
+    for (const ASTNode *argument : node->arguments)
+        arguments.push_back(valueNow(argument));
+    std::string call = functionName(callee.slot) + "(";
+    for (size_t i = 0; i < arguments.size(); i++)
+        call += (i ? ", " : "") + arguments[i].text;
+    call += ")";
+
+    std::string name(symbols.name(static_cast<const IdentifierExpression *>(node->callee)->name));
+    line("base_enter(" + std::to_string(node->line) + ", " + cString(name) + ");");
+    CValue result;
+    if (node->valueType == TypeName::Void)
+        line(call + ";");
+    else
+    {
+        result = {temp(), node->valueType == TypeName::String};
+        line(declare(node->valueType, result.text) + " = " + call + ";");
+    }
+    line("base_depth--;");
+    for (const CValue &argument : arguments)
+        release(argument);
+    return result;
+}
+
+CValue CGenerator::visitTemplateLiteral(const TemplateLiteral *node)
+{
+    std::string index = std::to_string(templateCount++);
+    std::string text, lengths;
+    for (const TemplateSegment &segment : node->segments)
+    {
+        text += symbols.name(segment.text);
+        lengths += (lengths.empty() ? "" : ", ") + std::to_string(segment.length);
+    }
+    constants += "static const size_t template" + index + "_lengths[] = {" + lengths + "};\n";
+    constants += "static const BaseTemplate template" + index + " = {" + std::to_string(node->expressions.count) +
+                 ", template" + index + "_lengths, " + cString(text) + "};\n";
+
+    std::vector<CValue> values;
+    std::string parts;
+    for (const ASTNode *expression : node->expressions)
+    {
+        values.push_back(valueNow(expression));
+        parts += parts.empty() ? "{" : ", {";
+        if (expression->valueType == TypeName::String)
+            parts += "1, 0, " + values.back().text + "}";
+        else
+            parts += "0, " + values.back().text + ", 0}";
+    }
+    std::string array = temp();
+    line("BasePart " + array + "[] = {" + parts + "};");
+    std::string result = temp();
+    line("BaseString *" + result + " = base_template(&template" + index + ", " + array + ");");
+    for (const CValue &value : values)
+        release(value);
+    return {result, true};
+}
+
+std::string defaultCCompiler()
+{
+    const char *compiler = std::getenv("CC");
+    return compiler && *compiler ? compiler : "cc";
+}
+
+namespace
+{
+
+// Writes source to a new file in the temporary directory, named so that no
+// other process can have created it first, and returns its path.
+std::filesystem::path writeTemporarySource(const std::string &source)
+{
+    std::string pattern = (std::filesystem::temp_directory_path() / "base-build-XXXXXX.c").string();
+#ifdef _WIN32
+    std::random_device random;
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        std::string path = pattern;
+        const char *digits = "0123456789abcdef";
+        for (size_t i = path.rfind("XXXXXX"), end = i + 6; i < end; i++)
+            path[i] = digits[random() % 16];
+        std::FILE *file = std::fopen(path.c_str(), "wbx"); // fails if it exists
+        if (!file)
+            continue;
+        bool written = std::fwrite(source.data(), 1, source.size(), file) == source.size();
+        if (std::fclose(file) != 0 || !written)
+            break;
+        return path;
+    }
+    throw std::runtime_error("Cannot create a temporary file for the C source");
+#else
+    int fd = mkstemps(pattern.data(), 2);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + pattern);
+    const char *data = source.data();
+    size_t left = source.size();
+    while (left > 0)
+    {
+        ssize_t written = ::write(fd, data, left);
+        if (written <= 0)
+        {
+            ::close(fd);
+            ::unlink(pattern.c_str());
+            throw std::runtime_error("Cannot write " + pattern);
+        }
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    ::close(fd);
+    return pattern;
+#endif
+}
+
+// Runs args[0], found on the PATH, with args and no shell in between.
+// Returns its exit status, or -1 if it could not be run.
+int runCommand(const std::vector<std::string> &args)
+{
+    std::vector<const char *> argv;
+#ifdef _WIN32
+    // _spawnvp joins the arguments into one command line.
+    std::vector<std::string> quoted;
+    for (const std::string &arg : args)
+        quoted.push_back("\"" + arg + "\"");
+    for (const std::string &arg : quoted)
+        argv.push_back(arg.c_str());
+    argv.push_back(nullptr);
+    return static_cast<int>(_spawnvp(_P_WAIT, args[0].c_str(), argv.data()));
+#else
+    for (const std::string &arg : args)
+        argv.push_back(arg.c_str());
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, const_cast<char *const *>(argv.data()), environ) != 0)
+        return -1;
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+} // namespace
+
+void buildExecutable(const std::string &source, const std::filesystem::path &output, const std::string &compiler)
+{
+    BASE_TRACE_SCOPE("buildExecutable", "codegen");
+    std::filesystem::path file = writeTemporarySource(source);
+    int status = runCommand({compiler, "-O2", "-o", output.string(), file.string(), "-lm"});
+    std::error_code ignored;
+    std::filesystem::remove(file, ignored);
+    if (status < 0)
+        throw std::runtime_error("C compiler failed: cannot run '" + compiler + "'");
+    if (status != 0)
+        throw std::runtime_error("C compiler failed: '" + compiler + "' exited with status " + std::to_string(status));
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "ast_visitor.hpp"
+
+// An expression lowered to C: the C expression that holds its value once the
+// statements emitted for the expression have run.
+struct CValue
+{
+    std::string text; // empty for a void call
+    bool owned = false; // a string reference the consumer must release
+    bool local = false; // a local variable, which later statements may change
+};
+
+// Translates a checked Program (see checker.hpp) into one self-contained C99
+// file with a main(). Numbers are plain doubles and strings are reference
+// counted; the checker's types and bindings say which is which, so the C
+// carries no type tags or name lookups. Expressions are flattened into one
+// statement per operation, in the order the VM evaluates them.
+//
+// Programs behave as under `base run`, except that only the call depth (not
+// the VM's register stack) limits recursion.
+class CGenerator : public ASTVisitor<CGenerator, CValue>
+{
+public:
+    // program must have passed Checker::check() since it was last changed.
+    static std::string generate(const Program *program);
+
+private:
+    struct FunctionState
+    {
+        std::string body;
+        int indent = 1;
+        uint32_t temps = 0;
+        const FunctionDeclaration *declaration = nullptr; // null for the top level
+        std::vector<std::string> stringLocals;            // live, innermost last
+    };
+
+    explicit CGenerator(const Program *program);
+
+    const Interner &symbols;
+    FunctionState *current = nullptr;
+    std::string constants; // string literals and template texts
+    std::string prototypes;
+    std::string definitions;
+    std::vector<int32_t> stringConstants; // by Symbol; -1 until first use
+    uint32_t stringCount = 0;
+    uint32_t templateCount = 0;
+    std::vector<TypeName> globalTypes;    // by global slot
+    std::vector<std::string> globalNames; // by global slot
+    std::vector<bool> globalReady;        // set once the top level has run a declaration
+
+    void line(const std::string &text);
+    std::string temp() { return "t" + std::to_string(current->temps++); }
+    void release(const CValue &value);
+    void releaseLocals(size_t mark);
+    std::string stringConstant(Symbol value);
+
+    // The value of node as of now: a local is copied, as a later operand
+    // may assign to it.
+    CValue valueNow(const ASTNode *node);
+    // value, copied to a temporary if it is a local.
+    CValue copyLocal(CValue value, TypeName type);
+    // Reads a global into a temporary, first checking it was initialized.
+    CValue readGlobal(uint32_t slot, int line);
+    void storeGlobal(uint32_t slot, const CValue &value);
+    // Replaces the string in variable by value.
+    void storeString(const std::string &variable, const CValue &value);
+    // Emits left op right into a temporary and releases the operands.
+    CValue operation(TokenKind op, TypeName type, const CValue &left, TypeName leftType, const CValue &right,
+                     TypeName rightType);
+    void generateBlock(const ArenaList<ASTNode *> &body);
+
+    friend ASTVisitor<CGenerator, CValue>;
+    CValue visitProgram(const Program *node);
+    CValue visitLiteralExpression(const LiteralExpression *node);
+    CValue visitIdentifierExpression(const IdentifierExpression *node);
+    CValue visitVariableDeclaration(const VariableDeclaration *node);
+    CValue visitFunctionDeclaration(const FunctionDeclaration *node);
+    CValue visitBlockStatement(const BlockStatement *node);
+    CValue visitReturnStatement(const ReturnStatement *node);
+    CValue visitExpressionStatement(const ExpressionStatement *node);
+    CValue visitBinaryExpression(const BinaryExpression *node);
+    CValue visitAssignmentExpression(const AssignmentExpression *node);
+    CValue visitCallExpression(const CallExpression *node);
+    CValue visitTemplateLiteral(const TemplateLiteral *node);
+};
+
+// $CC if set, otherwise "cc".
+std::string defaultCCompiler();
+
+// Compiles C source with compiler, a cc-style driver named by a single
+// program name and run without a shell, into the executable output. The
+// source goes through a temporary file that is removed afterwards. Throws
+// std::runtime_error if the compiler fails.
+void buildExecutable(const std::string &source, const std::filesystem::path &output, const std::string &compiler);
@@ -0,0 +1,269 @@
+#include "char_scan.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BASE_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BASE_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#else
+#define BASE_TARGET_AVX2
+#endif
+
+namespace {
+
+inline unsigned countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline size_t popCount(uint32_t mask)
+{
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+// Scalar versions; also used for the tails of the vector loops.
+
+const char *scalarSkipSpace(const char *p, const char *end)
+{
+    while (p < end && hasCharClass(*p, CharSpace))
+        p++;
+    return p;
+}
+
+const char *scalarSkipIdentBody(const char *p, const char *end)
+{
+    while (p < end && hasCharClass(*p, CharIdentBody))
+        p++;
+    return p;
+}
+
+const char *scalarFindAny(const char *p, const char *end, char a, char b, char c, char d)
+{
+    for (; p < end; p++)
+    {
+        char ch = *p;
+        if (ch == a || ch == b || ch == c || ch == d)
+            return p;
+    }
+    return end;
+}
+
+size_t scalarCountNewlines(const char *p, const char *end)
+{
+    size_t count = 0;
+    for (; p < end; p++)
+        count += *p == '\n';
+    return count;
+}
+
+#ifdef BASE_SCAN_X86
+
+// Unsigned "lo <= v <= hi" per byte, built from SSE2's unsigned minimum.
+inline __m128i sse2InRange(__m128i v, char lo, char hi)
+{
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(static_cast<char>(hi - lo))), shifted);
+}
+
+inline uint32_t sse2SpaceMask(__m128i v)
+{
+    __m128i space = _mm_or_si128(sse2InRange(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    return static_cast<uint32_t>(_mm_movemask_epi8(space));
+}
+
+inline uint32_t sse2IdentMask(__m128i v)
+{
+    __m128i alpha = sse2InRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = sse2InRange(v, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), underscore)));
+}
+
+const char *sse2SkipSpace(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        uint32_t other = ~sse2SpaceMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) & 0xFFFFu;
+        if (other)
+            return p + countTrailingZeros(other);
+    }
+    return scalarSkipSpace(p, end);
+}
+
+const char *sse2SkipIdentBody(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        uint32_t other = ~sse2IdentMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) & 0xFFFFu;
+        if (other)
+            return p + countTrailingZeros(other);
+    }
+    return scalarSkipIdentBody(p, end);
+}
+
+const char *sse2FindAny(const char *p, const char *end, char a, char b, char c, char d)
+{
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, vd)));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if (mask)
+            return p + countTrailingZeros(mask);
+    }
+    return scalarFindAny(p, end, a, b, c, d);
+}
+
+size_t sse2CountNewlines(const char *p, const char *end)
+{
+    size_t count = 0;
+    __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        count += popCount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline))));
+    }
+    return count + scalarCountNewlines(p, end);
+}
+
+BASE_TARGET_AVX2 inline __m256i avx2InRange(__m256i v, char lo, char hi)
+{
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(static_cast<char>(hi - lo))), shifted);
+}
+
+BASE_TARGET_AVX2 const char *avx2SkipSpace(const char *p, const char *end)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i space = _mm256_or_si256(avx2InRange(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+        if (other)
+            return p + countTrailingZeros(other);
+    }
+    return sse2SkipSpace(p, end);
+}
+
+BASE_TARGET_AVX2 const char *avx2SkipIdentBody(const char *p, const char *end)
+{
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i alpha = avx2InRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digit = avx2InRange(v, '0', '9');
+        __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), underscore)));
+        if (other)
+            return p + countTrailingZeros(other);
+    }
+    return sse2SkipIdentBody(p, end);
+}
+
+BASE_TARGET_AVX2 const char *avx2FindAny(const char *p, const char *end, char a, char b, char c, char d)
+{
+    __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b), vc = _mm256_set1_epi8(c), vd = _mm256_set1_epi8(d);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, vc), _mm256_cmpeq_epi8(v, vd)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask)
+            return p + countTrailingZeros(mask);
+    }
+    return sse2FindAny(p, end, a, b, c, d);
+}
+
+BASE_TARGET_AVX2 size_t avx2CountNewlines(const char *p, const char *end)
+{
+    size_t count = 0;
+    __m256i newline = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        count += static_cast<size_t>(_mm_popcnt_u32(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)))));
+    }
+    return count + sse2CountNewlines(p, end);
+}
+
+bool cpuSupportsAvx2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool popcnt = (info[2] & (1 << 23)) != 0;
+    if (!osSavesAvx || !popcnt)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif // BASE_SCAN_X86
+
+const CharScanner scalarScanner = {"scalar", scalarSkipSpace, scalarSkipIdentBody, scalarFindAny, scalarCountNewlines};
+#ifdef BASE_SCAN_X86
+const CharScanner sse2Scanner = {"sse2", sse2SkipSpace, sse2SkipIdentBody, sse2FindAny, sse2CountNewlines};
+const CharScanner avx2Scanner = {"avx2", avx2SkipSpace, avx2SkipIdentBody, avx2FindAny, avx2CountNewlines};
+#endif
+
+const CharScanner &selectCharScanner()
+{
+    if (const char *forced = std::getenv("BASE_SCAN"))
+        if (const CharScanner *scanner = findCharScanner(forced))
+            return *scanner;
+#ifdef BASE_SCAN_X86
+    // SSE2 is part of the x86-64 baseline; AVX2 needs a runtime check.
+    return cpuSupportsAvx2() ? avx2Scanner : sse2Scanner;
+#else
+    return scalarScanner;
+#endif
+}
+
+} // namespace
+
+const CharScanner &charScanner()
+{
+    static const CharScanner &scanner = selectCharScanner();
+    return scanner;
+}
+
+const CharScanner *findCharScanner(const char *name)
+{
+    if (std::strcmp(name, "scalar") == 0)
+        return &scalarScanner;
+#ifdef BASE_SCAN_X86
+    if (std::strcmp(name, "sse2") == 0)
+        return &sse2Scanner;
+    if (std::strcmp(name, "avx2") == 0 && cpuSupportsAvx2())
+        return &avx2Scanner;
+#endif
+    return nullptr;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Byte classification and bulk scanning primitives for the lexer. Classes come
+// from a 256-entry table so they never depend on the C locale; the bulk
+// scanners process 16 or 32 bytes at a time with SSE2 or AVX2 when available.
+enum CharClass : uint8_t {
+    CharSpace = 1 << 0,      // ' ' \t \n \v \f \r
+    CharIdentStart = 1 << 1, // [A-Za-z_]
+    CharIdentBody = 1 << 2,  // [A-Za-z0-9_]
+    CharDigit = 1 << 3,      // [0-9]
+    CharHexDigit = 1 << 4    // [0-9A-Fa-f]
+};
+
+struct CharClassTable {
+    uint8_t classes[256];
+};
+
+constexpr CharClassTable buildCharClassTable() {
+    CharClassTable table{};
+    for (int c = 0; c < 256; c++) {
+        uint8_t cls = 0;
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        bool digit = c >= '0' && c <= '9';
+        if (c == ' ' || (c >= '\t' && c <= '\r')) cls |= CharSpace;
+        if (alpha || c == '_') cls |= CharIdentStart;
+        if (alpha || digit || c == '_') cls |= CharIdentBody;
+        if (digit) cls |= CharDigit;
+        if (digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) cls |= CharHexDigit;
+        table.classes[c] = cls;
+    }
+    return table;
+}
+
+inline constexpr CharClassTable charClassTable = buildCharClassTable();
+
+inline bool hasCharClass(char c, uint8_t cls) {
+    return (charClassTable.classes[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+// One implementation of the bulk scanners. Every function scans [p, end) and
+// never reads outside it.
+struct CharScanner {
+    const char *name;
+    // First byte that is not whitespace, or end.
+    const char *(*skipSpace)(const char *p, const char *end);
+    // First byte that cannot continue an identifier, or end.
+    const char *(*skipIdentBody)(const char *p, const char *end);
+    // First byte equal to any of a, b, c or d, or end.
+    const char *(*findAny)(const char *p, const char *end, char a, char b, char c, char d);
+    size_t (*countNewlines)(const char *p, const char *end);
+};
+
+// The fastest scanner the CPU supports, chosen once. Setting the BASE_SCAN
+// environment variable to scalar, sse2 or avx2 forces a specific one.
+const CharScanner &charScanner();
+// Looks up a scanner by name; returns nullptr if it is unsupported here.
+const CharScanner *findCharScanner(const char *name);
@@ -0,0 +1,434 @@
+#include "checker.hpp"
+#include "profile.hpp"
+
+namespace
+{
+
+// The first three CheckedTypes mirror TypeName.
+CheckedType checkedType(TypeName type)
+{
+    return static_cast<CheckedType>(type);
+}
+
+bool matches(CheckedType actual, TypeName expected)
+{
+    return actual == CheckedType::Unknown || actual == checkedType(expected);
+}
+
+const char *describe(CheckedType type)
+{
+    switch (type)
+    {
+    case CheckedType::Number:
+        return "a number";
+    case CheckedType::String:
+        return "a string";
+    default:
+        return "void";
+    }
+}
+
+const char *describe(TypeName type)
+{
+    return describe(checkedType(type));
+}
+
+} // namespace
+
+Checker::Checker(Program &program, Diagnostics &diagnostics)
+    : program(program),
+      symbols(program.symbols),
+      diagnostics(diagnostics),
+      printSymbol(program.symbols.find("print")),
+      variableHeads(program.symbols.size() + 1, -1),
+      functionHeads(program.symbols.size() + 1, -1)
+{
+}
+
+bool Checker::check(Program &program, Diagnostics &diagnostics)
+{
+    BASE_TRACE_SCOPE("Checker::check", "checker");
+    size_t before = diagnostics.size();
+    Checker checker(program, diagnostics);
+    checker.visit(&program);
+    return diagnostics.size() == before;
+}
+
+void Checker::error(DiagnosticCode code, const ASTNode *node, std::string message)
+{
+    diagnostics.report(code, {node->offset, node->length, node->line}, std::move(message));
+}
+
+void Checker::declare(std::vector<Entry> &table, std::vector<int32_t> &heads, Entry entry)
+{
+    entry.shadows = heads[entry.name];
+    heads[entry.name] = static_cast<int32_t>(table.size());
+    table.push_back(entry);
+}
+
+Checker::Scope Checker::enterScope() const
+{
+    return {variables.size(), functions.size(), current->liveLocals};
+}
+
+void Checker::leaveScope(const Scope &scope)
+{
+    while (variables.size() > scope.variables)
+    {
+        variableHeads[variables.back().name] = variables.back().shadows;
+        variables.pop_back();
+    }
+    while (functions.size() > scope.functions)
+    {
+        functionHeads[functions.back().name] = functions.back().shadows;
+        functions.pop_back();
+    }
+    current->liveLocals = scope.liveLocals;
+}
+
+// Locals of enclosing functions stay in the table while a nested function
+// is checked, but live in another frame; they are skipped in favour of
+// whatever they shadow.
+const Checker::Entry *Checker::findVariable(Symbol name) const
+{
+    for (int32_t i = variableHeads[name]; i >= 0; i = variables[i].shadows)
+        if (variables[i].binding.kind != BindingKind::Local || variables[i].owner == current->index)
+            return &variables[i];
+    return nullptr;
+}
+
+const Checker::Entry *Checker::findFunction(Symbol name) const
+{
+    int32_t i = functionHeads[name];
+    return i >= 0 ? &functions[i] : nullptr;
+}
+
+CheckedType Checker::annotate(ASTNode *node, CheckedType type)
+{
+    if (type != CheckedType::Unknown)
+        node->valueType = static_cast<TypeName>(type);
+    return type;
+}
+
+// Top-level variables are globals so that functions can see them, wherever
+// they are declared. A redeclared global shares its slot; any const
+// declaration makes it read-only.
+void Checker::declareGlobals(const ArenaList<ASTNode *> &body)
+{
+    uint32_t count = 0;
+    for (ASTNode *stmt : body)
+    {
+        auto *decl = nodeCast<VariableDeclaration>(stmt);
+        if (!decl)
+            continue;
+        bool isConst = decl->kind == DeclarationKind::Const;
+        for (VariableDeclarator &declarator : decl->declarations)
+        {
+            int32_t head = variableHeads[declarator.name];
+            if (head < 0)
+            {
+                declare(variables, variableHeads,
+                        {declarator.name, {BindingKind::Global, count++}, declarator.type, isConst, 0, -1, nullptr});
+                head = variableHeads[declarator.name];
+            }
+            Entry &global = variables[head];
+            global.isConst = global.isConst || isConst;
+            declarator.binding = global.binding;
+        }
+    }
+    program.globalCount = count;
+}
+
+// Functions are visible throughout their block, so calls may come before
+// the declaration. Indices are given in the order the compiler meets them.
+void Checker::hoistFunctions(const ArenaList<ASTNode *> &body)
+{
+    for (ASTNode *stmt : body)
+        if (auto *decl = nodeCast<FunctionDeclaration>(stmt))
+        {
+            decl->index = functionCount++;
+            declare(functions, functionHeads,
+                    {decl->name, {BindingKind::Function, decl->index}, decl->returnType, true, 0, -1, decl});
+        }
+}
+
+void Checker::checkBlock(const ArenaList<ASTNode *> &body)
+{
+    Scope scope = enterScope();
+    current->blockDepth++;
+    hoistFunctions(body);
+    for (ASTNode *stmt : body)
+        visit(stmt);
+    current->blockDepth--;
+    leaveScope(scope);
+}
+
+bool Checker::alwaysReturns(const ArenaList<ASTNode *> &body)
+{
+    for (const ASTNode *stmt : body)
+    {
+        if (nodeCast<ReturnStatement>(stmt))
+            return true;
+        if (const auto *block = nodeCast<BlockStatement>(stmt))
+            if (alwaysReturns(block->body))
+                return true;
+    }
+    return false;
+}
+
+CheckedType Checker::visitProgram(Program *node)
+{
+    FunctionContext context{0, nullptr};
+    current = &context;
+    declareGlobals(node->body);
+    hoistFunctions(node->body);
+    for (ASTNode *stmt : node->body)
+        visit(stmt);
+    node->functionCount = functionCount;
+    current = nullptr;
+    return CheckedType::Void;
+}
+
+CheckedType Checker::visitLiteralExpression(LiteralExpression *node)
+{
+    return annotate(node, node->isString ? CheckedType::String : CheckedType::Number);
+}
+
+CheckedType Checker::visitIdentifierExpression(IdentifierExpression *node)
+{
+    if (const Entry *variable = findVariable(node->name))
+    {
+        node->binding = variable->binding;
+        return annotate(node, checkedType(variable->type));
+    }
+    if (findFunction(node->name))
+        error(DiagnosticCode::FunctionAsValue, node,
+              "Function '" + name(node->name) + "' cannot be used as a value");
+    else
+        error(DiagnosticCode::UndefinedVariable, node, "Undefined variable '" + name(node->name) + "'");
+    return CheckedType::Unknown;
+}
+
+CheckedType Checker::visitVariableDeclaration(VariableDeclaration *node)
+{
+    bool global = current->index == 0 && current->blockDepth == 0;
+    for (VariableDeclarator &declarator : node->declarations)
+    {
+        // The initializer still sees any outer variable of the same name.
+        CheckedType init = declarator.init ? visit(declarator.init) : CheckedType::Unknown;
+        // A declaration's own line is that of the token after it, so errors
+        // point at the initializer.
+        const ASTNode *at = declarator.init ? declarator.init : node;
+        if (declarator.type == TypeName::Void)
+            error(DiagnosticCode::TypeMismatch, at, "Variable '" + name(declarator.name) + "' cannot be void");
+        else if (!matches(init, declarator.type))
+            error(DiagnosticCode::TypeMismatch, at,
+                  std::string("Cannot assign ") + describe(init) + " to '" + name(declarator.name) + "' of type " +
+                      typeNameSpelling(declarator.type));
+        if (global)
+        {
+            // Bound by declareGlobals(), with the type of the first declaration.
+            const Entry *first = findVariable(declarator.name);
+            if (declarator.type != first->type)
+                error(DiagnosticCode::TypeMismatch, at,
+                      "Global '" + name(declarator.name) + "' was declared as " + describe(first->type) +
+                          ", not " + describe(declarator.type));
+            continue;
+        }
+        // A local's register is the number of locals live before it, as
+        // temporaries are all freed between statements.
+        declarator.binding = {BindingKind::Local, current->liveLocals++};
+        declare(variables, variableHeads,
+                {declarator.name, declarator.binding, declarator.type, node->kind == DeclarationKind::Const,
+                 current->index, -1, nullptr});
+    }
+    return CheckedType::Void;
+}
+
+CheckedType Checker::visitFunctionDeclaration(FunctionDeclaration *node)
+{
+    FunctionContext context{node->index, node};
+    FunctionContext *enclosing = current;
+    current = &context;
+    Scope scope = enterScope();
+    for (const Parameter &param : node->params)
+    {
+        if (param.type == TypeName::Void)
+            error(DiagnosticCode::TypeMismatch, node->body, "Parameter '" + name(param.name) + "' cannot be void");
+        declare(variables, variableHeads,
+                {param.name, {BindingKind::Local, context.liveLocals++}, param.type, false, node->index, -1, nullptr});
+    }
+    checkBlock(node->body->body);
+    leaveScope(scope);
+    current = enclosing;
+
+    if (node->returnType != TypeName::Void && !alwaysReturns(node->body->body))
+        error(DiagnosticCode::MissingReturn, node->body,
+              "Function '" + name(node->name) + "' must return " + describe(node->returnType) + " on every path");
+    return CheckedType::Void;
+}
+
+CheckedType Checker::visitBlockStatement(BlockStatement *node)
+{
+    checkBlock(node->body);
+    return CheckedType::Void;
+}
+
+CheckedType Checker::visitReturnStatement(ReturnStatement *node)
+{
+    CheckedType value = node->argument ? visit(node->argument) : CheckedType::Void;
+    const FunctionDeclaration *function = current->declaration;
+    if (!function)
+        return CheckedType::Void; // the top level may return anything
+    if (!node->argument && function->returnType != TypeName::Void)
+        error(DiagnosticCode::TypeMismatch, node,
+              "Function '" + name(function->name) + "' must return " + describe(function->returnType));
+    else if (node->argument && !matches(value, function->returnType))
+        error(DiagnosticCode::TypeMismatch, node,
+              "Function '" + name(function->name) + "' must return " + describe(function->returnType) + ", not " +
+                  describe(value));
+    return CheckedType::Void;
+}
+
+CheckedType Checker::visitExpressionStatement(ExpressionStatement *node)
+{
+    visit(node->expression);
+    return CheckedType::Void;
+}
+
+// The rules the VM applies to values at run time: + concatenates when
+// either side is a string, the other arithmetic needs numbers, any two
+// values can be tested for equality, and ordering needs two numbers or two
+// strings. None of them take void.
+CheckedType Checker::binaryType(TokenKind op, CheckedType left, CheckedType right, const ASTNode *node)
+{
+    bool comparison = op != TokenKind::Plus && op != TokenKind::Minus && op != TokenKind::Star &&
+                      op != TokenKind::Slash;
+    if (left == CheckedType::Unknown || right == CheckedType::Unknown)
+    {
+        if (comparison)
+            return CheckedType::Number;
+        return op == TokenKind::Plus ? CheckedType::Unknown : CheckedType::Number;
+    }
+    std::string spelling = tokenKindSpelling(op);
+    if (left == CheckedType::Void || right == CheckedType::Void)
+    {
+        error(DiagnosticCode::TypeMismatch, node, "Void value used as an operand of '" + spelling + "'");
+        return CheckedType::Unknown;
+    }
+    switch (op)
+    {
+    case TokenKind::Plus:
+        if (left == CheckedType::String || right == CheckedType::String)
+            return CheckedType::String;
+        return CheckedType::Number;
+    case TokenKind::Minus:
+    case TokenKind::Star:
+    case TokenKind::Slash:
+        if (left != CheckedType::Number || right != CheckedType::Number)
+            error(DiagnosticCode::TypeMismatch, node, "Operands of '" + spelling + "' must be numbers");
+        return CheckedType::Number;
+    case TokenKind::EqualEqual:
+    case TokenKind::BangEqual:
+        return CheckedType::Number;
+    case TokenKind::Less:
+    case TokenKind::LessEqual:
+    case TokenKind::Greater:
+    case TokenKind::GreaterEqual:
+        if (left != right)
+            error(DiagnosticCode::TypeMismatch, node,
+                  "Operands of '" + spelling + "' must be two numbers or two strings");
+        return CheckedType::Number;
+    default:
+        error(DiagnosticCode::TypeMismatch, node, "Unsupported operator '" + spelling + "'");
+        return CheckedType::Unknown;
+    }
+}
+
+CheckedType Checker::visitBinaryExpression(BinaryExpression *node)
+{
+    CheckedType left = visit(node->left);
+    CheckedType right = visit(node->right);
+    return annotate(node, binaryType(node->op, left, right, node));
+}
+
+CheckedType Checker::visitAssignmentExpression(AssignmentExpression *node)
+{
+    CheckedType value = visit(node->value);
+    const Entry *variable = findVariable(node->name);
+    if (!variable)
+    {
+        if (findFunction(node->name))
+            error(DiagnosticCode::AssignmentToFunction, node,
+                  "Cannot assign to function '" + name(node->name) + "'");
+        else
+            error(DiagnosticCode::UndefinedVariable, node, "Undefined variable '" + name(node->name) + "'");
+        return CheckedType::Unknown;
+    }
+    node->binding = variable->binding;
+    if (variable->isConst)
+        error(DiagnosticCode::AssignmentToConstant, node,
+              "Cannot assign to constant '" + name(node->name) + "'");
+
+    TokenKind op = node->binaryOperator();
+    if (op != TokenKind::Equal)
+        value = binaryType(op, checkedType(variable->type), value, node);
+    if (!matches(value, variable->type))
+        error(DiagnosticCode::TypeMismatch, node,
+              std::string("Cannot assign ") + describe(value) + " to '" + name(node->name) + "' of type " +
+                  typeNameSpelling(variable->type));
+    return annotate(node, checkedType(variable->type));
+}
+
+CheckedType Checker::visitCallExpression(CallExpression *node)
+{
+    std::vector<CheckedType> arguments;
+    arguments.reserve(node->arguments.count);
+    for (ASTNode *argument : node->arguments)
+        arguments.push_back(visit(argument));
+
+    auto *callee = nodeCast<IdentifierExpression>(node->callee);
+    if (!callee)
+    {
+        error(DiagnosticCode::NotCallable, node, "Only named functions can be called");
+        return CheckedType::Unknown;
+    }
+
+    if (callee->name == printSymbol)
+    {
+        callee->binding = {BindingKind::Print, 0};
+        if (arguments.size() != 1)
+            error(DiagnosticCode::ArgumentCount, node, "print expects 1 argument");
+        else if (arguments[0] == CheckedType::Void)
+            error(DiagnosticCode::TypeMismatch, node, "print expects a number or a string, not void");
+        return annotate(node, CheckedType::Void);
+    }
+
+    const Entry *function = findFunction(callee->name);
+    if (!function)
+    {
+        error(DiagnosticCode::UndefinedFunction, node, "Undefined function '" + name(callee->name) + "'");
+        return CheckedType::Unknown;
+    }
+    callee->binding = function->binding;
+    const ArenaList<Parameter> &params = function->function->params;
+    if (arguments.size() != params.count)
+        error(DiagnosticCode::ArgumentCount, node,
+              "Function '" + name(callee->name) + "' expects " + std::to_string(params.count) +
+                  " arguments but got " + std::to_string(arguments.size()));
+    else
+        for (uint32_t i = 0; i < params.count; i++)
+            if (!matches(arguments[i], params[i].type))
+                error(DiagnosticCode::TypeMismatch, node->arguments[i],
+                      "Argument " + std::to_string(i + 1) + " of '" + name(callee->name) + "' must be " +
+                          describe(params[i].type) + ", not " + describe(arguments[i]));
+    return annotate(node, checkedType(function->type));
+}
+
+CheckedType Checker::visitTemplateLiteral(TemplateLiteral *node)
+{
+    for (ASTNode *expression : node->expressions)
+        if (visit(expression) == CheckedType::Void)
+            error(DiagnosticCode::TypeMismatch, expression, "Void value used in a template literal");
+    return annotate(node, CheckedType::String);
+}
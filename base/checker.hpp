@@ -0,0 +1,110 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ast_visitor.hpp"
+#include "diagnostics.hpp"
+
+// Static type of an expression while checking. Unknown stands for an
+// expression that already had an error and is accepted everywhere, so a
+// mistake is reported once rather than by every expression around it.
+enum class CheckedType : uint8_t
+{
+    Number,
+    String,
+    Void,
+    Unknown
+};
+
+// Resolves names and checks types between parsing and compilation. Every
+// IdentifierExpression, AssignmentExpression and VariableDeclarator gets a
+// Binding, every FunctionDeclaration its function index and every
+// expression its valueType, so the compiler emits register, global and
+// function accesses directly and knows what each operator is applied to.
+//
+// Scopes are one flat table per namespace (variables, and functions, which
+// only calls look in). Each Symbol holds the index of its innermost entry
+// and each entry the index of the entry it shadows, so declaring a name,
+// looking it up and leaving a scope never search.
+//
+// Passes that rewrite the tree leave new nodes unannotated; check again
+// after optimizing.
+class Checker : public MutableASTVisitor<Checker, CheckedType>
+{
+public:
+    // Annotates program and reports every error into diagnostics. Returns
+    // false if there were errors, in which case the annotations must not
+    // be compiled.
+    static bool check(Program &program, Diagnostics &diagnostics);
+
+private:
+    struct Entry
+    {
+        Symbol name;
+        Binding binding;
+        TypeName type;   // of the variable, or the function's return type
+        bool isConst;
+        uint32_t owner;  // function whose frame holds a local
+        int32_t shadows; // entry of the same name further out, or -1
+        const FunctionDeclaration *function;
+    };
+
+    struct Scope
+    {
+        size_t variables;
+        size_t functions;
+        uint32_t liveLocals;
+    };
+
+    struct FunctionContext
+    {
+        uint32_t index;                         // 0 for the top level
+        const FunctionDeclaration *declaration; // null for the top level
+        uint32_t liveLocals = 0;
+        int blockDepth = 0;
+    };
+
+    Checker(Program &program, Diagnostics &diagnostics);
+
+    Program &program;
+    const Interner &symbols;
+    Diagnostics &diagnostics;
+    Symbol printSymbol;
+    std::vector<Entry> variables;
+    std::vector<Entry> functions;
+    std::vector<int32_t> variableHeads; // by Symbol
+    std::vector<int32_t> functionHeads; // by Symbol
+    FunctionContext *current = nullptr;
+    uint32_t functionCount = 1;
+
+    // Reports at the line and source span of node.
+    void error(DiagnosticCode code, const ASTNode *node, std::string message);
+    std::string name(Symbol symbol) const { return std::string(symbols.name(symbol)); }
+
+    void declare(std::vector<Entry> &table, std::vector<int32_t> &heads, Entry entry);
+    Scope enterScope() const;
+    void leaveScope(const Scope &scope);
+    const Entry *findVariable(Symbol name) const;
+    const Entry *findFunction(Symbol name) const;
+
+    void declareGlobals(const ArenaList<ASTNode *> &body);
+    void hoistFunctions(const ArenaList<ASTNode *> &body);
+    void checkBlock(const ArenaList<ASTNode *> &body);
+    static bool alwaysReturns(const ArenaList<ASTNode *> &body);
+    CheckedType binaryType(TokenKind op, CheckedType left, CheckedType right, const ASTNode *node);
+    // Records type as node's valueType and returns it.
+    static CheckedType annotate(ASTNode *node, CheckedType type);
+
+    friend MutableASTVisitor<Checker, CheckedType>;
+    CheckedType visitProgram(Program *node);
+    CheckedType visitLiteralExpression(LiteralExpression *node);
+    CheckedType visitIdentifierExpression(IdentifierExpression *node);
+    CheckedType visitVariableDeclaration(VariableDeclaration *node);
+    CheckedType visitFunctionDeclaration(FunctionDeclaration *node);
+    CheckedType visitBlockStatement(BlockStatement *node);
+    CheckedType visitReturnStatement(ReturnStatement *node);
+    CheckedType visitExpressionStatement(ExpressionStatement *node);
+    CheckedType visitBinaryExpression(BinaryExpression *node);
+    CheckedType visitAssignmentExpression(AssignmentExpression *node);
+    CheckedType visitCallExpression(CallExpression *node);
+    CheckedType visitTemplateLiteral(TemplateLiteral *node);
+};
@@ -0,0 +1,359 @@
+#include "compiler.hpp"
+#include <cstring>
+#include <stdexcept>
+
+Compiler::Compiler(const Program *program)
+    : symbols(program->symbols),
+      stringConstants(program->symbols.size() + 1, -1)
+{
+}
+
+Module Compiler::compile(const Program *program)
+{
+    Compiler compiler(program);
+    compiler.visit(program, 0u);
+    return std::move(compiler.module);
+}
+
+void Compiler::error(int line, const std::string &message) const
+{
+    throw std::runtime_error("Compile error at line " + std::to_string(line) + ": " + message);
+}
+
+void Compiler::emit(Instruction ins, int line)
+{
+    Function &fn = function();
+    fn.code.push_back(ins);
+    fn.lines.push_back(line);
+}
+
+uint32_t Compiler::allocateRegister(int line)
+{
+    uint32_t reg = current->nextRegister++;
+    if (reg >= MaxRegisters)
+        error(line, "Function '" + function().name + "' needs too many registers");
+    Function &fn = function();
+    if (current->nextRegister > fn.numRegisters)
+        fn.numRegisters = current->nextRegister;
+    return reg;
+}
+
+uint32_t Compiler::numberConstant(double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto [it, inserted] = numberConstants.emplace(bits, static_cast<uint32_t>(module.constants.size()));
+    if (inserted)
+        module.constants.push_back(Value::fromNumber(value));
+    return it->second;
+}
+
+uint32_t Compiler::stringConstant(Symbol value)
+{
+    int32_t &slot = stringConstants[value];
+    if (slot < 0)
+    {
+        slot = static_cast<int32_t>(module.constants.size());
+        module.constants.push_back(Value::fromString(StringObject::create(symbols.name(value))));
+    }
+    return static_cast<uint32_t>(slot);
+}
+
+// The block's locals hold the registers from the mark up; leaving the block
+// frees them.
+void Compiler::compileBlock(const ArenaList<ASTNode *> &body)
+{
+    uint32_t registerMark = current->nextRegister;
+    for (const ASTNode *stmt : body)
+        visit(stmt, 0u);
+    freeRegisters(registerMark);
+}
+
+uint32_t Compiler::compileConsecutive(const ArenaList<ASTNode *> &nodes, uint32_t dst, int line)
+{
+    // If dst is the newest register the values can start there, which saves
+    // moving the result into dst afterwards.
+    uint32_t base = dst + 1 == current->nextRegister ? dst : current->nextRegister;
+    for (uint32_t i = 0; i < nodes.count; i++)
+    {
+        uint32_t reg = base + i;
+        if (reg >= current->nextRegister)
+            allocateRegister(line);
+        visit(nodes[i], reg);
+        freeRegisters(reg + 1);
+    }
+    if (base >= current->nextRegister)
+        allocateRegister(line);
+    return base;
+}
+
+uint32_t Compiler::operandRegister(const ASTNode *node, const ASTNode *later)
+{
+    if (const auto *ident = nodeCast<IdentifierExpression>(node))
+        if (ident->binding.kind == BindingKind::Local && !(later && assignsLocal(later, ident->binding.slot)))
+            return ident->binding.slot;
+    uint32_t reg = allocateRegister(node->line);
+    visit(node, reg);
+    return reg;
+}
+
+void Compiler::visitProgram(const Program *node, uint32_t)
+{
+    module.functions.resize(node->functionCount);
+    module.functions[Module::MainFunction].name = "<main>";
+    module.globalNames.resize(node->globalCount);
+    for (const ASTNode *stmt : node->body)
+        if (const auto *decl = nodeCast<VariableDeclaration>(stmt))
+            for (const VariableDeclarator &declarator : decl->declarations)
+                module.globalNames[declarator.binding.slot] = symbols.name(declarator.name);
+
+    FunctionState state(Module::MainFunction);
+    current = &state;
+    for (const ASTNode *stmt : node->body)
+        visit(stmt, 0u);
+    emit(Instruction::abc(Opcode::ReturnVoid, 0), node->line);
+    // Calls write their result to the callee's first register, so every
+    // frame has at least one.
+    if (function().numRegisters == 0)
+        function().numRegisters = 1;
+    current = nullptr;
+}
+
+void Compiler::visitLiteralExpression(const LiteralExpression *node, uint32_t dst)
+{
+    uint32_t index = node->isString ? stringConstant(node->strValue) : numberConstant(node->numValue);
+    emit(Instruction::abx(Opcode::LoadK, dst, index), node->line);
+}
+
+void Compiler::visitIdentifierExpression(const IdentifierExpression *node, uint32_t dst)
+{
+    uint32_t slot = node->binding.slot;
+    if (node->binding.kind == BindingKind::Global)
+        emit(Instruction::abx(Opcode::GetGlobal, dst, slot), node->line);
+    else if (slot != dst)
+        emit(Instruction::abc(Opcode::Move, dst, slot), node->line);
+}
+
+void Compiler::visitVariableDeclaration(const VariableDeclaration *node, uint32_t)
+{
+    for (const VariableDeclarator &declarator : node->declarations)
+    {
+        if (declarator.binding.kind == BindingKind::Global)
+        {
+            if (!declarator.init)
+                continue;
+            uint32_t mark = current->nextRegister;
+            uint32_t reg = operandRegister(declarator.init);
+            emit(Instruction::abx(Opcode::SetGlobal, reg, declarator.binding.slot), node->line);
+            freeRegisters(mark);
+            continue;
+        }
+        // Between statements only locals hold registers, so this is the
+        // local's own register, declarator.binding.slot.
+        uint32_t reg = allocateRegister(node->line);
+        visit(declarator.init, reg);
+        freeRegisters(reg + 1);
+    }
+}
+
+void Compiler::visitFunctionDeclaration(const FunctionDeclaration *node, uint32_t)
+{
+    FunctionState state(node->index);
+    FunctionState *enclosing = current;
+    current = &state;
+    function().name = std::string(symbols.name(node->name));
+    function().numParams = node->params.count;
+    for (uint32_t i = 0; i < node->params.count; i++)
+        allocateRegister(node->line);
+    compileBlock(node->body->body);
+    emit(Instruction::abc(Opcode::ReturnVoid, 0), node->body->line);
+    if (function().numRegisters == 0)
+        function().numRegisters = 1;
+    current = enclosing;
+}
+
+void Compiler::visitBlockStatement(const BlockStatement *node, uint32_t)
+{
+    compileBlock(node->body);
+}
+
+void Compiler::visitReturnStatement(const ReturnStatement *node, uint32_t)
+{
+    if (!node->argument)
+    {
+        emit(Instruction::abc(Opcode::ReturnVoid, 0), node->line);
+        return;
+    }
+    uint32_t mark = current->nextRegister;
+    emit(Instruction::abc(Opcode::Return, operandRegister(node->argument)), node->line);
+    freeRegisters(mark);
+}
+
+void Compiler::visitExpressionStatement(const ExpressionStatement *node, uint32_t)
+{
+    // An assignment to a local needs no copy of its value.
+    if (const auto *assignment = nodeCast<AssignmentExpression>(node->expression))
+        if (assignment->binding.kind == BindingKind::Local)
+        {
+            visit(assignment, assignment->binding.slot);
+            return;
+        }
+    uint32_t mark = current->nextRegister;
+    visit(node->expression, allocateRegister(node->line));
+    freeRegisters(mark);
+}
+
+void Compiler::emitBinary(TokenKind op, TypeName type, uint32_t dst, uint32_t left, const ASTNode *right, int line)
+{
+    // Comparisons and Concat have no constant form (opK == op).
+    Opcode opR, opK;
+    switch (op)
+    {
+    case TokenKind::Plus:
+        if (type == TypeName::String)
+            opR = opK = Opcode::Concat;
+        else
+            opR = Opcode::Add, opK = Opcode::AddK;
+        break;
+    case TokenKind::Minus:
+        opR = Opcode::Sub, opK = Opcode::SubK;
+        break;
+    case TokenKind::Star:
+        opR = Opcode::Mul, opK = Opcode::MulK;
+        break;
+    case TokenKind::Slash:
+        opR = Opcode::Div, opK = Opcode::DivK;
+        break;
+    case TokenKind::EqualEqual:
+        opR = opK = Opcode::Eq;
+        break;
+    case TokenKind::BangEqual:
+        opR = opK = Opcode::Ne;
+        break;
+    case TokenKind::Less:
+        opR = opK = Opcode::Lt;
+        break;
+    case TokenKind::LessEqual:
+        opR = opK = Opcode::Le;
+        break;
+    case TokenKind::Greater:
+        opR = opK = Opcode::Gt;
+        break;
+    case TokenKind::GreaterEqual:
+        opR = opK = Opcode::Ge;
+        break;
+    default:
+        error(line, std::string("Unsupported operator '") + tokenKindSpelling(op) + "'");
+    }
+
+    uint32_t mark = current->nextRegister;
+    const auto *literal = nodeCast<LiteralExpression>(right);
+    if (opK != opR && literal && !literal->isString)
+    {
+        uint32_t index = numberConstant(literal->numValue);
+        if (index <= 0xFFFF)
+        {
+            emit(Instruction::abc(opK, dst, left, index), line);
+            return;
+        }
+    }
+    emit(Instruction::abc(opR, dst, left, operandRegister(right)), line);
+    freeRegisters(mark);
+}
+
+void Compiler::visitBinaryExpression(const BinaryExpression *node, uint32_t dst)
+{
+    uint32_t mark = current->nextRegister;
+    emitBinary(node->op, node->valueType, dst, operandRegister(node->left, node->right), node->right, node->line);
+    freeRegisters(mark);
+}
+
+// The value is computed straight into the variable's register, or into dst
+// for a global; single instructions write their destination only after
+// reading their operands, so the value may read the variable itself. Calls
+// and templates are the exception: their operands are evaluated into
+// consecutive registers that may start at the destination, so they go
+// through a fresh register. A compound assignment reads the variable
+// before its value, as it does for a global, so a value that assigns the
+// local works on a copy.
+void Compiler::visitAssignmentExpression(const AssignmentExpression *node, uint32_t dst)
+{
+    TokenKind op = node->binaryOperator();
+    uint32_t mark = current->nextRegister;
+    if (node->binding.kind == BindingKind::Local)
+    {
+        uint32_t reg = node->binding.slot;
+        if (op == TokenKind::Equal && (nodeCast<CallExpression>(node->value) || nodeCast<TemplateLiteral>(node->value)))
+        {
+            uint32_t value = allocateRegister(node->line);
+            visit(node->value, value);
+            emit(Instruction::abc(Opcode::Move, reg, value), node->line);
+        }
+        else if (op == TokenKind::Equal)
+            visit(node->value, reg);
+        else
+        {
+            uint32_t left = reg;
+            if (assignsLocal(node->value, reg))
+            {
+                left = allocateRegister(node->line);
+                emit(Instruction::abc(Opcode::Move, left, reg), node->line);
+            }
+            emitBinary(op, node->valueType, reg, left, node->value, node->line);
+        }
+        freeRegisters(mark);
+        if (reg != dst)
+            emit(Instruction::abc(Opcode::Move, dst, reg), node->line);
+        return;
+    }
+    uint32_t global = node->binding.slot;
+    if (op == TokenKind::Equal)
+        visit(node->value, dst);
+    else
+    {
+        // The variable is read before the value is evaluated.
+        uint32_t previous = allocateRegister(node->line);
+        emit(Instruction::abx(Opcode::GetGlobal, previous, global), node->line);
+        emitBinary(op, node->valueType, dst, previous, node->value, node->line);
+    }
+    emit(Instruction::abx(Opcode::SetGlobal, dst, global), node->line);
+    freeRegisters(mark);
+}
+
+void Compiler::visitCallExpression(const CallExpression *node, uint32_t dst)
+{
+    const Binding &callee = static_cast<const IdentifierExpression *>(node->callee)->binding;
+    uint32_t mark = current->nextRegister;
+    if (callee.kind == BindingKind::Print)
+    {
+        emit(Instruction::abc(Opcode::Print, operandRegister(node->arguments[0])), node->line);
+        freeRegisters(mark);
+        return;
+    }
+
+    uint32_t base = compileConsecutive(node->arguments, dst, node->line);
+    emit(Instruction::abx(Opcode::Call, base, callee.slot), node->line);
+    if (base != dst)
+        emit(Instruction::abc(Opcode::Move, dst, base), node->line);
+    freeRegisters(mark);
+}
+
+void Compiler::visitTemplateLiteral(const TemplateLiteral *node, uint32_t dst)
+{
+    Template info;
+    info.text.reserve(node->textLength);
+    for (const TemplateSegment &segment : node->segments)
+    {
+        info.text += symbols.name(segment.text);
+        info.segmentLengths.push_back(segment.length);
+    }
+    uint32_t index = static_cast<uint32_t>(module.templates.size());
+    module.templates.push_back(std::move(info));
+
+    uint32_t mark = current->nextRegister;
+    uint32_t base = compileConsecutive(node->expressions, dst, node->line);
+    emit(Instruction::abx(Opcode::Template, base, index), node->line);
+    if (base != dst)
+        emit(Instruction::abc(Opcode::Move, dst, base), node->line);
+    freeRegisters(mark);
+}
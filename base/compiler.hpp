@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast_visitor.hpp"
+#include "bytecode.hpp"
+
+// Translates a checked Program (see checker.hpp) into register bytecode.
+// Names were resolved by the Checker: locals are fixed registers, top-level
+// variables are global slots and calls carry function indices, so neither
+// the compiler nor the VM looks a name up.
+class Compiler : public ASTVisitor<Compiler>
+{
+public:
+    // program must have passed Checker::check() since it was last changed.
+    // Throws std::runtime_error if a function needs too many registers.
+    static Module compile(const Program *program);
+
+private:
+    struct FunctionState
+    {
+        explicit FunctionState(uint32_t index) : index(index) {}
+        uint32_t index;
+        uint32_t nextRegister = 0;
+    };
+
+    explicit Compiler(const Program *program);
+
+    const Interner &symbols;
+    Module module;
+    FunctionState *current = nullptr;
+
+    std::vector<int32_t> stringConstants; // by Symbol; -1 until first use
+    std::unordered_map<uint64_t, uint32_t> numberConstants;
+
+    [[noreturn]] void error(int line, const std::string &message) const;
+    void emit(Instruction ins, int line);
+    Function &function() { return module.functions[current->index]; }
+
+    uint32_t allocateRegister(int line);
+    void freeRegisters(uint32_t mark) { current->nextRegister = mark; }
+    uint32_t numberConstant(double value);
+    uint32_t stringConstant(Symbol value);
+
+    void compileBlock(const ArenaList<ASTNode *> &body);
+    // Evaluates nodes into consecutive registers and returns the first one.
+    // Calls and templates read their operands from there.
+    uint32_t compileConsecutive(const ArenaList<ASTNode *> &nodes, uint32_t dst, int line);
+    // Returns a register holding the value of node: the local's own register
+    // for a local variable, otherwise a fresh temporary. A local is copied to
+    // a temporary as well when later, which is evaluated before the value is
+    // used, may assign it.
+    uint32_t operandRegister(const ASTNode *node, const ASTNode *later = nullptr);
+    // Emits dst = left op right for a binary operator token, reading a
+    // number literal on the right from the constant pool where possible. A
+    // + whose result type is String concatenates.
+    void emitBinary(TokenKind op, TypeName type, uint32_t dst, uint32_t left, const ASTNode *right, int line);
+
+    friend ASTVisitor<Compiler>;
+    void visitProgram(const Program *node, uint32_t dst);
+    void visitLiteralExpression(const LiteralExpression *node, uint32_t dst);
+    void visitIdentifierExpression(const IdentifierExpression *node, uint32_t dst);
+    void visitVariableDeclaration(const VariableDeclaration *node, uint32_t dst);
+    void visitFunctionDeclaration(const FunctionDeclaration *node, uint32_t dst);
+    void visitBlockStatement(const BlockStatement *node, uint32_t dst);
+    void visitReturnStatement(const ReturnStatement *node, uint32_t dst);
+    void visitExpressionStatement(const ExpressionStatement *node, uint32_t dst);
+    void visitBinaryExpression(const BinaryExpression *node, uint32_t dst);
+    void visitAssignmentExpression(const AssignmentExpression *node, uint32_t dst);
+    void visitCallExpression(const CallExpression *node, uint32_t dst);
+    void visitTemplateLiteral(const TemplateLiteral *node, uint32_t dst);
+};
@@ -0,0 +1,43 @@
+#include "diagnostics.hpp"
+#include <utility>
+
+const char *diagnosticCodeId(DiagnosticCode code)
+{
+    switch (code)
+    {
+#define BASE_DIAGNOSTIC_ID(name, id) \
+    case DiagnosticCode::name:       \
+        return id;
+        BASE_DIAGNOSTICS(BASE_DIAGNOSTIC_ID)
+#undef BASE_DIAGNOSTIC_ID
+    }
+    return "?";
+}
+
+std::string formatDiagnostic(const Diagnostic &diagnostic)
+{
+    std::string line = std::to_string(diagnostic.span.line);
+    switch (diagnostic.code)
+    {
+    case DiagnosticCode::SingleQuoteString:
+    case DiagnosticCode::MultiLineString:
+        return diagnostic.message + " at line " + line;
+    case DiagnosticCode::UndefinedVariable:
+    case DiagnosticCode::UndefinedFunction:
+    case DiagnosticCode::FunctionAsValue:
+    case DiagnosticCode::NotCallable:
+    case DiagnosticCode::AssignmentToConstant:
+    case DiagnosticCode::AssignmentToFunction:
+    case DiagnosticCode::ArgumentCount:
+    case DiagnosticCode::TypeMismatch:
+    case DiagnosticCode::MissingReturn:
+        return "Compile error at line " + line + ": " + diagnostic.message;
+    default:
+        return "Parse error at line " + line + ": " + diagnostic.message;
+    }
+}
+
+void Diagnostics::report(DiagnosticCode code, SourceSpan span, std::string message)
+{
+    items.push_back(Diagnostic{code, span, std::move(message)});
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every diagnostic the front end can report. The id is stable across
+// releases so tools can match on it; the list is the single source of truth
+// for DiagnosticCode and diagnosticCodeId().
+#define BASE_DIAGNOSTICS(X)                 \
+    X(SingleQuoteString, "E0001")           \
+    X(MultiLineString, "E0002")             \
+    X(ExpectedToken, "E0100")               \
+    X(ExpectedTypeAnnotation, "E0101")      \
+    X(ExpectedIdentifier, "E0102")          \
+    X(ExpectedReturnType, "E0103")          \
+    X(ExpectedFunctionName, "E0104")        \
+    X(ExpectedParameterType, "E0105")       \
+    X(ExpectedParameterName, "E0106")       \
+    X(UnexpectedToken, "E0107")             \
+    X(UnclosedTemplatePlaceholder, "E0108") \
+    X(InvalidAssignmentTarget, "E0109")     \
+    X(UndefinedVariable, "E0200")           \
+    X(UndefinedFunction, "E0201")           \
+    X(FunctionAsValue, "E0202")             \
+    X(NotCallable, "E0203")                 \
+    X(AssignmentToConstant, "E0204")        \
+    X(AssignmentToFunction, "E0205")        \
+    X(ArgumentCount, "E0206")               \
+    X(TypeMismatch, "E0207")                \
+    X(MissingReturn, "E0208")
+
+enum class DiagnosticCode : uint8_t
+{
+#define BASE_DIAGNOSTIC_CODE(name, id) name,
+    BASE_DIAGNOSTICS(BASE_DIAGNOSTIC_CODE)
+#undef BASE_DIAGNOSTIC_CODE
+};
+
+const char *diagnosticCodeId(DiagnosticCode code);
+
+// Where a diagnostic points: byte offset and length in the source (for a
+// streaming lexer, in the whole input modulo 2^32) and the 1-based line.
+struct SourceSpan
+{
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    int line = 0;
+};
+
+struct Diagnostic
+{
+    DiagnosticCode code;
+    SourceSpan span;
+    std::string message;
+};
+
+// The wording used since before diagnostics were collected, e.g.
+// "Parse error at line 3: Expected ';' after expression". Codes from E0200
+// on come from the Checker and read "Compile error at line 3: ...".
+std::string formatDiagnostic(const Diagnostic &diagnostic);
+
+// Collects the diagnostics of one parse, in source order.
+class Diagnostics
+{
+public:
+    void report(DiagnosticCode code, SourceSpan span, std::string message);
+
+    bool hasErrors() const { return !items.empty(); }
+    size_t size() const { return items.size(); }
+    const std::vector<Diagnostic> &all() const { return items; }
+    const Diagnostic &first() const { return items.front(); }
+    void clear() { items.clear(); }
+
+private:
+    std::vector<Diagnostic> items;
+};
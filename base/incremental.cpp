@@ -0,0 +1,209 @@
+#include "incremental.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "ast_visitor.hpp"
+
+namespace
+{
+
+// Moves every node of a reused statement by the number of lines and bytes
+// an edit before it added or removed.
+class NodeShifter : public MutableASTVisitor<NodeShifter>
+{
+public:
+    NodeShifter(int lineDelta, int64_t offsetDelta) : lineDelta(lineDelta), offsetDelta(offsetDelta) {}
+
+    void visitProgram(Program *) {}
+    void visitLiteralExpression(LiteralExpression *node) { move(node); }
+    void visitIdentifierExpression(IdentifierExpression *node) { move(node); }
+    void visitVariableDeclaration(VariableDeclaration *node)
+    {
+        move(node);
+        for (VariableDeclarator &decl : node->declarations)
+            visit(decl.init);
+    }
+    void visitFunctionDeclaration(FunctionDeclaration *node)
+    {
+        move(node);
+        visit(node->body);
+    }
+    void visitBlockStatement(BlockStatement *node)
+    {
+        move(node);
+        for (ASTNode *stmt : node->body)
+            visit(stmt);
+    }
+    void visitReturnStatement(ReturnStatement *node)
+    {
+        move(node);
+        if (node->argument)
+            visit(node->argument);
+    }
+    void visitExpressionStatement(ExpressionStatement *node)
+    {
+        move(node);
+        visit(node->expression);
+    }
+    void visitBinaryExpression(BinaryExpression *node)
+    {
+        move(node);
+        visit(node->left);
+        visit(node->right);
+    }
+    void visitAssignmentExpression(AssignmentExpression *node)
+    {
+        move(node);
+        visit(node->value);
+    }
+    void visitCallExpression(CallExpression *node)
+    {
+        move(node);
+        visit(node->callee);
+        for (ASTNode *arg : node->arguments)
+            visit(arg);
+    }
+    void visitTemplateLiteral(TemplateLiteral *node)
+    {
+        move(node);
+        for (ASTNode *expr : node->expressions)
+            visit(expr);
+    }
+
+private:
+    int lineDelta;
+    int64_t offsetDelta;
+
+    void move(ASTNode *node)
+    {
+        node->line += lineDelta;
+        node->offset = static_cast<uint32_t>(node->offset + offsetDelta);
+    }
+};
+
+} // namespace
+
+void IncrementalParser::drop()
+{
+    tree.reset();
+    statements.clear();
+    starts.clear();
+    lines.clear();
+}
+
+const Program &IncrementalParser::parse()
+{
+    drop();
+    auto program = std::make_unique<Program>();
+    Lexer lexer(source);
+    Parser parser(lexer);
+    parser.attach(*program);
+    try
+    {
+        while (parser.peekToken().type != TokenTypeEnum::EndOfFile)
+        {
+            starts.push_back(tokenStart(parser.peekToken()));
+            lines.push_back(parser.peekToken().line);
+            statements.push_back(parser.parseTopLevelStatement());
+        }
+    }
+    catch (...)
+    {
+        drop();
+        throw;
+    }
+    starts.push_back(tokenStart(parser.peekToken()));
+    lines.push_back(parser.peekToken().line);
+    program->body = {statements.data(), static_cast<uint32_t>(statements.size())};
+    fullParseBytes = program->arena.bytesUsed();
+    parsedCount = statements.size();
+    tree = std::move(program);
+    return *tree;
+}
+
+const Program &IncrementalParser::edit(const TextEdit &edit)
+{
+    if (edit.offset > source.size() || edit.removed > source.size() - edit.offset)
+        throw std::out_of_range("Edit outside of the source text");
+    if (!tree || tree->arena.bytesUsed() > 2 * fullParseBytes + MinCompactBytes)
+    {
+        source.replace(edit.offset, edit.removed, edit.inserted);
+        return parse();
+    }
+
+    // Reparse from the first statement whose span reaches the edit, counting
+    // its end: declarations take the line of the token that follows them.
+    size_t count = statements.size();
+    size_t first = std::lower_bound(starts.begin() + 1, starts.begin() + count + 1, edit.offset) - starts.begin() - 1;
+    uint32_t restart = first == 0 ? 0 : starts[first];
+    int restartLine = first == 0 ? 1 : lines[first];
+    // Old statements from resume on lie wholly after the edit; the first of
+    // them whose start the new token stream reaches ends the reparse.
+    uint32_t editEnd = edit.offset + edit.removed;
+    size_t resume = std::lower_bound(starts.begin() + first, starts.end(), editEnd) - starts.begin();
+    int64_t delta = static_cast<int64_t>(edit.inserted.size()) - edit.removed;
+    source.replace(edit.offset, edit.removed, edit.inserted);
+
+    std::vector<ASTNode *> fresh;
+    std::vector<uint32_t> freshStarts;
+    std::vector<int> freshLines;
+    Lexer lexer(std::string_view(source).substr(restart), restartLine, restart);
+    Parser parser(lexer);
+    parser.attach(*tree);
+    bool aligned = false;
+    try
+    {
+        for (;;)
+        {
+            const Token &next = parser.peekToken();
+            int64_t position = tokenStart(next);
+            while (resume <= count && starts[resume] + delta < position)
+                resume++;
+            if (resume <= count && starts[resume] + delta == position)
+            {
+                aligned = true;
+                break;
+            }
+            freshStarts.push_back(static_cast<uint32_t>(position));
+            freshLines.push_back(next.line);
+            if (next.type == TokenTypeEnum::EndOfFile)
+                break;
+            fresh.push_back(parser.parseTopLevelStatement());
+        }
+    }
+    catch (...)
+    {
+        drop();
+        throw;
+    }
+
+    if (aligned)
+    {
+        int lineDelta = parser.peekToken().line - lines[resume];
+        for (size_t i = resume; i <= count; i++)
+        {
+            starts[i] = static_cast<uint32_t>(starts[i] + delta);
+            lines[i] += lineDelta;
+        }
+        if (lineDelta != 0 || delta != 0)
+        {
+            NodeShifter shifter(lineDelta, delta);
+            for (size_t i = resume; i < count; i++)
+                shifter.visit(statements[i]);
+        }
+    }
+    else
+    {
+        // Reached the end of file without lining up; freshStarts ends with
+        // the new end-of-file entry.
+        resume = count + 1;
+    }
+    statements.erase(statements.begin() + first, statements.begin() + std::min(resume, count));
+    statements.insert(statements.begin() + first, fresh.begin(), fresh.end());
+    starts.erase(starts.begin() + first, starts.begin() + resume);
+    starts.insert(starts.begin() + first, freshStarts.begin(), freshStarts.end());
+    lines.erase(lines.begin() + first, lines.begin() + resume);
+    lines.insert(lines.begin() + first, freshLines.begin(), freshLines.end());
+    tree->body = {statements.data(), static_cast<uint32_t>(statements.size())};
+    parsedCount = fresh.size();
+    return *tree;
+}
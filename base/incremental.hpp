@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "parser.hpp"
+
+// Replaces removed bytes at offset with inserted.
+struct TextEdit
+{
+    uint32_t offset;
+    uint32_t removed;
+    std::string_view inserted;
+};
+
+// Keeps the tree of a source text up to date while the text is edited. An
+// edit re-lexes and reparses from the top-level statement it touches until
+// the token stream lines up with a statement start of the old text again;
+// the statements before and after that region are reused as they are, with
+// their line numbers moved when the edit added or removed lines. Nodes an
+// edit replaced stay in the program's arena until it has grown to twice its
+// size after the last full parse; the next edit then parses from scratch.
+class IncrementalParser
+{
+public:
+    explicit IncrementalParser(std::string text) : source(std::move(text)) {}
+
+    // Parses the whole text. Throws std::runtime_error on parse errors.
+    const Program &parse();
+
+    // Applies edit to the text and updates the tree. On a parse error the
+    // text keeps the edit, the tree is dropped and the error is thrown; the
+    // next edit then parses from scratch. The returned program, like
+    // program(), is valid until the next edit.
+    const Program &edit(const TextEdit &edit);
+
+    std::string_view text() const { return source; }
+    // Null before the first parse and after a parse error.
+    const Program *program() const { return tree.get(); }
+    // Top-level statements the last parse or edit had to parse.
+    size_t statementsParsed() const { return parsedCount; }
+
+private:
+    static constexpr size_t MinCompactBytes = 1024 * 1024;
+
+    std::string source;
+    std::unique_ptr<Program> tree;
+    // Backing store of tree->body. Statement i spans from starts[i] up to
+    // starts[i + 1], trailing whitespace and comments included, and begins
+    // on lines[i]; the last entry of starts and lines is the end of file.
+    std::vector<ASTNode *> statements;
+    std::vector<uint32_t> starts;
+    std::vector<int> lines;
+    size_t fullParseBytes = 0;
+    size_t parsedCount = 0;
+
+    void drop();
+};
@@ -0,0 +1,94 @@
+#include "interner.hpp"
+#include <cstring>
+
+Interner::Interner() : names(1), table(256, Slot{0, NoSymbol}), mask(255) {}
+
+uint32_t Interner::hash(std::string_view text)
+{
+    // Word-at-a-time multiplicative hash; string literals can be long, so
+    // avoid a per-byte loop.
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t h = text.size() * multiplier;
+    const char *p = text.data();
+    size_t n = text.size();
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    if (n > 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, p, n);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+Symbol Interner::find(std::string_view text) const
+{
+    uint32_t h = hash(text);
+    for (size_t i = h & mask;; i = (i + 1) & mask)
+    {
+        const Slot &slot = table[i];
+        if (slot.symbol == NoSymbol)
+            return NoSymbol;
+        if (slot.hash == h && names[slot.symbol] == text)
+            return slot.symbol;
+    }
+}
+
+Symbol Interner::intern(std::string_view text)
+{
+    uint32_t h = hash(text);
+    size_t i = h & mask;
+    for (;; i = (i + 1) & mask)
+    {
+        const Slot &slot = table[i];
+        if (slot.symbol == NoSymbol)
+            break;
+        if (slot.hash == h && names[slot.symbol] == text)
+            return slot.symbol;
+    }
+    Symbol symbol = static_cast<Symbol>(names.size());
+    names.push_back(storage.copyString(text));
+    table[i] = Slot{h, symbol};
+    // Keep the load factor at or below one half.
+    if (names.size() * 2 > table.size())
+        grow();
+    return symbol;
+}
+
+void Interner::grow()
+{
+    std::vector<Slot> larger(table.size() * 2, Slot{0, NoSymbol});
+    mask = larger.size() - 1;
+    for (const Slot &slot : table)
+    {
+        if (slot.symbol == NoSymbol)
+            continue;
+        size_t i = slot.hash & mask;
+        while (larger[i].symbol != NoSymbol)
+            i = (i + 1) & mask;
+        larger[i] = slot;
+    }
+    table.swap(larger);
+}
+
+void Interner::clear()
+{
+    storage.reset();
+    names.resize(1);
+    // Back to the initial size: refilling a table grown for one large
+    // program would cost more than growing it again.
+    table.assign(256, Slot{0, NoSymbol});
+    mask = 255;
+}
+
+size_t Interner::bytesUsed() const
+{
+    return storage.bytesUsed() + names.capacity() * sizeof(std::string_view) + table.capacity() * sizeof(Slot);
+}
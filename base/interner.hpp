@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "arena.hpp"
+
+// Compact handle for an interned identifier or string literal. Symbols are
+// dense indices into the owning Interner; equal text always yields the same
+// Symbol, so names compare as integers.
+using Symbol = uint32_t;
+
+constexpr Symbol NoSymbol = 0;
+
+class Interner
+{
+public:
+    Interner();
+
+    Symbol intern(std::string_view text);
+    // Returns NoSymbol if text has not been interned.
+    Symbol find(std::string_view text) const;
+    std::string_view name(Symbol symbol) const { return names[symbol]; }
+
+    size_t size() const { return names.size() - 1; }
+    // Forgets every symbol, keeping the storage's first chunk for reuse.
+    void clear();
+    size_t bytesUsed() const;
+
+private:
+    Arena storage;
+    struct Slot
+    {
+        uint32_t hash;
+        Symbol symbol; // NoSymbol marks an empty slot
+    };
+
+    std::vector<std::string_view> names; // indexed by Symbol; entry 0 is NoSymbol
+    std::vector<Slot> table;             // open addressing with linear probing
+    size_t mask = 0;
+
+    static uint32_t hash(std::string_view text);
+    void grow();
+};
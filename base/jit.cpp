@@ -0,0 +1,593 @@
+#include "jit.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "profile.hpp"
+
+#if BASE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+NativeCode::~NativeCode() { release(); }
+
+NativeCode::NativeCode(NativeCode &&other) noexcept { *this = std::move(other); }
+
+NativeCode &NativeCode::operator=(NativeCode &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    release();
+    memory = std::exchange(other.memory, nullptr);
+    size = std::exchange(other.size, 0);
+    entries = std::move(other.entries);
+    compiled = std::exchange(other.compiled, 0);
+    other.entries.clear();
+    return *this;
+}
+
+#if !BASE_JIT
+
+void NativeCode::release() {}
+
+NativeCode NativeCode::compile(const Program *, const Module &) { return NativeCode(); }
+
+bool NativeCode::call(const void *, const double *, double *, size_t) const { return false; }
+
+#else
+
+namespace {
+
+// System V on the way in; between native functions, arguments go in xmm0
+// up, the result comes back in xmm0, xmm8-xmm15 are preserved and r14 and
+// r15 hold the entry stub's stack pointer and the stack limit.
+//
+// A function keeps local slot i in xmm8+i and evaluates expressions on a
+// stack of registers, the value at depth d in xmm d. xmm7 is scratch.
+constexpr int MaxLocals = 8;
+constexpr int MaxDepth = 6;
+constexpr int Scratch = 7;
+constexpr int LocalBase = 8;
+
+struct Unsupported
+{
+};
+
+class Assembler
+{
+public:
+    std::vector<uint8_t> code;
+
+    size_t offset() const { return code.size(); }
+    void byte(uint8_t value) { code.push_back(value); }
+    void bytes(std::initializer_list<uint8_t> values) { code.insert(code.end(), values); }
+    void u32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void u64(uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void patch32(size_t at, uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            code[at + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    // The rel32 at `at` so that it reaches target.
+    void patchRelative(size_t at, size_t target) { patch32(at, static_cast<uint32_t>(target - (at + 4))); }
+
+    // prefix [REX] 0F op with reg and rm registers.
+    void sse(uint8_t prefix, uint8_t op, int reg, int rm, bool wide = false)
+    {
+        byte(prefix);
+        rex(wide, reg, rm);
+        byte(0x0F);
+        byte(op);
+        byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+    // prefix [REX] 0F op with reg and [rbp + disp].
+    void sseFrame(uint8_t prefix, uint8_t op, int reg, int32_t disp)
+    {
+        byte(prefix);
+        rex(false, reg, 0);
+        byte(0x0F);
+        byte(op);
+        byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | 5));
+        u32(static_cast<uint32_t>(disp));
+    }
+
+    void movapd(int dst, int src)
+    {
+        if (dst != src)
+            sse(0x66, 0x28, dst, src);
+    }
+    void load(int dst, int32_t disp) { sseFrame(0xF2, 0x10, dst, disp); }
+    void store(int32_t disp, int src) { sseFrame(0xF2, 0x11, src, disp); }
+    void cmpsd(int dst, int src, uint8_t predicate)
+    {
+        sse(0xF2, 0xC2, dst, src);
+        byte(predicate);
+    }
+    void movqFromRax(int dst) { sse(0x66, 0x6E, dst, 0, true); }
+    void movqToRax(int src) { sse(0x66, 0x7E, src, 0, true); }
+    void movRax(uint64_t value)
+    {
+        bytes({0x48, 0xB8});
+        u64(value);
+    }
+
+    void loadConstant(int dst, double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        if (bits == 0)
+        {
+            sse(0x66, 0x57, dst, dst); // xorpd
+            return;
+        }
+        movRax(bits);
+        movqFromRax(dst);
+    }
+
+    // Turns the all-ones or zero mask of a comparison into 1 or 0.
+    void maskToNumber(int reg)
+    {
+        uint64_t one;
+        double value = 1;
+        std::memcpy(&one, &value, sizeof(one));
+        movqToRax(reg);
+        bytes({0x48, 0xB9}); // mov rcx, imm64
+        u64(one);
+        bytes({0x48, 0x21, 0xC8}); // and rax, rcx
+        movqFromRax(reg);
+    }
+
+private:
+    void rex(bool wide, int reg, int rm)
+    {
+        uint8_t prefix = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+        if (prefix != 0x40)
+            byte(prefix);
+    }
+};
+
+// Generates the entry stub and then each numeric function in turn; a
+// function that turns out to use anything else is dropped, along with the
+// functions that call it.
+class NativeCompiler : public ASTVisitor<NativeCompiler, void>
+{
+public:
+    struct CallSite
+    {
+        size_t at; // the rel32 of the call
+        uint32_t caller;
+        uint32_t callee;
+    };
+
+    NativeCompiler(const Module &module, const std::vector<const FunctionDeclaration *> &declarations)
+        : module(module), declarations(declarations)
+    {
+    }
+
+    Assembler out;
+    std::vector<CallSite> calls;
+    size_t bail = 0;
+
+    void emitEntryStub();
+    // Returns false, emitting nothing, if fn cannot be compiled.
+    bool compileFunction(const FunctionDeclaration *fn);
+
+private:
+    const Module &module;
+    const std::vector<const FunctionDeclaration *> &declarations;
+    const FunctionDeclaration *current = nullptr;
+    int locals = 0;
+    int spills = 0;
+    bool returned = false;
+
+    static int32_t localSave(int slot) { return -8 * (slot + 1); }
+    int32_t spillSlot(int depth) const { return -8 * (locals + depth + 1); }
+    static bool isNumeric(const FunctionDeclaration *fn);
+    static int countLocals(const ArenaList<ASTNode *> &body, int count);
+    static void checkDepth(int depth)
+    {
+        if (depth > MaxDepth)
+            throw Unsupported();
+    }
+
+    // The register of a local number operand, which the operation reads
+    // when it runs, as the VM does; -1 for any other operand.
+    static int localRegister(const ASTNode *node);
+    void block(const ArenaList<ASTNode *> &body);
+    // Leaves left op right in xmm depth. leftRegister, if not -1, is a local
+    // standing in for left.
+    void binary(TokenKind op, int leftRegister, const ASTNode *left, const ASTNode *right, int depth);
+    void apply(TokenKind op, int dst, int src);
+
+    friend ASTVisitor<NativeCompiler, void>;
+    void visitProgram(const Program *, int) { throw Unsupported(); }
+    void visitLiteralExpression(const LiteralExpression *node, int depth);
+    void visitIdentifierExpression(const IdentifierExpression *node, int depth);
+    void visitVariableDeclaration(const VariableDeclaration *node, int depth);
+    void visitFunctionDeclaration(const FunctionDeclaration *, int) {} // compiled on its own
+    void visitBlockStatement(const BlockStatement *node, int) { block(node->body); }
+    void visitReturnStatement(const ReturnStatement *node, int depth);
+    void visitExpressionStatement(const ExpressionStatement *node, int depth) { visit(node->expression, depth); }
+    void visitBinaryExpression(const BinaryExpression *node, int depth);
+    void visitAssignmentExpression(const AssignmentExpression *node, int depth);
+    void visitCallExpression(const CallExpression *node, int depth);
+    void visitTemplateLiteral(const TemplateLiteral *, int) { throw Unsupported(); }
+};
+
+// int stub(const void *function, const double *args, double *result,
+//          const char *stackLimit): loads MaxParams arguments, calls function
+// and stores its result. Native code that runs past the limit jumps to the
+// bail label, which drops all native frames and returns 0.
+void NativeCompiler::emitEntryStub()
+{
+    out.bytes({0x53, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, rbp, r14, r15
+    out.byte(0x52);                                  // push rdx
+    out.bytes({0x49, 0x89, 0xCF});                   // mov r15, rcx
+    out.bytes({0x49, 0x89, 0xE6});                   // mov r14, rsp
+    out.bytes({0x48, 0x89, 0xF8});                   // mov rax, rdi
+    for (uint8_t i = 0; i < NativeCode::MaxParams; i++)
+        out.bytes({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x46 | i << 3), static_cast<uint8_t>(8 * i)}); // movsd xmm i, [rsi + 8i]
+    out.bytes({0xFF, 0xD0});             // call rax
+    out.byte(0x5A);                      // pop rdx
+    out.bytes({0xF2, 0x0F, 0x11, 0x02}); // movsd [rdx], xmm0
+    out.bytes({0xB8, 1, 0, 0, 0});       // mov eax, 1
+    size_t done = out.offset();
+    out.bytes({0x41, 0x5F, 0x41, 0x5E, 0x5D, 0x5B, 0xC3}); // pop r15, r14, rbp, rbx; ret
+    bail = out.offset();
+    out.bytes({0x4C, 0x89, 0xF4}); // mov rsp, r14
+    out.byte(0x5A);                // pop rdx
+    out.bytes({0x31, 0xC0});       // xor eax, eax
+    out.bytes({0xEB, static_cast<uint8_t>(done - (out.offset() + 2))}); // jmp done
+}
+
+bool NativeCompiler::isNumeric(const FunctionDeclaration *fn)
+{
+    if (fn->returnType != TypeName::Number || fn->params.count > NativeCode::MaxParams)
+        return false;
+    for (const Parameter &param : fn->params)
+        if (param.type != TypeName::Number)
+            return false;
+    return true;
+}
+
+int NativeCompiler::countLocals(const ArenaList<ASTNode *> &body, int count)
+{
+    for (const ASTNode *stmt : body)
+        if (const auto *decl = nodeCast<VariableDeclaration>(stmt))
+        {
+            for (const VariableDeclarator &declarator : decl->declarations)
+                count = std::max(count, static_cast<int>(declarator.binding.slot) + 1);
+        }
+        else if (const auto *inner = nodeCast<BlockStatement>(stmt))
+            count = countLocals(inner->body, count);
+    return count;
+}
+
+bool NativeCompiler::compileFunction(const FunctionDeclaration *fn)
+{
+    if (!isNumeric(fn))
+        return false;
+    size_t start = out.offset();
+    size_t callMark = calls.size();
+    current = fn;
+    locals = countLocals(fn->body->body, static_cast<int>(fn->params.count));
+    spills = 0;
+    returned = false;
+    try
+    {
+        if (locals > MaxLocals)
+            throw Unsupported();
+        out.bytes({0x55, 0x48, 0x89, 0xE5}); // push rbp; mov rbp, rsp
+        out.bytes({0x48, 0x81, 0xEC});       // sub rsp, imm32
+        size_t frameSize = out.offset();
+        out.u32(0);
+        out.bytes({0x4C, 0x39, 0xFC, 0x0F, 0x82}); // cmp rsp, r15; jb bail
+        out.u32(0);
+        out.patchRelative(out.offset() - 4, bail);
+        for (int i = 0; i < locals; i++)
+            out.store(localSave(i), LocalBase + i);
+        for (int i = 0; i < static_cast<int>(fn->params.count); i++)
+            out.movapd(LocalBase + i, i);
+        block(fn->body->body);
+        if (!returned)
+            throw Unsupported();
+        uint32_t size = static_cast<uint32_t>(8 * (locals + spills));
+        size = std::max<uint32_t>(size, NativeCode::BytesPerRegister * module.functions[fn->index].numRegisters);
+        out.patch32(frameSize, (size + 15) & ~15u);
+        return true;
+    }
+    catch (const Unsupported &)
+    {
+        out.code.resize(start);
+        calls.resize(callMark);
+        return false;
+    }
+}
+
+int NativeCompiler::localRegister(const ASTNode *node)
+{
+    const auto *ident = nodeCast<IdentifierExpression>(node);
+    if (!ident || ident->binding.kind != BindingKind::Local || ident->valueType != TypeName::Number)
+        return -1;
+    return LocalBase + static_cast<int>(ident->binding.slot);
+}
+
+// Without conditionals the first return always runs; nothing after it can.
+void NativeCompiler::block(const ArenaList<ASTNode *> &body)
+{
+    for (const ASTNode *stmt : body)
+    {
+        if (returned)
+            return;
+        visit(stmt, 0);
+    }
+}
+
+void NativeCompiler::binary(TokenKind op, int leftRegister, const ASTNode *left, const ASTNode *right, int depth)
+{
+    checkDepth(depth);
+    if (left && left->valueType != TypeName::Number)
+        throw Unsupported();
+    if (right->valueType != TypeName::Number)
+        throw Unsupported();
+    if (leftRegister < 0)
+        visit(left, depth);
+    else if (assignsLocal(right, static_cast<uint32_t>(leftRegister - LocalBase)))
+    {
+        // Read the local before right assigns it, as the VM does.
+        out.movapd(depth, leftRegister);
+        leftRegister = -1;
+    }
+    int rightRegister = localRegister(right);
+    const auto *literal = nodeCast<LiteralExpression>(right);
+    if (rightRegister < 0 && literal)
+    {
+        // Loaded only now, as evaluating left may use the scratch register.
+        out.loadConstant(Scratch, literal->numValue);
+        rightRegister = Scratch;
+    }
+    else if (rightRegister < 0)
+    {
+        rightRegister = leftRegister < 0 ? depth + 1 : depth;
+        visit(right, rightRegister);
+    }
+    if (leftRegister >= 0)
+    {
+        if (rightRegister == depth)
+        {
+            out.movapd(Scratch, depth);
+            rightRegister = Scratch;
+        }
+        out.movapd(depth, leftRegister);
+    }
+    apply(op, depth, rightRegister);
+}
+
+void NativeCompiler::apply(TokenKind op, int dst, int src)
+{
+    switch (op)
+    {
+    case TokenKind::Plus:
+        out.sse(0xF2, 0x58, dst, src);
+        return;
+    case TokenKind::Minus:
+        out.sse(0xF2, 0x5C, dst, src);
+        return;
+    case TokenKind::Star:
+        out.sse(0xF2, 0x59, dst, src);
+        return;
+    case TokenKind::Slash:
+        out.sse(0xF2, 0x5E, dst, src);
+        return;
+    case TokenKind::EqualEqual:
+        out.cmpsd(dst, src, 0);
+        break;
+    case TokenKind::BangEqual:
+        out.cmpsd(dst, src, 4);
+        break;
+    case TokenKind::Less:
+        out.cmpsd(dst, src, 1);
+        break;
+    case TokenKind::LessEqual:
+        out.cmpsd(dst, src, 2);
+        break;
+    case TokenKind::Greater:
+    case TokenKind::GreaterEqual:
+        // a > b as b < a, which, unlike not (a <= b), is false for NaN.
+        out.movapd(Scratch, src);
+        out.cmpsd(Scratch, dst, op == TokenKind::Greater ? 1 : 2);
+        out.movapd(dst, Scratch);
+        break;
+    default:
+        throw Unsupported();
+    }
+    out.maskToNumber(dst);
+}
+
+void NativeCompiler::visitLiteralExpression(const LiteralExpression *node, int depth)
+{
+    checkDepth(depth);
+    if (node->isString)
+        throw Unsupported();
+    out.loadConstant(depth, node->numValue);
+}
+
+void NativeCompiler::visitIdentifierExpression(const IdentifierExpression *node, int depth)
+{
+    checkDepth(depth);
+    int reg = localRegister(node);
+    if (reg < 0)
+        throw Unsupported();
+    out.movapd(depth, reg);
+}
+
+void NativeCompiler::visitVariableDeclaration(const VariableDeclaration *node, int depth)
+{
+    for (const VariableDeclarator &declarator : node->declarations)
+    {
+        if (declarator.binding.kind != BindingKind::Local || declarator.type != TypeName::Number ||
+            declarator.init->valueType != TypeName::Number)
+            throw Unsupported();
+        visit(declarator.init, depth);
+        out.movapd(LocalBase + static_cast<int>(declarator.binding.slot), depth);
+    }
+}
+
+void NativeCompiler::visitReturnStatement(const ReturnStatement *node, int)
+{
+    if (!node->argument || node->argument->valueType != TypeName::Number)
+        throw Unsupported();
+    visit(node->argument, 0);
+    for (int i = 0; i < locals; i++)
+        out.load(LocalBase + i, localSave(i));
+    out.bytes({0xC9, 0xC3}); // leave; ret
+    returned = true;
+}
+
+void NativeCompiler::visitBinaryExpression(const BinaryExpression *node, int depth)
+{
+    if (node->valueType != TypeName::Number)
+        throw Unsupported();
+    binary(node->op, localRegister(node->left), node->left, node->right, depth);
+}
+
+void NativeCompiler::visitAssignmentExpression(const AssignmentExpression *node, int depth)
+{
+    checkDepth(depth);
+    if (node->binding.kind != BindingKind::Local || node->value->valueType != TypeName::Number)
+        throw Unsupported();
+    int reg = LocalBase + static_cast<int>(node->binding.slot);
+    TokenKind op = node->binaryOperator();
+    if (op == TokenKind::Equal)
+        visit(node->value, depth);
+    else
+        binary(op, reg, nullptr, node->value, depth);
+    out.movapd(reg, depth);
+}
+
+// Arguments are evaluated above the live temporaries, which are saved in
+// the frame across the call, then moved down to xmm0 up.
+void NativeCompiler::visitCallExpression(const CallExpression *node, int depth)
+{
+    const Binding &callee = static_cast<const IdentifierExpression *>(node->callee)->binding;
+    if (callee.kind != BindingKind::Function || !declarations[callee.slot] || !isNumeric(declarations[callee.slot]))
+        throw Unsupported();
+    int count = static_cast<int>(node->arguments.count);
+    checkDepth(depth + std::max(count - 1, 0));
+    for (int i = 0; i < count; i++)
+        visit(node->arguments[i], depth + i);
+    for (int i = 0; i < depth; i++)
+        out.store(spillSlot(i), i);
+    for (int i = 0; i < count; i++)
+        out.movapd(i, depth + i);
+    out.byte(0xE8); // call rel32
+    calls.push_back({out.offset(), current->index, callee.slot});
+    out.u32(0);
+    out.movapd(depth, 0);
+    for (int i = 0; i < depth; i++)
+        out.load(i, spillSlot(i));
+    spills = std::max(spills, depth);
+}
+
+void collectFunctions(const ArenaList<ASTNode *> &body, std::vector<const FunctionDeclaration *> &functions)
+{
+    for (const ASTNode *stmt : body)
+        if (const auto *fn = nodeCast<FunctionDeclaration>(stmt))
+        {
+            functions[fn->index] = fn;
+            collectFunctions(fn->body->body, functions);
+        }
+        else if (const auto *inner = nodeCast<BlockStatement>(stmt))
+            collectFunctions(inner->body, functions);
+}
+
+} // namespace
+
+void NativeCode::release()
+{
+    if (memory)
+        munmap(memory, size);
+    memory = nullptr;
+    size = 0;
+}
+
+NativeCode NativeCode::compile(const Program *program, const Module &module)
+{
+    BASE_TRACE_SCOPE("NativeCode::compile", "jit");
+    std::vector<const FunctionDeclaration *> declarations(module.functions.size());
+    collectFunctions(program->body, declarations);
+
+    NativeCompiler compiler(module, declarations);
+    compiler.emitEntryStub();
+    std::vector<size_t> starts(declarations.size());
+    std::vector<bool> compiled(declarations.size());
+    for (const FunctionDeclaration *fn : declarations)
+        if (fn)
+        {
+            starts[fn->index] = compiler.out.offset();
+            compiled[fn->index] = compiler.compileFunction(fn);
+        }
+
+    // A function whose callee was dropped is dropped too; its code stays
+    // behind, unreachable.
+    std::vector<std::vector<uint32_t>> callers(declarations.size());
+    std::vector<uint32_t> dropped;
+    for (const NativeCompiler::CallSite &site : compiler.calls)
+        callers[site.callee].push_back(site.caller);
+    for (uint32_t i = 0; i < declarations.size(); i++)
+        if (!compiled[i])
+            dropped.push_back(i);
+    while (!dropped.empty())
+    {
+        uint32_t callee = dropped.back();
+        dropped.pop_back();
+        for (uint32_t caller : callers[callee])
+            if (compiled[caller])
+            {
+                compiled[caller] = false;
+                dropped.push_back(caller);
+            }
+    }
+
+    NativeCode code;
+    code.entries.resize(declarations.size());
+    code.compiled = static_cast<size_t>(std::count(compiled.begin(), compiled.end(), true));
+    if (code.compiled == 0)
+        return code;
+    for (const NativeCompiler::CallSite &site : compiler.calls)
+        if (compiled[site.caller])
+            compiler.out.patchRelative(site.at, starts[site.callee]);
+
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    code.size = (compiler.out.code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, code.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NativeCode(); // interpret everything
+    code.memory = memory;
+    std::memcpy(memory, compiler.out.code.data(), compiler.out.code.size());
+    if (mprotect(memory, code.size, PROT_READ | PROT_EXEC) != 0)
+        return NativeCode();
+    for (size_t i = 0; i < declarations.size(); i++)
+        if (compiled[i])
+            code.entries[i] = static_cast<const uint8_t *>(memory) + starts[i];
+    return code;
+}
+
+bool NativeCode::call(const void *function, const double *args, double *result, size_t stackBudget) const
+{
+    using Stub = int (*)(const void *, const double *, double *, uintptr_t);
+    // Measured from here, which also counts the stub's own pushes.
+    volatile char marker = 0;
+    uintptr_t limit = reinterpret_cast<uintptr_t>(&marker) - stackBudget;
+    return reinterpret_cast<Stub>(memory)(function, args, result, limit) != 0;
+}
+
+#endif
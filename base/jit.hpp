@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ast_visitor.hpp"
+#include "bytecode.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define BASE_JIT 1
+#else
+#define BASE_JIT 0
+#endif
+
+// Machine code for the numeric functions of a program: those whose
+// parameters and result are all numbers and whose bodies only do arithmetic
+// on locals, constants and calls to other such functions. Values stay in SSE
+// registers and native functions call each other directly. The VM calls into
+// this code where it can and interprets everything else (see VM::run()).
+//
+// Native code is pure, so a call can always be redone in the VM. It gives up
+// (returns false from call()) when its stack use exceeds a budget that the
+// VM derives from its own limits, which it can only do where the VM itself
+// would have stopped with a stack overflow, or shortly before.
+//
+// Only Linux on x86-64 has a back end; elsewhere compile() returns no code.
+class NativeCode
+{
+public:
+    NativeCode() = default;
+    ~NativeCode();
+    NativeCode(const NativeCode &) = delete;
+    NativeCode &operator=(const NativeCode &) = delete;
+    NativeCode(NativeCode &&other) noexcept;
+    NativeCode &operator=(NativeCode &&other) noexcept;
+
+    // program must be the checked program module was compiled from.
+    static NativeCode compile(const Program *program, const Module &module);
+
+    static constexpr uint32_t MaxParams = 8;
+    // Every native frame takes at least this much stack for each VM
+    // register its function has, plus BytesPerCall; budgets count on it.
+    static constexpr size_t BytesPerRegister = 8;
+    static constexpr size_t BytesPerCall = 16;
+
+    // The code of function index, or null if it has none.
+    const void *function(uint32_t index) const { return index < entries.size() ? entries[index] : nullptr; }
+    size_t functionCount() const { return compiled; }
+
+    // Runs function with MaxParams arguments (the unused ones ignored). Returns
+    // false, having had no effect, if it would use more than stackBudget
+    // bytes of stack.
+    bool call(const void *function, const double *args, double *result, size_t stackBudget) const;
+
+private:
+    void *memory = nullptr;
+    size_t size = 0;
+    std::vector<const void *> entries; // by function index
+    size_t compiled = 0;
+
+    void release();
+};
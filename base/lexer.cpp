@@ -1,15 +1,75 @@
 #include "lexer.hpp"
+#include "profile.hpp"
+#include "source_buffer.hpp"
+#include <charconv>
+#include <cmath>
 #include <iostream>
-#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
+#include <utility>
 
-const std::unordered_set<std::string> Lexer::keywords = {
-    "let", "const", "function", "return",
-    "number", "string", "void",
-    "if", "else", "for", "while", "break", "continue", "print"
+namespace {
+
+struct KeywordEntry {
+    const char *text;
+    size_t length;
+    TokenKind kind;
+};
+
+constexpr KeywordEntry keywordEntries[] = {
+#define BASE_KEYWORD_ENTRY(name, text) {text, sizeof(text) - 1, TokenKind::name},
+    BASE_KEYWORDS(BASE_KEYWORD_ENTRY)
+#undef BASE_KEYWORD_ENTRY
 };
 
-Lexer::Lexer(const std::string &src) : source(src) {}
+// Perfect hash over the keyword set, built and checked at compile time. If a
+// new keyword collides, the static_assert below fires and the multipliers in
+// keywordHash need adjusting.
+constexpr size_t KeywordTableSize = 64;
+
+constexpr size_t keywordHash(char first, char last, size_t length) {
+    return (static_cast<unsigned char>(first) + 2u * static_cast<unsigned char>(last) + length) & (KeywordTableSize - 1);
+}
+
+struct KeywordTable {
+    signed char slots[KeywordTableSize];
+    bool perfect;
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable table{};
+    table.perfect = true;
+    for (size_t i = 0; i < KeywordTableSize; i++)
+        table.slots[i] = -1;
+    for (size_t i = 0; i < sizeof(keywordEntries) / sizeof(keywordEntries[0]); i++) {
+        const KeywordEntry &entry = keywordEntries[i];
+        size_t slot = keywordHash(entry.text[0], entry.text[entry.length - 1], entry.length);
+        if (table.slots[slot] != -1)
+            table.perfect = false;
+        table.slots[slot] = static_cast<signed char>(i);
+    }
+    return table;
+}
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+static_assert(keywordTable.perfect, "keyword hash has collisions");
+
+TokenKind keywordKind(const char *text, size_t length) {
+    int index = keywordTable.slots[keywordHash(text[0], text[length - 1], length)];
+    if (index < 0)
+        return TokenKind::Identifier;
+    const KeywordEntry &entry = keywordEntries[index];
+    if (entry.length != length || std::memcmp(entry.text, text, length) != 0)
+        return TokenKind::Identifier;
+    return entry.kind;
+}
+
+} // namespace
+
+Lexer::Lexer(std::string_view src, int firstLine, uint32_t firstOffset)
+    : source(src), line(firstLine), scanner(&charScanner()), base(firstOffset) {}
+Lexer::Lexer(SourceStream &stream) : source(stream.window()), scanner(&charScanner()), stream(&stream), base(stream.windowStart()), keepFrom(base) {}
 
 char Lexer::peekChar() const {
     if (pos >= source.size()) return '\0';
@@ -21,143 +81,391 @@ char Lexer::peekNextChar() const {
 }
 char Lexer::advanceChar() {
     char c = peekChar();
-    pos++;
+    if (pos < source.size()) pos++;
     if (c == '\n') line++;
     return c;
 }
 void Lexer::skipWhitespaceAndComments() {
-    while (true) {
-        char c = peekChar();
-        if (c == '\0') break;
-        if (isspace(static_cast<unsigned char>(c))) {
-            advanceChar();
+    const char *data = source.data();
+    const char *end = data + source.size();
+    while (pos < source.size()) {
+        const char *p = data + pos;
+        if (hasCharClass(*p, CharSpace)) {
+            const char *stop = scanner->skipSpace(p, end);
+            line += static_cast<int>(scanner->countNewlines(p, stop));
+            pos = stop - data;
             continue;
         }
-        if (c == '/' && peekNextChar() == '/') {
-            advanceChar(); advanceChar();
-            while (peekChar() != '\n' && peekChar() != '\0') advanceChar();
+        if (*p != '/' || p + 1 == end)
+            break;
+        if (p[1] == '/') {
+            pos = scanner->findAny(p + 2, end, '\n', '\0', '\0', '\0') - data;
             continue;
         }
-        if (c == '/' && peekNextChar() == '*') {
-            advanceChar(); advanceChar();
+        if (p[1] == '*') {
+            const char *body = p + 2;
+            const char *q = body;
             while (true) {
-                char ch = peekChar();
-                if (ch == '\0') return;
-                if (ch == '*' && peekNextChar() == '/') {
-                    advanceChar(); advanceChar();
-                    break;
+                q = scanner->findAny(q, end, '*', '\0', '\0', '\0');
+                if (q == end || *q == '\0') {
+                    line += static_cast<int>(scanner->countNewlines(body, q));
+                    pos = q - data;
+                    return;
                 }
-                advanceChar();
+                if (q + 1 < end && q[1] == '/')
+                    break;
+                q++;
             }
+            line += static_cast<int>(scanner->countNewlines(body, q));
+            pos = q + 2 - data;
             continue;
         }
         break;
     }
 }
+Token Lexer::makeToken(TokenTypeEnum type, TokenKind kind, size_t start, size_t end, int tokenLine, uint8_t flags) const {
+    Token token;
+    token.type = type;
+    token.kind = kind;
+    token.flags = flags;
+    token.offset = static_cast<uint32_t>(base + start);
+    token.length = static_cast<uint32_t>(end - start);
+    token.line = tokenLine;
+    return token;
+}
 Token Lexer::readIdentifierOrKeyword() {
-    std::string value;
-    char c = peekChar();
-    while (isalnum(static_cast<unsigned char>(c)) || c == '_') {
-        value += advanceChar();
-        c = peekChar();
-    }
-    if (keywords.count(value))
-        return {TokenTypeEnum::Keyword, value, line};
-    return {TokenTypeEnum::Identifier, value, line};
+    size_t start = pos;
+    pos = scanner->skipIdentBody(source.data() + pos, source.data() + source.size()) - source.data();
+    TokenKind kind = keywordKind(source.data() + start, pos - start);
+    if (kind != TokenKind::Identifier)
+        return makeToken(TokenTypeEnum::Keyword, kind, start, pos, line);
+    return makeToken(TokenTypeEnum::Identifier, kind, start, pos, line);
 }
+// Decimal (1, 2.5, 1., 6.02e23), hex (0xFF) and either with '_' between
+// digits (1_000_000). A separator, an exponent or a hex prefix belongs to the
+// number only when a digit follows, so text like "2e" or "1_x" lexes as
+// before: a number and then an identifier.
 Token Lexer::readNumber() {
-    std::string value;
-    bool hasDot = false;
-    char c = peekChar();
-    while (isdigit(static_cast<unsigned char>(c)) || (c == '.' && !hasDot)) {
-        if (c == '.') hasDot = true;
-        value += advanceChar();
-        c = peekChar();
+    const char *data = source.data();
+    const char *end = data + source.size();
+    size_t start = pos;
+    const char *p = data + pos;
+    uint8_t flags = 0;
+    // Set when a streamed window ends where the next character decides.
+    bool cut = false;
+    bool more = stream && !stream->atEnd();
+    auto digitAt = [&](const char *q, uint8_t cls) {
+        if (q < end)
+            return hasCharClass(*q, cls);
+        cut |= more;
+        return false;
+    };
+    auto digits = [&](const char *q, uint8_t cls) {
+        const char *first = q;
+        while (true) {
+            while (q < end && hasCharClass(*q, cls)) q++;
+            if (q == first || q == end || *q != '_' || !digitAt(q + 1, cls))
+                return q;
+            flags |= TokenNumberSeparators;
+            q++;
+        }
+    };
+    if (p[0] == '0' && p + 1 < end && (p[1] == 'x' || p[1] == 'X') && digitAt(p + 2, CharHexDigit)) {
+        flags |= TokenNumberHex;
+        p = digits(p + 2, CharHexDigit);
+    } else {
+        p = digits(p, CharDigit);
+        if (p < end && *p == '.') {
+            flags |= TokenNumberFraction;
+            p = digits(p + 1, CharDigit);
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            if (q < end && (*q == '+' || *q == '-')) q++;
+            if (digitAt(q, CharDigit)) {
+                flags |= TokenNumberFraction;
+                p = digits(q, CharDigit);
+            }
+        }
+    }
+    pos = cut ? source.size() : static_cast<size_t>(p - data);
+    return makeToken(TokenTypeEnum::Number, TokenKind::Number, start, p - data, line, flags);
+}
+double Lexer::numberValue(const Token &token) const {
+    std::string_view digits = text(token);
+    // Up to 15 decimal digits are below 2^53, so the sum is exact.
+    if (!(token.flags & (TokenNumberHex | TokenNumberFraction | TokenNumberSeparators)) && digits.size() <= 15) {
+        uint64_t value = 0;
+        for (char c : digits)
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+        return static_cast<double>(value);
+    }
+    bool hex = token.flags & TokenNumberHex;
+    if (hex)
+        digits.remove_prefix(2);
+    // A null-terminated copy without separators; only literals of 256
+    // characters or more go to the heap.
+    char stack[256];
+    std::string heap;
+    char *copy = stack;
+    if (digits.size() >= sizeof(stack)) {
+        heap.resize(digits.size() + 1);
+        copy = heap.data();
     }
-    return {TokenTypeEnum::Number, value, line};
+    size_t length = 0;
+    for (char c : digits)
+        if (c != '_')
+            copy[length++] = c;
+    copy[length] = '\0';
+    double value = 0;
+#ifdef __cpp_lib_to_chars
+    std::from_chars_result result =
+        std::from_chars(copy, copy + length, value, hex ? std::chars_format::hex : std::chars_format::general);
+    if (result.ec == std::errc::result_out_of_range) {
+        // No value is stored; tell overflow from underflow by the exponent.
+        const char *exponent = hex ? nullptr : std::strpbrk(copy, "eE");
+        value = exponent && exponent[1] == '-' ? 0.0 : HUGE_VAL;
+    }
+#else
+    // The driver never changes the C locale, so strtod reads '.' as here.
+    value = hex ? std::strtod((std::string("0x") + copy).c_str(), nullptr) : std::strtod(copy, nullptr);
+#endif
+    return value;
 }
 Token Lexer::readString() {
     char opener = peekChar();
     if (opener != '"') throw std::runtime_error("readString called on non-\" at line " + std::to_string(line));
     advanceChar();
-    std::string value;
+    const char *data = source.data();
+    const char *end = data + source.size();
+    size_t start = pos;
+    uint8_t flags = 0;
+    const char *p = data + pos;
     while (true) {
-        char c = peekChar();
-        if (c == '\0') break;
-        if (c == '\n') throw std::runtime_error("Multi-line string not allowed with double quotes at line " + std::to_string(line));
-        if (c == '"') { advanceChar(); break; }
-        if (c == '\\') {
-            advanceChar();
-            char esc = peekChar();
-            switch (esc) {
-                case 'n': value += '\n'; break;
-                case 't': value += '\t'; break;
-                case 'r': value += '\r'; break;
-                case '"': value += '"'; break;
-                case '\\': value += '\\'; break;
-                default: value += esc;
-            }
-            advanceChar();
-        } else {
-            value += advanceChar();
+        p = scanner->findAny(p, end, '"', '\\', '\n', '\0');
+        if (p == end || *p == '\0') break;
+        if (*p == '\n') {
+            // End the string at the newline; it is lexed as whitespace next.
+            pos = p - data;
+            setError(DiagnosticCode::MultiLineString, start - 1, pos, "Multi-line string not allowed with double quotes");
+            return makeToken(TokenTypeEnum::String, TokenKind::String, start, pos, line, flags);
+        }
+        if (*p == '"') break;
+        flags |= TokenHasEscapes;
+        if (++p < end) {
+            if (*p == '\n') line++;
+            p++;
         }
     }
-    return {TokenTypeEnum::String, value, line};
+    pos = p - data;
+    Token token = makeToken(TokenTypeEnum::String, TokenKind::String, start, pos, line, flags);
+    if (p < end && *p == '"') pos++;
+    return token;
 }
 Token Lexer::readTemplateLiteral() {
     advanceChar(); // skip `
-    std::string value;
+    const char *data = source.data();
+    const char *end = data + source.size();
+    size_t start = pos;
+    uint8_t flags = 0;
     int startLine = line;
+    const char *p = data + pos;
     while (true) {
-        char c = peekChar();
-        if (c == '\0') break;
-        if (c == '`') { advanceChar(); break; }
-        if (c == '\\') {
-            advanceChar();
-            char esc = peekChar();
-            if (esc == 'n') value += '\n';
-            else if (esc == 't') value += '\t';
-            else if (esc == 'r') value += '\r';
-            else value += esc;
-            advanceChar();
-            continue;
+        const char *q = scanner->findAny(p, end, '`', '\\', '\0', '\0');
+        line += static_cast<int>(scanner->countNewlines(p, q));
+        p = q;
+        if (p == end || *p != '\\') break;
+        flags |= TokenHasEscapes;
+        if (++p < end) {
+            if (*p == '\n') line++;
+            p++;
         }
-        value += advanceChar();
     }
-    return {TokenTypeEnum::TemplateLiteral, value, startLine};
+    pos = p - data;
+    Token token = makeToken(TokenTypeEnum::TemplateLiteral, TokenKind::TemplateLiteral, start, pos, startLine, flags);
+    if (p < end && *p == '`') pos++;
+    return token;
+}
+// Not part of the language; lexed as a string up to the closing quote on
+// the same line so that the parser can go on.
+Token Lexer::readSingleQuotedString() {
+    size_t start = pos + 1;
+    const char *data = source.data();
+    const char *end = data + source.size();
+    const char *p = scanner->findAny(data + start, end, '\'', '\n', '\0', '\0');
+    pos = p - data;
+    setError(DiagnosticCode::SingleQuoteString, start - 1, pos, "Single-quote strings not allowed in BASE");
+    Token token = makeToken(TokenTypeEnum::String, TokenKind::String, start, pos, line);
+    if (p < end && *p == '\'') pos++;
+    return token;
 }
 Token Lexer::readSymbol() {
-    std::string two;
     char a = peekChar();
     char b = peekNextChar();
-    two += a; two += b;
-    static const std::unordered_set<std::string> twoChar = {
-        "==", "!=", "<=", ">=", "+=", "-=", "*=", "/=", "++", "--"
-    };
-    if (twoChar.count(two)) {
+    TokenKind kind = TokenKind::Symbol;
+    TokenKind twoCharKind = TokenKind::Symbol;
+    switch (a) {
+        case '=': kind = TokenKind::Equal; if (b == '=') twoCharKind = TokenKind::EqualEqual; break;
+        case '!': kind = TokenKind::Bang; if (b == '=') twoCharKind = TokenKind::BangEqual; break;
+        case '<': kind = TokenKind::Less; if (b == '=') twoCharKind = TokenKind::LessEqual; break;
+        case '>': kind = TokenKind::Greater; if (b == '=') twoCharKind = TokenKind::GreaterEqual; break;
+        case '+':
+            kind = TokenKind::Plus;
+            if (b == '=') twoCharKind = TokenKind::PlusEqual;
+            else if (b == '+') twoCharKind = TokenKind::PlusPlus;
+            break;
+        case '-':
+            kind = TokenKind::Minus;
+            if (b == '=') twoCharKind = TokenKind::MinusEqual;
+            else if (b == '-') twoCharKind = TokenKind::MinusMinus;
+            break;
+        case '*': kind = TokenKind::Star; if (b == '=') twoCharKind = TokenKind::StarEqual; break;
+        case '/': kind = TokenKind::Slash; if (b == '=') twoCharKind = TokenKind::SlashEqual; break;
+        case '(': kind = TokenKind::LParen; break;
+        case ')': kind = TokenKind::RParen; break;
+        case '{': kind = TokenKind::LBrace; break;
+        case '}': kind = TokenKind::RBrace; break;
+        case '[': kind = TokenKind::LBracket; break;
+        case ']': kind = TokenKind::RBracket; break;
+        case ',': kind = TokenKind::Comma; break;
+        case ';': kind = TokenKind::Semicolon; break;
+        case ':': kind = TokenKind::Colon; break;
+        case '.': kind = TokenKind::Dot; break;
+        case '%': kind = TokenKind::Percent; break;
+        case '?': kind = TokenKind::Question; break;
+        default: break;
+    }
+    size_t start = pos;
+    if (twoCharKind != TokenKind::Symbol) {
         pos += 2;
-        return {TokenTypeEnum::Symbol, two, line};
+        return makeToken(TokenTypeEnum::Symbol, twoCharKind, start, pos, line);
     }
-    char c = advanceChar();
-    return {TokenTypeEnum::Symbol, std::string(1, c), line};
+    advanceChar();
+    return makeToken(TokenTypeEnum::Symbol, kind, start, start + 1, line);
 }
-Token Lexer::nextToken() {
+// A token that runs into the end of a streamed window may continue in the
+// next chunk (an identifier, a string, a comment before it, or "+" that is
+// really "+="), so it is lexed again from the same place once more input
+// is in. Only the token being lexed is redone; earlier ones are final.
+Token Lexer::lexToken() {
+    Token token;
+    if (!stream) {
+        token = scanToken();
+    } else {
+        while (true) {
+            size_t startPos = pos;
+            int startLine = line;
+            errorMessage = nullptr;
+            token = scanToken();
+            if (pos < source.size())
+                break;
+            pos = startPos;
+            line = startLine;
+            if (!refill()) {
+                errorMessage = nullptr;
+                token = scanToken();
+                break;
+            }
+        }
+    }
+    if (errorMessage)
+        reportError();
+    return token;
+}
+void Lexer::setError(DiagnosticCode code, size_t start, size_t end, const char *message) {
+    errorCode = code;
+    errorSpan.offset = static_cast<uint32_t>(base + start);
+    errorSpan.length = static_cast<uint32_t>(end - start);
+    errorSpan.line = line;
+    errorMessage = message;
+}
+void Lexer::reportError() {
+    Diagnostic diagnostic{errorCode, errorSpan, errorMessage};
+    errorMessage = nullptr;
+    if (!diagnostics)
+        throw std::runtime_error(formatDiagnostic(diagnostic));
+    diagnostics->report(diagnostic.code, diagnostic.span, std::move(diagnostic.message));
+}
+bool Lexer::refill() {
+    uint64_t position = base + pos;
+    bool more = stream->fill(keepFrom < position ? keepFrom : position);
+    source = stream->window();
+    base = stream->windowStart();
+    pos = static_cast<size_t>(position - base);
+    return more;
+}
+void Lexer::release(const Token &token) {
+    if (stream)
+        keepFrom = base + static_cast<uint32_t>(token.offset - static_cast<uint32_t>(base));
+}
+Token Lexer::scanToken() {
     skipWhitespaceAndComments();
     char c = peekChar();
-    if (c == '\0') return {TokenTypeEnum::EndOfFile, "", line};
-    if (isalpha(static_cast<unsigned char>(c)) || c == '_')
+    if (c == '\0') return makeToken(TokenTypeEnum::EndOfFile, TokenKind::EndOfFile, pos, pos, line);
+    if (hasCharClass(c, CharIdentStart))
         return readIdentifierOrKeyword();
-    if (isdigit(static_cast<unsigned char>(c)))
+    if (hasCharClass(c, CharDigit))
         return readNumber();
     if (c == '"')
         return readString();
     if (c == '`')
         return readTemplateLiteral();
     if (c == '\'')
-        throw std::runtime_error("Single-quote strings not allowed in BASE at line " + std::to_string(line));
+        return readSingleQuotedString();
     return readSymbol();
 }
-Token Lexer::peekToken() const {
-    Lexer temp = *this;
-    return temp.nextToken();
-}
\ No newline at end of file
+Token Lexer::nextToken() {
+    if (lookaheadCount == 0)
+        return lexToken();
+    Token token = lookahead[lookaheadHead];
+    lookaheadHead = (lookaheadHead + 1) % MaxLookahead;
+    lookaheadCount--;
+    return token;
+}
+size_t Lexer::nextTokens(Token *out, size_t max) {
+    BASE_TRACE_SCOPE("Lexer::nextToken batch", "lexer");
+    size_t count = 0;
+    while (count < max) {
+        out[count] = nextToken();
+        if (out[count++].type == TokenTypeEnum::EndOfFile)
+            break;
+    }
+    return count;
+}
+const Token &Lexer::peek(size_t n) {
+    if (n >= MaxLookahead)
+        throw std::runtime_error("Lexer lookahead of " + std::to_string(n + 1) + " tokens exceeds the limit of " + std::to_string(MaxLookahead));
+    while (lookaheadCount <= n) {
+        lookahead[(lookaheadHead + lookaheadCount) % MaxLookahead] = lexToken();
+        lookaheadCount++;
+    }
+    return lookahead[(lookaheadHead + n) % MaxLookahead];
+}
+std::string_view Lexer::text(const Token &token) const {
+    return std::string_view(source.data() + static_cast<uint32_t>(token.offset - static_cast<uint32_t>(base)), token.length);
+}
+std::string Lexer::value(const Token &token) const {
+    std::string_view raw = text(token);
+    if (!(token.flags & TokenHasEscapes))
+        return std::string(raw);
+    return decodeEscapes(raw);
+}
+std::string Lexer::decodeEscapes(std::string_view raw) {
+    std::string value;
+    value.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        if (raw[i] != '\\') {
+            value += raw[i];
+            continue;
+        }
+        // A trailing backslash at end of input escapes the terminating '\0'.
+        char esc = ++i < raw.size() ? raw[i] : '\0';
+        switch (esc) {
+            case 'n': value += '\n'; break;
+            case 't': value += '\t'; break;
+            case 'r': value += '\r'; break;
+            default: value += esc;
+        }
+    }
+    return value;
+}
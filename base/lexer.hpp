@@ -1,44 +1,87 @@
 #pragma once
 #include <string>
-#include <unordered_set>
-
-enum class TokenTypeEnum {
-    Identifier,
-    Keyword,
-    Number,
-    String,
-    TemplateLiteral,
-    Symbol,
-    EndOfFile
-};
+#include <string_view>
+#include "char_scan.hpp"
+#include "diagnostics.hpp"
+#include "token.hpp"
 
-struct Token {
-    TokenTypeEnum type;
-    std::string value;
-    int line;
-};
+class SourceStream;
 
 class Lexer {
 public:
-    Lexer(const std::string &src);
+    // The lexer borrows src; the underlying buffer must outlive it. firstLine
+    // is the line number of the start of src and firstOffset the offset its
+    // tokens report for it, when src is a slice of a larger text.
+    Lexer(std::string_view src, int firstLine = 1, uint32_t firstOffset = 0);
+    // Lexes input that arrives in chunks. Token offsets count from the start
+    // of the whole input (modulo 2^32), and text() only works for tokens at
+    // or after the last release() point. Such a lexer must not be copied.
+    explicit Lexer(SourceStream &stream);
+    static constexpr size_t MaxLookahead = 4;
+
     Token nextToken();
-    Token peekToken() const;
+    // Returns the n-th upcoming token without consuming it (0 = the token the
+    // next call to nextToken() will return). n must be below MaxLookahead.
+    const Token &peek(size_t n = 0);
+    // Lexes up to max tokens into out and returns how many; stops after the
+    // EndOfFile token. One trace span covers the whole batch.
+    size_t nextTokens(Token *out, size_t max);
+
+    // Raw source text of a token (string contents are still escaped).
+    std::string_view text(const Token &token) const;
+    // Token text with escape sequences decoded.
+    std::string value(const Token &token) const;
+    static std::string decodeEscapes(std::string_view raw);
+    // Value of a Number token, correctly rounded and independent of the C
+    // locale. Values beyond the double range become infinity or 0. Only
+    // literals of 256 characters or more allocate.
+    double numberValue(const Token &token) const;
+
+    // Without a sink, a malformed token throws std::runtime_error. With one,
+    // it is reported there and lexed as the nearest well-formed token (a
+    // single-quoted string as a string, a string broken by a newline up to
+    // the newline), so lexing never stops early.
+    void setDiagnostics(Diagnostics *sink) { diagnostics = sink; }
+
+    // Tells a streaming lexer that the input before token is no longer
+    // needed, so the next refill may drop it. No-op for in-memory sources.
+    void release(const Token &token);
 
 private:
-    std::string source;
+    std::string_view source;
     size_t pos = 0;
     int line = 1;
+    const CharScanner *scanner;
+    SourceStream *stream = nullptr;
+    uint64_t base = 0;     // input offset of source[0]
+    uint64_t keepFrom = 0; // streaming: first input offset still needed
+    Diagnostics *diagnostics = nullptr;
+    // Error found by scanToken(), reported once the token is final (a
+    // streamed token may be scanned twice).
+    const char *errorMessage = nullptr;
+    DiagnosticCode errorCode = DiagnosticCode::UnexpectedToken;
+    SourceSpan errorSpan;
 
-    static const std::unordered_set<std::string> keywords;
+    // Ring buffer of tokens that were lexed ahead by peek().
+    Token lookahead[MaxLookahead];
+    size_t lookaheadHead = 0;
+    size_t lookaheadCount = 0;
 
     char peekChar() const;
     char peekNextChar() const;
     char advanceChar();
     void skipWhitespaceAndComments();
+    Token lexToken();
+    Token scanToken();
+    bool refill();
+    void setError(DiagnosticCode code, size_t start, size_t end, const char *message);
+    void reportError();
+    Token makeToken(TokenTypeEnum type, TokenKind kind, size_t start, size_t end, int tokenLine, uint8_t flags = 0) const;
 
     Token readIdentifierOrKeyword();
     Token readNumber();
     Token readString();
     Token readTemplateLiteral();
+    Token readSingleQuotedString();
     Token readSymbol();
-};
\ No newline at end of file
+};
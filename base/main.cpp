@@ -5,10 +5,18 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <fstream>
+#include <charconv>
 #include <filesystem>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
 #ifdef _WIN32
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #endif
 
 std::string getArchitecture()
@@ -46,6 +54,17 @@ std::string getPlatform()
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "ast_printer.hpp"
+#include "ast_output.hpp"
+#include "c_generator.hpp"
+#include "checker.hpp"
+#include "source_buffer.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "optimizer.hpp"
+#include "vm.hpp"
+#include "ast_cache.hpp"
+#include "batch.hpp"
+#include "profile.hpp"
 
 constexpr auto VERSION = "0.0.1-alpha";
 constexpr auto VERSION_CODE = "xxxxxx";
@@ -60,6 +79,19 @@ std::string formatBuildDateTime()
     return month + " " + day + " " + year + ", " + __TIME__;
 }
 
+#if BASE_PROFILE && BASE_COUNT_HEAP
+// Counts heap bytes for --stats; the arena counts its own chunks.
+void *operator new(size_t size)
+{
+    profile::countAllocation(size);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
 std::string toLower(const std::string& s) {
     std::string result = s;
     std::transform(result.begin(), result.end(), result.begin(),
@@ -67,6 +99,417 @@ std::string toLower(const std::string& s) {
     return result;
 }
 
+struct ProfileOptions
+{
+    bool stats = false;
+    std::string tracePath;
+};
+
+// Takes --stats and --trace=<file>; returns false for any other argument.
+bool parseProfileOption(const std::string &arg, ProfileOptions &options)
+{
+    if (arg == "--stats")
+        options.stats = true;
+    else if (arg.rfind("--trace=", 0) == 0 && arg.size() > 8)
+        options.tracePath = arg.substr(8);
+    else
+        return false;
+    return true;
+}
+
+bool startProfiling(const ProfileOptions &options)
+{
+    if (!profile::Available && (options.stats || !options.tracePath.empty()))
+    {
+        std::cerr << "--stats and --trace need a build with BASE_PROFILE=1" << std::endl;
+        return false;
+    }
+    if (!options.tracePath.empty())
+        profile::startTrace();
+    return true;
+}
+
+// Prints the --stats table to stderr and writes the --trace file. Returns
+// false if the trace cannot be written.
+bool finishProfiling(const ProfileOptions &options, const profile::Stats &stats)
+{
+    if (options.stats)
+        stats.report(std::cerr);
+    if (options.tracePath.empty())
+        return true;
+    size_t dropped = 0;
+    if (!profile::writeTrace(options.tracePath, dropped))
+    {
+        std::cerr << "Cannot write trace: " << options.tracePath << std::endl;
+        return false;
+    }
+    if (dropped)
+        std::cerr << "Trace truncated: " << dropped << " spans dropped" << std::endl;
+    return true;
+}
+
+struct RunOptions
+{
+    bool disassemble = false;
+    bool jit = true;
+    bool passStats = false;
+    bool useCache = true;
+    PassManager passes;
+};
+
+struct BuildOptions
+{
+    std::string output; // empty: the source path without its extension
+    std::string compiler = defaultCCompiler();
+    bool emitC = false;
+};
+
+// Reads filename, parses it (or loads it from the cache), checks it and runs
+// the optimization passes, for the back ends of `base run` and `base build`.
+// Prints the errors and returns null if there are any. Throws on failures
+// that are not errors in the program.
+std::unique_ptr<Program> loadProgram(const std::string &filename, RunOptions &options, profile::Stats &stats)
+{
+    SourceBuffer source;
+    {
+        profile::ScopedPhase phase(stats, "read");
+        if (!source.open(filename))
+        {
+            std::cerr << "File not found: " << filename << std::endl;
+            return nullptr;
+        }
+    }
+    // Cache the tree as checked; the passes below rewrite it. Only trees
+    // without errors are cached.
+    AstCache cache(AstCache::defaultDirectory(), VERSION);
+    std::unique_ptr<Program> program;
+    const char *treePhase = "cache load";
+    bool checked = false;
+    if (options.useCache)
+    {
+        profile::ScopedPhase phase(stats, "cache load");
+        program = cache.load(source.view());
+    }
+    if (!program)
+    {
+        Diagnostics diagnostics;
+        Lexer lexer(source.view());
+        Parser parser(lexer, diagnostics);
+        treePhase = "parse";
+        {
+            profile::ScopedPhase phase(stats, "parse");
+            program = parser.parse();
+        }
+        if (!diagnostics.hasErrors())
+        {
+            profile::ScopedPhase phase(stats, "check");
+            checked = Checker::check(*program, diagnostics);
+        }
+        if (diagnostics.hasErrors())
+        {
+            for (const Diagnostic &diagnostic : diagnostics.all())
+                std::cerr << formatDiagnostic(diagnostic) << "\n";
+            return nullptr;
+        }
+        if (stats.isEnabled())
+            stats.phase("parse").tokens = parser.tokenCount();
+        if (options.useCache)
+        {
+            profile::ScopedPhase phase(stats, "cache store");
+            cache.store(source.view(), *program);
+        }
+    }
+    if (stats.isEnabled())
+        stats.phase(treePhase).nodes = profile::countNodes(program.get());
+    size_t rewrites;
+    {
+        profile::ScopedPhase phase(stats, "optimize");
+        rewrites = options.passes.run(*program);
+    }
+    // Rewritten nodes carry no bindings yet, and a loaded tree is checked
+    // here rather than trusting the bindings in its image. Only trees that
+    // checked are cached, and they still check after the passes, which keep
+    // behaviour.
+    if (rewrites > 0 || !checked)
+    {
+        profile::ScopedPhase phase(stats, "check");
+        Diagnostics diagnostics;
+        if (!Checker::check(*program, diagnostics))
+            throw std::runtime_error(formatDiagnostic(diagnostics.first()));
+    }
+    if (options.passStats)
+        options.passes.report(std::cerr);
+    return program;
+}
+
+// base run <file>: optimizes the program, compiles it to bytecode and
+// executes it.
+int runProgram(const std::string &filename, RunOptions &options, profile::Stats &stats)
+{
+    try
+    {
+        std::unique_ptr<Program> program = loadProgram(filename, options, stats);
+        if (!program)
+            return 1;
+        Module module;
+        {
+            profile::ScopedPhase phase(stats, "compile");
+            module = Compiler::compile(program.get());
+        }
+        if (options.disassemble)
+        {
+            module.disassemble(std::cout);
+            return 0;
+        }
+        NativeCode native;
+        if (options.jit)
+        {
+            profile::ScopedPhase phase(stats, "jit");
+            native = NativeCode::compile(program.get(), module);
+        }
+        std::cout.flush();
+        VM vm(module, stdout, &native);
+        profile::ScopedPhase phase(stats, "run");
+        vm.run();
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// base build <file>: optimizes the program, translates it to C and compiles
+// that with the system C compiler into a standalone executable.
+int buildProgram(const std::string &filename, RunOptions &options, const BuildOptions &build, profile::Stats &stats)
+{
+    try
+    {
+        std::unique_ptr<Program> program = loadProgram(filename, options, stats);
+        if (!program)
+            return 1;
+        std::string source;
+        {
+            profile::ScopedPhase phase(stats, "generate C");
+            source = CGenerator::generate(program.get());
+        }
+        if (build.emitC)
+        {
+            if (build.output.empty())
+                std::cout << source;
+            else if (!(std::ofstream(build.output, std::ios::binary) << source))
+                throw std::runtime_error("Cannot write " + build.output);
+            return 0;
+        }
+        std::filesystem::path output = build.output;
+        if (output.empty())
+        {
+            output = std::filesystem::path(filename).replace_extension();
+#ifdef _WIN32
+            output += ".exe";
+#endif
+        }
+        profile::ScopedPhase phase(stats, "cc");
+        buildExecutable(source, output, build.compiler);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+struct CheckOptions
+{
+    size_t jobs = 0; // 0 = one per core
+    bool timing = false;
+    bool useCache = true;
+    std::string tracePath;
+    std::vector<std::string> paths;
+};
+
+constexpr auto CHECK_USAGE =
+    "Usage: base check [--jobs N] [--time] [--no-cache] [--trace=<file>] <files, directories or globs...>";
+
+// Parses the N of --jobs N: a thread count of at least 1, digits only.
+bool parseJobs(const char *text, size_t &jobs)
+{
+    const char *end = text + std::strlen(text);
+    size_t value = 0;
+    auto [rest, error] = std::from_chars(text, end, value);
+    if (error != std::errc() || rest != end || value == 0)
+        return false;
+    jobs = value;
+    return true;
+}
+
+// base check <paths...>: parses every source file under the given files,
+// directories and globs in parallel and prints the errors sorted by path.
+int runCheck(const CheckOptions &options)
+{
+    std::vector<std::string> unmatched;
+    std::vector<std::string> files = collectSourceFiles(options.paths, unmatched);
+    for (const std::string &arg : unmatched)
+        std::cerr << "No source files match: " << arg << std::endl;
+
+    ProfileOptions profileOptions;
+    profileOptions.tracePath = options.tracePath;
+    if (!startProfiling(profileOptions))
+        return 1;
+    profile::Stats stats(false);
+    auto start = std::chrono::steady_clock::now();
+    WorkStealingPool pool(options.jobs);
+    AstCache cache(AstCache::defaultDirectory(), VERSION);
+    std::vector<CheckResult> results;
+    {
+        profile::ScopedPhase phase(stats, "check");
+        results = checkFiles(files, pool, options.useCache ? &cache : nullptr);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    for (const CheckResult &result : results)
+    {
+        bytes += result.bytes;
+        if (!result.failed())
+            continue;
+        failed++;
+        if (!result.error.empty())
+            std::cout << result.path << ": " << result.error << "\n";
+        for (const Diagnostic &diagnostic : result.diagnostics)
+            std::cout << result.path << ": " << formatDiagnostic(diagnostic) << "\n";
+    }
+    std::cout << "Checked " << results.size() << " files, " << failed << " with errors" << std::endl;
+    if (options.timing)
+        std::cerr << std::fixed << std::setprecision(1) << bytes / 1e6 << " MB in " << elapsed * 1e3 << " ms on "
+                  << pool.threadCount() << " threads" << std::endl;
+    bool traced = finishProfiling(profileOptions, stats);
+    return failed == 0 && unmatched.empty() && traced ? 0 : 1;
+}
+
+struct DumpOptions
+{
+    bool dumpTokens = false;
+    AstFormat format = AstFormat::Text;
+};
+
+// base <file>: prints the AST of a file and, with --dump-tokens, its tokens
+// first. The file is lexed once either way: the dump lexes it onto a token
+// tape that the parser then reads. With --ast=json or --ast=binary the
+// tree is all that goes to stdout, and syntax errors fail the command.
+int dumpProgram(const std::string &filename, const DumpOptions &options, profile::Stats &stats)
+{
+    SourceBuffer source;
+    {
+        profile::ScopedPhase phase(stats, "read");
+        if (!source.open(filename))
+        {
+            std::cerr << "File not found: " << filename << std::endl;
+            return 1;
+        }
+    }
+    Lexer lexer(source.view());
+    Diagnostics diagnostics;
+    std::unique_ptr<TokenTape> tape;
+    if (options.dumpTokens)
+    {
+        {
+            profile::ScopedPhase phase(stats, "lex");
+            tape = std::make_unique<TokenTape>(lexer);
+        }
+        if (stats.isEnabled())
+            stats.phase("lex").tokens = tape->size();
+        profile::ScopedPhase phase(stats, "dump tokens");
+        uint64_t written = tape->dump(std::cout);
+        if (stats.isEnabled())
+            stats.phase("dump tokens").bytesWritten += written;
+    }
+    Parser parser = tape ? Parser(*tape, diagnostics) : Parser(lexer, diagnostics);
+    std::unique_ptr<Program> program;
+    {
+        profile::ScopedPhase phase(stats, "parse");
+        program = parser.parse();
+    }
+    if (stats.isEnabled())
+    {
+        profile::Phase &phase = stats.phase("parse");
+        phase.tokens = parser.tokenCount();
+        phase.nodes = profile::countNodes(program.get());
+    }
+    if (diagnostics.hasErrors())
+    {
+        std::cout.flush();
+        for (const Diagnostic &diagnostic : diagnostics.all())
+            std::cerr << "Parse error: " << formatDiagnostic(diagnostic) << "\n";
+        return options.format == AstFormat::Text ? 0 : 1;
+    }
+    bool text = options.format == AstFormat::Text;
+    if (text)
+    {
+        std::cout << "Parsing successful" << std::endl;
+        std::cout << "AST:\n";
+    }
+#ifdef _WIN32
+    else if (options.format == AstFormat::Binary)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    {
+        profile::ScopedPhase phase(stats, "print");
+        OutputBuffer out(std::cout);
+        writeAst(out, options.format, program.get(), program->symbols);
+        out.flush();
+        if (stats.isEnabled())
+            stats.phase("print").bytesWritten += out.bytesWritten();
+    }
+    if (text)
+        std::cout << "\n";
+    return 0;
+}
+
+// base - : parses standard input one top-level statement at a time and
+// prints the AST of each as soon as it is complete, so piped input of any
+// size runs in memory bounded by its largest statement.
+int streamProgram(profile::Stats &stats)
+{
+    SourceStream input(std::cin);
+    Lexer lexer(input);
+    Diagnostics diagnostics;
+    std::cout << "AST:\n";
+    std::cout << "Program\n";
+    {
+        profile::ScopedPhase parsePhase(stats, "parse");
+        Parser parser(lexer, diagnostics);
+        size_t nodes = 0;
+        parser.parseEach([&](Program &program)
+        {
+            profile::ScopedPhase printPhase(stats, "print");
+            for (const ASTNode *stmt : program.body)
+                ASTPrinter::print(stmt, program.symbols, 1);
+            if (stats.isEnabled())
+                nodes += profile::countNodes(&program) - 1;
+        });
+        if (stats.isEnabled())
+        {
+            profile::Phase &phase = stats.phase("parse");
+            phase.tokens = parser.tokenCount();
+            phase.nodes = nodes + 1;
+        }
+    }
+    if (diagnostics.hasErrors())
+    {
+        std::cout.flush();
+        for (const Diagnostic &diagnostic : diagnostics.all())
+            std::cerr << "Parse error: " << formatDiagnostic(diagnostic) << "\n";
+        return 1;
+    }
+    std::cout << "\n";
+    std::cout << "Parsing successful" << std::endl;
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2)
@@ -74,7 +517,7 @@ int main(int argc, char *argv[])
         std::cout << "Base" << " " << VERSION << " " << "(tags/" << VERSION << ":"
                   << VERSION_CODE << "," << " " << formatBuildDateTime() << ")" << " "
                   << "[MSC v.1943" << " " << getArchitecture() << "]" << " " << "on" << " " << getPlatform() << std::endl;
-        std::cerr << "Usage: base <filename> [--v | --version]" << std::endl;
+        std::cerr << "Usage: base [run | build] [options] <filename> | base check <paths...> [--v | --version]" << std::endl;
         return 1;
     }
     for (int i = 1; i < argc; i++)
@@ -86,45 +529,141 @@ int main(int argc, char *argv[])
             return 0;
         }
     }
-    std::string filename = argv[1];
-    std::string ext = std::filesystem::path(filename).extension().string();
-    std::string extLower = toLower(ext);
-    if (extLower != ".bxml" && extLower != ".base")
+    if (std::string(argv[1]) == "check")
     {
-        std::cerr << "Unsupported file extension: " << ext << std::endl;
-        return 1;
+        CheckOptions checkOptions;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--time")
+                checkOptions.timing = true;
+            else if (arg == "--no-cache")
+                checkOptions.useCache = false;
+            else if (arg == "--jobs")
+            {
+                if (i + 1 == argc || !parseJobs(argv[++i], checkOptions.jobs))
+                {
+                    std::cerr << "--jobs needs a thread count of at least 1" << std::endl;
+                    std::cerr << CHECK_USAGE << std::endl;
+                    return 1;
+                }
+            }
+            else if (arg.rfind("--trace=", 0) == 0 && arg.size() > 8)
+                checkOptions.tracePath = arg.substr(8);
+            else if (arg[0] == '-')
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+            else
+                checkOptions.paths.push_back(arg);
+        }
+        if (checkOptions.paths.empty())
+        {
+            std::cerr << CHECK_USAGE << std::endl;
+            return 1;
+        }
+        return runCheck(checkOptions);
     }
-    std::ifstream file(filename);
-    if (!file.is_open())
+    bool run = std::string(argv[1]) == "run";
+    bool build = std::string(argv[1]) == "build";
+    // Both back ends take the front-end options.
+    bool backEnd = run || build;
+    RunOptions runOptions;
+    BuildOptions buildOptions;
+    ProfileOptions profileOptions;
+    DumpOptions dumpOptions;
+    auto usage = [&]()
     {
-        std::cerr << "File not found: " << filename << std::endl;
+        if (run)
+            std::cerr << "Usage: base run [--disasm] [--no-jit] [--pass-stats] [--no-cache] [-O0] [--no-<pass>] [--stats] [--trace=<file>] <filename>"
+                      << std::endl;
+        else if (build)
+            std::cerr << "Usage: base build [-o <output>] [--emit-c] [--cc=<compiler>] [--pass-stats] [--no-cache] [-O0] "
+                         "[--no-<pass>] [--stats] [--trace=<file>] <filename>"
+                      << std::endl;
+        else
+            std::cerr << "Usage: base [--dump-tokens] [--ast=text|json|binary] [--stats] [--trace=<file>] <filename | ->" << std::endl;
         return 1;
-    }
-    std::string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    Lexer lexer(code);
+    };
+    // Options may come before or after the one file name.
+    std::string filename;
+    for (int arg = backEnd ? 2 : 1; arg < argc; arg++)
     {
-        Lexer tempLexer = lexer; // Pozisyonu bozmamak için kopya al
-        Token token;
-        do
+        std::string option = argv[arg];
+        if (option.size() < 2 || option[0] != '-')
+        {
+            if (!filename.empty())
+            {
+                std::cerr << "Unexpected argument: " << option << std::endl;
+                return usage();
+            }
+            filename = option;
+            continue;
+        }
+        if (parseProfileOption(option, profileOptions))
+            continue;
+        if (!backEnd && option == "--dump-tokens")
+            dumpOptions.dumpTokens = true;
+        else if (!backEnd && option.rfind("--ast=", 0) == 0 && parseAstFormat(option.substr(6), dumpOptions.format))
+            continue;
+        else if (run && option == "--disasm")
+            runOptions.disassemble = true;
+        else if (run && option == "--no-jit")
+            runOptions.jit = false;
+        else if (build && option == "-o" && arg + 1 < argc)
+            buildOptions.output = argv[++arg];
+        else if (build && option == "--emit-c")
+            buildOptions.emitC = true;
+        else if (build && option.rfind("--cc=", 0) == 0 && option.size() > 5)
+            buildOptions.compiler = option.substr(5);
+        else if (backEnd && option == "--pass-stats")
+            runOptions.passStats = true;
+        else if (backEnd && option == "--no-cache")
+            runOptions.useCache = false;
+        else if (backEnd && option == "-O0")
+            runOptions.passes.setAllEnabled(false);
+        else if (backEnd && option.rfind("--no-", 0) == 0 && runOptions.passes.setEnabled(option.substr(5), false))
+            continue;
+        else
         {
-            token = tempLexer.nextToken();
-            std::cout << "Token: type=" << static_cast<int>(token.type)
-                      << ", value='" << token.value
-                      << "', line=" << token.line << "\n";
-        } while (token.type != TokenTypeEnum::EndOfFile);
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
     }
-    Parser parser(lexer);
-    try
+    if (filename.empty())
+        return usage();
+    if (dumpOptions.dumpTokens && dumpOptions.format != AstFormat::Text)
     {
-        std::unique_ptr<Program> program = parser.parse();
-        std::cout << "Parsing successful" << std::endl;
-        std::cout << "AST:\n";
-        ASTPrinter::print(program.get());
-        std::cout << "\n";
+        std::cerr << "--dump-tokens only goes with the text AST" << std::endl;
+        return 1;
     }
-    catch (const std::exception &ex)
+    if (filename == "-" && !backEnd)
     {
-        std::cerr << "Parse error: " << ex.what() << std::endl;
+        if (dumpOptions.dumpTokens || dumpOptions.format != AstFormat::Text)
+        {
+            std::cerr << "--dump-tokens and --ast need a file; standard input is printed as text as it streams"
+                      << std::endl;
+            return 1;
+        }
+        if (!startProfiling(profileOptions))
+            return 1;
+        profile::Stats stats(profileOptions.stats);
+        int status = streamProgram(stats);
+        return finishProfiling(profileOptions, stats) ? status : 1;
     }
-    return 0;
+    std::string ext = std::filesystem::path(filename).extension().string();
+    std::string extLower = toLower(ext);
+    if (extLower != ".bxml" && extLower != ".base")
+    {
+        std::cerr << "Unsupported file extension: " << ext << std::endl;
+        return 1;
+    }
+    if (!startProfiling(profileOptions))
+        return 1;
+    profile::Stats stats(profileOptions.stats);
+    int status = run     ? runProgram(filename, runOptions, stats)
+                 : build ? buildProgram(filename, runOptions, buildOptions, stats)
+                         : dumpProgram(filename, dumpOptions, stats);
+    return finishProfiling(profileOptions, stats) ? status : 1;
 }
@@ -0,0 +1,719 @@
+#include "optimizer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include "ast_visitor.hpp"
+#include "profile.hpp"
+#include "value.hpp"
+
+namespace {
+
+// True if running node may call a user function. Rewritten calls carry no
+// binding and count as calls.
+bool mayCall(const ASTNode *node)
+{
+    if (!node)
+        return false;
+    if (const auto *call = nodeCast<CallExpression>(node))
+    {
+        const auto *callee = nodeCast<IdentifierExpression>(call->callee);
+        if (!callee || callee->binding.kind != BindingKind::Print)
+            return true;
+        for (const ASTNode *arg : call->arguments)
+            if (mayCall(arg))
+                return true;
+        return false;
+    }
+    if (const auto *decl = nodeCast<VariableDeclaration>(node))
+    {
+        for (const VariableDeclarator &declarator : decl->declarations)
+            if (mayCall(declarator.init))
+                return true;
+        return false;
+    }
+    if (const auto *block = nodeCast<BlockStatement>(node))
+    {
+        for (const ASTNode *stmt : block->body)
+            if (mayCall(stmt))
+                return true;
+        return false;
+    }
+    if (const auto *binary = nodeCast<BinaryExpression>(node))
+        return mayCall(binary->left) || mayCall(binary->right);
+    if (const auto *assignment = nodeCast<AssignmentExpression>(node))
+        return mayCall(assignment->value);
+    if (const auto *templ = nodeCast<TemplateLiteral>(node))
+    {
+        for (const ASTNode *expr : templ->expressions)
+            if (mayCall(expr))
+                return true;
+        return false;
+    }
+    if (const auto *ret = nodeCast<ReturnStatement>(node))
+        return mayCall(ret->argument);
+    if (const auto *stmt = nodeCast<ExpressionStatement>(node))
+        return mayCall(stmt->expression);
+    return false; // literals, names and function declarations run nothing
+}
+
+// Walks the tree, replacing every child by what visiting it returns, and
+// tracks which declaration each name refers to using the compiler's rules:
+// functions see globals and their own locals, function declarations are
+// hoisted to the start of their block. Passes override the handlers they
+// care about and call the Rewriter version to process the children.
+template <typename Derived>
+class Rewriter : public MutableASTVisitor<Derived, ASTNode *>
+{
+public:
+    explicit Rewriter(Program &program)
+        : arena(program.arena), symbols(program.symbols), globalDeclarations(program.symbols.size() + 1, 0)
+    {
+        for (const ASTNode *stmt : program.body)
+            if (const auto *decl = nodeCast<VariableDeclaration>(stmt))
+                for (const VariableDeclarator &declarator : decl->declarations)
+                    globalDeclarations[declarator.name]++;
+    }
+
+    size_t rewrites = 0;
+
+    ASTNode *rewrite(ASTNode *node) { return node ? this->visit(node) : nullptr; }
+
+    ASTNode *visitProgram(Program *node)
+    {
+        hoistFunctions(node->body);
+        firstCall = node->body.count;
+        for (uint32_t i = 0; i < node->body.count && firstCall == node->body.count; i++)
+            if (mayCall(node->body[i]))
+                firstCall = i;
+        for (statement = 0; statement < node->body.count; statement++)
+            node->body[statement] = rewrite(node->body[statement]);
+        return node;
+    }
+
+    ASTNode *visitLiteralExpression(LiteralExpression *node) { return node; }
+    ASTNode *visitIdentifierExpression(IdentifierExpression *node) { return node; }
+
+    ASTNode *visitVariableDeclaration(VariableDeclaration *node)
+    {
+        for (VariableDeclarator &declarator : node->declarations)
+        {
+            declarator.init = rewrite(declarator.init);
+            const LiteralExpression *constant = nullptr;
+            if (node->kind == DeclarationKind::Const)
+                constant = nodeCast<LiteralExpression>(declarator.init);
+            if (inFunction || depth > 0)
+                locals.push_back({declarator.name, constant, true});
+            else if (globalDeclarations[declarator.name] == 1)
+                globals.push_back({declarator.name, constant, statement < firstCall});
+            else
+                // Redeclared globals share one slot; functions may see either value.
+                globals.push_back({declarator.name, nullptr, false});
+        }
+        return node;
+    }
+
+    ASTNode *visitFunctionDeclaration(FunctionDeclaration *node)
+    {
+        size_t savedFrame = frameStart;
+        int savedDepth = depth;
+        bool savedInFunction = inFunction;
+        frameStart = locals.size();
+        depth = 0;
+        inFunction = true;
+        for (const Parameter &param : node->params)
+            locals.push_back({param.name, nullptr, true});
+        node->body = static_cast<BlockStatement *>(rewrite(node->body));
+        locals.resize(frameStart);
+        frameStart = savedFrame;
+        depth = savedDepth;
+        inFunction = savedInFunction;
+        return node;
+    }
+
+    ASTNode *visitBlockStatement(BlockStatement *node)
+    {
+        size_t localMark = locals.size();
+        size_t functionMark = functions.size();
+        depth++;
+        hoistFunctions(node->body);
+        for (ASTNode *&stmt : node->body)
+            stmt = rewrite(stmt);
+        depth--;
+        locals.resize(localMark);
+        functions.resize(functionMark);
+        return node;
+    }
+
+    ASTNode *visitReturnStatement(ReturnStatement *node)
+    {
+        node->argument = rewrite(node->argument);
+        return node;
+    }
+
+    ASTNode *visitExpressionStatement(ExpressionStatement *node)
+    {
+        node->expression = rewrite(node->expression);
+        return node;
+    }
+
+    ASTNode *visitBinaryExpression(BinaryExpression *node)
+    {
+        node->left = rewrite(node->left);
+        node->right = rewrite(node->right);
+        return node;
+    }
+
+    ASTNode *visitAssignmentExpression(AssignmentExpression *node)
+    {
+        node->value = rewrite(node->value);
+        return node;
+    }
+
+    ASTNode *visitCallExpression(CallExpression *node)
+    {
+        for (ASTNode *&arg : node->arguments)
+            arg = rewrite(arg);
+        return node;
+    }
+
+    ASTNode *visitTemplateLiteral(TemplateLiteral *node)
+    {
+        for (ASTNode *&expr : node->expressions)
+            expr = rewrite(expr);
+        return node;
+    }
+
+protected:
+    struct Variable
+    {
+        Symbol name;
+        const LiteralExpression *constant; // null unless a const with a literal value
+        // Declared before any function can have been called, so functions
+        // never see it uninitialized.
+        bool settled;
+    };
+
+    struct FunctionBinding
+    {
+        Symbol name;
+        FunctionDeclaration *declaration;
+    };
+
+    Arena &arena;
+    Interner &symbols;
+
+    // Variables declared so far, in source order.
+    const Variable *findVariable(Symbol name) const
+    {
+        for (size_t i = locals.size(); i-- > frameStart;)
+            if (locals[i].name == name)
+                return &locals[i];
+        for (size_t i = globals.size(); i-- > 0;)
+            if (globals[i].name == name)
+                return &globals[i];
+        return nullptr;
+    }
+
+    // The literal value of the constant name refers to here, or null. A
+    // function may run before a global's declaration and must then fail to
+    // read it, so functions only see the values of settled globals.
+    const LiteralExpression *constantValue(Symbol name) const
+    {
+        const Variable *variable = findVariable(name);
+        if (!variable || (inFunction && !variable->settled))
+            return nullptr;
+        return variable->constant;
+    }
+
+    // True if the compiler will resolve name to a variable: a local of the
+    // current function or any top-level variable, declared before or after.
+    bool isVariable(Symbol name) const
+    {
+        for (size_t i = locals.size(); i-- > frameStart;)
+            if (locals[i].name == name)
+                return true;
+        return globalDeclarations[name] > 0;
+    }
+
+    FunctionDeclaration *findFunction(Symbol name) const
+    {
+        for (size_t i = functions.size(); i-- > 0;)
+            if (functions[i].name == name)
+                return functions[i].declaration;
+        return nullptr;
+    }
+
+    LiteralExpression *copyLiteral(const LiteralExpression *literal, int line)
+    {
+        if (literal->isString)
+            return arena.make<LiteralExpression>(literal->strValue, line);
+        return arena.make<LiteralExpression>(literal->numValue, line);
+    }
+
+private:
+    std::vector<Variable> locals;
+    std::vector<Variable> globals;
+    std::vector<FunctionBinding> functions;
+    std::vector<uint32_t> globalDeclarations; // by Symbol
+    size_t frameStart = 0;
+    int depth = 0;
+    bool inFunction = false;
+    uint32_t statement = 0; // top-level statement being rewritten
+    uint32_t firstCall = 0; // first top-level statement that may call a function
+
+    void hoistFunctions(const ArenaList<ASTNode *> &body)
+    {
+        for (ASTNode *stmt : body)
+            if (auto *decl = nodeCast<FunctionDeclaration>(stmt))
+                functions.push_back({decl->name, decl});
+    }
+};
+
+class ConstantFolder : public Rewriter<ConstantFolder>
+{
+public:
+    using Rewriter::Rewriter;
+
+    ASTNode *visitBinaryExpression(BinaryExpression *node)
+    {
+        Rewriter::visitBinaryExpression(node);
+        const auto *left = nodeCast<LiteralExpression>(node->left);
+        const auto *right = nodeCast<LiteralExpression>(node->right);
+        if (!left || !right)
+            return node;
+        if (!left->isString && !right->isString)
+        {
+            double x = left->numValue, y = right->numValue, result;
+            switch (node->op)
+            {
+            case TokenKind::Plus:
+                result = x + y;
+                break;
+            case TokenKind::Minus:
+                result = x - y;
+                break;
+            case TokenKind::Star:
+                result = x * y;
+                break;
+            case TokenKind::Slash:
+                result = x / y;
+                break;
+            default:
+                if (!compare(node->op, x < y ? -1 : x > y ? 1 : 0, x == y, result))
+                    return node;
+                break;
+            }
+            rewrites++;
+            return arena.make<LiteralExpression>(result, node->line);
+        }
+        if (left->isString && right->isString && node->op != TokenKind::Plus)
+        {
+            int order = symbols.name(left->strValue).compare(symbols.name(right->strValue));
+            double result;
+            if (!compare(node->op, order, order == 0, result))
+                return node;
+            rewrites++;
+            return arena.make<LiteralExpression>(result, node->line);
+        }
+        // A string and a number are never equal; other operators on them
+        // are runtime errors, which are left to the VM.
+        if (node->op == TokenKind::EqualEqual || node->op == TokenKind::BangEqual)
+        {
+            rewrites++;
+            return arena.make<LiteralExpression>(node->op == TokenKind::BangEqual ? 1.0 : 0.0, node->line);
+        }
+        if (node->op != TokenKind::Plus)
+            return node;
+        std::string text;
+        appendText(text, left);
+        appendText(text, right);
+        rewrites++;
+        return arena.make<LiteralExpression>(symbols.intern(text), node->line);
+    }
+
+    // Moves literal placeholders into the surrounding text. A template left
+    // without placeholders becomes a string literal.
+    ASTNode *visitTemplateLiteral(TemplateLiteral *node)
+    {
+        Rewriter::visitTemplateLiteral(node);
+        size_t literals = 0;
+        for (const ASTNode *expr : node->expressions)
+            literals += nodeCast<LiteralExpression>(expr) != nullptr;
+        if (literals == 0)
+            return node;
+        rewrites++;
+
+        std::string text(symbols.name(node->segments[0].text));
+        segments.clear();
+        expressions.clear();
+        uint32_t textLength = 0;
+        for (size_t i = 0; i < node->expressions.size(); i++)
+        {
+            if (const auto *literal = nodeCast<LiteralExpression>(node->expressions[i]))
+                appendText(text, literal);
+            else
+            {
+                segments.emplace_back(symbols.intern(text), static_cast<uint32_t>(text.size()));
+                textLength += static_cast<uint32_t>(text.size());
+                expressions.push_back(node->expressions[i]);
+                text.clear();
+            }
+            text += symbols.name(node->segments[i + 1].text);
+        }
+        if (expressions.empty())
+            return arena.make<LiteralExpression>(symbols.intern(text), node->line);
+        segments.emplace_back(symbols.intern(text), static_cast<uint32_t>(text.size()));
+        textLength += static_cast<uint32_t>(text.size());
+        return arena.make<TemplateLiteral>(arena.copyList(segments.data(), segments.size()),
+                                           arena.copyList(expressions.data(), expressions.size()), textLength, node->line);
+    }
+
+private:
+    std::vector<TemplateSegment> segments;
+    std::vector<ASTNode *> expressions;
+
+    // Comparisons yield 1 or 0, as in the VM. order is negative, 0 or
+    // positive as the left operand sorts before, with or after the right;
+    // equal is false for NaN. Returns false if op is not a comparison.
+    static bool compare(TokenKind op, int order, bool equal, double &result)
+    {
+        bool holds;
+        switch (op)
+        {
+        case TokenKind::EqualEqual:
+            holds = equal;
+            break;
+        case TokenKind::BangEqual:
+            holds = !equal;
+            break;
+        case TokenKind::Less:
+            holds = order < 0;
+            break;
+        case TokenKind::LessEqual:
+            holds = equal || order < 0;
+            break;
+        case TokenKind::Greater:
+            holds = order > 0;
+            break;
+        case TokenKind::GreaterEqual:
+            holds = equal || order > 0;
+            break;
+        default:
+            return false;
+        }
+        result = holds ? 1 : 0;
+        return true;
+    }
+
+    void appendText(std::string &text, const LiteralExpression *literal) const
+    {
+        if (literal->isString)
+            text += symbols.name(literal->strValue);
+        else
+            text += formatNumber(literal->numValue);
+    }
+};
+
+class ConstantPropagator : public Rewriter<ConstantPropagator>
+{
+public:
+    using Rewriter::Rewriter;
+
+    ASTNode *visitIdentifierExpression(IdentifierExpression *node)
+    {
+        const LiteralExpression *constant = constantValue(node->name);
+        if (!constant)
+            return node;
+        rewrites++;
+        return copyLiteral(constant, node->line);
+    }
+};
+
+class Inliner : public Rewriter<Inliner>
+{
+public:
+    using Rewriter::Rewriter;
+
+    static constexpr size_t MaxInlineNodes = 16;
+
+    ASTNode *visitCallExpression(CallExpression *node)
+    {
+        Rewriter::visitCallExpression(node);
+        const auto *callee = nodeCast<IdentifierExpression>(node->callee);
+        FunctionDeclaration *function = callee ? findFunction(callee->name) : nullptr;
+        if (!function || function->params.count != node->arguments.count)
+            return node;
+        const ASTNode *body = inlineBody(function);
+        if (!body)
+            return node;
+        // A literal or variable argument may be evaluated any number of times
+        // and in any order. Any other argument must run exactly where the call
+        // would have run it: used once, in argument order, before any of the
+        // body's operators, so side effects and errors keep their order. A
+        // variable is read where the body uses it rather than where the call
+        // copied it, so no later argument may assign it, and a body that is
+        // just the variable would be read only when the enclosing operator
+        // runs.
+        nonTrivial.assign(node->arguments.count, false);
+        bool laterEffects = false;
+        for (size_t i = node->arguments.count; i-- > 0;)
+        {
+            const ASTNode *arg = node->arguments[i];
+            const auto *ident = nodeCast<IdentifierExpression>(arg);
+            bool variable = ident && isVariable(ident->name);
+            if (variable && laterEffects)
+                return node;
+            nonTrivial[i] = !nodeCast<LiteralExpression>(arg) && !variable;
+            laterEffects = laterEffects || nonTrivial[i];
+        }
+        if (const auto *ident = nodeCast<IdentifierExpression>(body))
+            if (nodeCast<IdentifierExpression>(node->arguments[parameterIndex(function, ident->name)]))
+                return node;
+        int lastUsed = -1;
+        bool operatorRan = false;
+        if (!keepsEvaluationOrder(body, function, lastUsed, operatorRan))
+            return node;
+        for (size_t i = lastUsed + 1; i < nonTrivial.size(); i++)
+            if (nonTrivial[i])
+                return node;
+        rewrites++;
+        return substitute(body, function, node);
+    }
+
+private:
+    std::unordered_map<const FunctionDeclaration *, const ASTNode *> bodies;
+    std::vector<bool> nonTrivial; // per argument of the call being inlined
+
+    bool keepsEvaluationOrder(const ASTNode *node, const FunctionDeclaration *function, int &lastUsed, bool &operatorRan) const
+    {
+        if (const auto *ident = nodeCast<IdentifierExpression>(node))
+        {
+            int index = parameterIndex(function, ident->name);
+            if (!nonTrivial[index])
+                return true;
+            if (operatorRan || index <= lastUsed)
+                return false;
+            for (int i = lastUsed + 1; i < index; i++)
+                if (nonTrivial[i])
+                    return false;
+            lastUsed = index;
+            return true;
+        }
+        if (const auto *binary = nodeCast<BinaryExpression>(node))
+        {
+            if (!keepsEvaluationOrder(binary->left, function, lastUsed, operatorRan) ||
+                !keepsEvaluationOrder(binary->right, function, lastUsed, operatorRan))
+                return false;
+            operatorRan = true;
+        }
+        return true;
+    }
+
+    // The returned expression if function can be inlined, otherwise null.
+    const ASTNode *inlineBody(const FunctionDeclaration *function)
+    {
+        auto it = bodies.find(function);
+        if (it != bodies.end())
+            return it->second;
+        const ASTNode *body = nullptr;
+        const ArenaList<ASTNode *> &stmts = function->body->body;
+        if (stmts.count == 1)
+            if (const auto *ret = nodeCast<ReturnStatement>(stmts[0]))
+            {
+                size_t nodes = 0;
+                if (ret->argument && isInlinable(ret->argument, function, nodes))
+                    body = ret->argument;
+            }
+        bodies.emplace(function, body);
+        return body;
+    }
+
+    static bool isInlinable(const ASTNode *node, const FunctionDeclaration *function, size_t &nodes)
+    {
+        if (++nodes > MaxInlineNodes)
+            return false;
+        if (nodeCast<LiteralExpression>(node))
+            return true;
+        if (const auto *ident = nodeCast<IdentifierExpression>(node))
+            return parameterIndex(function, ident->name) >= 0;
+        if (const auto *binary = nodeCast<BinaryExpression>(node))
+            return isInlinable(binary->left, function, nodes) && isInlinable(binary->right, function, nodes);
+        return false;
+    }
+
+    // The last parameter of that name, which is the one the body sees.
+    static int parameterIndex(const FunctionDeclaration *function, Symbol name)
+    {
+        for (size_t i = function->params.count; i-- > 0;)
+            if (function->params[i].name == name)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    // Copies the body with arguments in place of parameters. The copies keep
+    // the lines of the function body, so runtime errors still point there.
+    ASTNode *substitute(const ASTNode *node, const FunctionDeclaration *function, const CallExpression *call)
+    {
+        if (const auto *literal = nodeCast<LiteralExpression>(node))
+            return copyLiteral(literal, literal->line);
+        if (const auto *ident = nodeCast<IdentifierExpression>(node))
+        {
+            int index = parameterIndex(function, ident->name);
+            ASTNode *arg = call->arguments[index];
+            if (nonTrivial[index])
+                return arg; // used exactly once
+            if (const auto *literal = nodeCast<LiteralExpression>(arg))
+                return copyLiteral(literal, literal->line);
+            return arena.make<IdentifierExpression>(nodeCast<IdentifierExpression>(arg)->name, arg->line);
+        }
+        const auto *binary = nodeCast<BinaryExpression>(node);
+        return arena.make<BinaryExpression>(substitute(binary->left, function, call), binary->op,
+                                            substitute(binary->right, function, call), binary->line);
+    }
+};
+
+class DeadCodeRemover : public Rewriter<DeadCodeRemover>
+{
+public:
+    using Rewriter::Rewriter;
+
+    ASTNode *visitProgram(Program *node)
+    {
+        Rewriter::visitProgram(node);
+        removeAfterReturn(node->body, true);
+        return node;
+    }
+
+    ASTNode *visitBlockStatement(BlockStatement *node)
+    {
+        Rewriter::visitBlockStatement(node);
+        removeAfterReturn(node->body, false);
+        return node;
+    }
+
+private:
+    static bool alwaysReturns(const ASTNode *node)
+    {
+        if (nodeCast<ReturnStatement>(node))
+            return true;
+        if (const auto *block = nodeCast<BlockStatement>(node))
+            for (const ASTNode *stmt : block->body)
+                if (alwaysReturns(stmt))
+                    return true;
+        return false;
+    }
+
+    // Functions are hoisted, so they stay. Hoisted functions may also read
+    // globals declared further down, so a global declaration stays too and
+    // only loses its initializer, which can never run.
+    void removeAfterReturn(ArenaList<ASTNode *> &body, bool topLevel)
+    {
+        size_t i = 0;
+        while (i < body.count && !alwaysReturns(body[i]))
+            i++;
+        if (i == body.count)
+            return;
+        size_t kept = i + 1;
+        for (i = kept; i < body.count; i++)
+        {
+            if (nodeCast<FunctionDeclaration>(body[i]))
+                body[kept++] = body[i];
+            else if (auto *decl = topLevel ? nodeCast<VariableDeclaration>(body[i]) : nullptr)
+            {
+                for (VariableDeclarator &declarator : decl->declarations)
+                    if (declarator.init)
+                    {
+                        declarator.init = nullptr;
+                        rewrites++;
+                    }
+                body[kept++] = decl;
+            }
+            else
+                rewrites++;
+        }
+        body.count = static_cast<uint32_t>(kept);
+    }
+};
+
+template <typename Pass>
+size_t runPass(Program &program)
+{
+    Pass pass(program);
+    pass.visit(&program);
+    return pass.rewrites;
+}
+
+} // namespace
+
+size_t foldConstants(Program &program) { return runPass<ConstantFolder>(program); }
+size_t propagateConstants(Program &program) { return runPass<ConstantPropagator>(program); }
+size_t inlineFunctions(Program &program) { return runPass<Inliner>(program); }
+size_t removeDeadCode(Program &program) { return runPass<DeadCodeRemover>(program); }
+
+PassManager::PassManager()
+    : pipeline{
+          {"const-propagation", propagateConstants, true, 0, 0},
+          {"inlining", inlineFunctions, true, 0, 0},
+          {"constant-folding", foldConstants, true, 0, 0},
+          {"dead-code", removeDeadCode, true, 0, 0},
+      }
+{
+}
+
+bool PassManager::setEnabled(std::string_view name, bool enabled)
+{
+    for (OptimizationPass &pass : pipeline)
+        if (name == pass.name)
+        {
+            pass.enabled = enabled;
+            return true;
+        }
+    return false;
+}
+
+void PassManager::setAllEnabled(bool enabled)
+{
+    for (OptimizationPass &pass : pipeline)
+        pass.enabled = enabled;
+}
+
+size_t PassManager::run(Program &program)
+{
+    BASE_TRACE_SCOPE("PassManager::run", "pass");
+    size_t total = 0;
+    for (int round = 0; round < MaxRounds; round++)
+    {
+        size_t rewrites = 0;
+        for (OptimizationPass &pass : pipeline)
+        {
+            if (!pass.enabled)
+                continue;
+            auto start = std::chrono::steady_clock::now();
+            BASE_TRACE_SCOPE(pass.name, "pass");
+            size_t count = pass.run(program);
+            pass.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            pass.rewrites += count;
+            rewrites += count;
+        }
+        total += rewrites;
+        if (rewrites == 0)
+            break;
+    }
+    return total;
+}
+
+void PassManager::report(std::ostream &out) const
+{
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-20s %10s %12s\n", "pass", "rewrites", "time (ms)");
+    out << line;
+    for (const OptimizationPass &pass : pipeline)
+    {
+        if (pass.enabled)
+            std::snprintf(line, sizeof(line), "%-20s %10zu %12.3f\n", pass.name, pass.rewrites, pass.milliseconds);
+        else
+            std::snprintf(line, sizeof(line), "%-20s %10s %12s\n", pass.name, "off", "-");
+        out << line;
+    }
+}
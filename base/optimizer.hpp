@@ -0,0 +1,57 @@
+#pragma once
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "parser.hpp"
+
+// AST-to-AST optimization passes. Each pass rewrites the Program in place,
+// allocating any new nodes in its arena, and returns the number of nodes it
+// rewrote. Passes keep the observable behaviour of programs, including the
+// lines reported by runtime errors.
+
+// Replaces + - * / on two number literals, + on string and number literals
+// and comparisons of two literals by the literal result. Literal template
+// placeholders become text.
+size_t foldConstants(Program &program);
+// Replaces reads of a `const` whose initializer is a literal by that literal.
+size_t propagateConstants(Program &program);
+// Replaces calls to functions whose body is a single `return` of an
+// expression over parameters and literals by that expression, when doing so
+// keeps the order in which the arguments are evaluated.
+size_t inlineFunctions(Program &program);
+// Removes statements that follow a `return` in the same block. Function
+// declarations are hoisted, so they are kept.
+size_t removeDeadCode(Program &program);
+
+struct OptimizationPass
+{
+    const char *name;
+    size_t (*run)(Program &program);
+    bool enabled;
+    size_t rewrites;
+    double milliseconds;
+};
+
+// Runs the enabled passes in order and repeats the pipeline while it keeps
+// rewriting, since one pass exposes work for another (an inlined call may
+// fold, a folded initializer may propagate). Statistics add up over rounds.
+class PassManager
+{
+public:
+    PassManager();
+
+    // Returns false if there is no pass with that name.
+    bool setEnabled(std::string_view name, bool enabled);
+    void setAllEnabled(bool enabled);
+
+    // Returns the number of rewrites; any rewrite leaves the program to be
+    // checked again (see Checker).
+    size_t run(Program &program);
+    const std::vector<OptimizationPass> &passes() const { return pipeline; }
+    void report(std::ostream &out) const;
+
+    static constexpr int MaxRounds = 4;
+
+private:
+    std::vector<OptimizationPass> pipeline;
+};
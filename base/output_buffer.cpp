@@ -0,0 +1,84 @@
+#include "output_buffer.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+
+void OutputBuffer::appendInt(int64_t value)
+{
+    if (value < 0)
+    {
+        put('-');
+        appendUnsigned(0 - static_cast<uint64_t>(value));
+    }
+    else
+        appendUnsigned(static_cast<uint64_t>(value));
+}
+
+void OutputBuffer::appendUnsigned(uint64_t value)
+{
+    char digits[20];
+    char *cursor = digits + sizeof(digits);
+    do
+    {
+        *--cursor = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    data.append(cursor, digits + sizeof(digits));
+}
+
+void OutputBuffer::appendGeneral(double value)
+{
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%g", value);
+    data.append(text, static_cast<size_t>(length));
+}
+
+void OutputBuffer::appendShortest(double value)
+{
+    char text[32];
+#ifdef __cpp_lib_to_chars
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    data.append(text, result.ptr);
+#else
+    // 17 significant digits always read back exactly; try fewer first.
+    for (int precision = 15; precision <= 17; precision++)
+    {
+        std::snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (precision == 17 || std::strtod(text, nullptr) == value)
+            break;
+    }
+    data.append(text);
+#endif
+}
+
+void OutputBuffer::appendVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    put(static_cast<char>(value));
+}
+
+void OutputBuffer::appendU32(uint32_t value)
+{
+    size_t at = data.size();
+    data.resize(at + 4);
+    patchU32(at, value);
+}
+
+void OutputBuffer::patchU32(size_t position, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        data[position + i] = static_cast<char>(value >> (8 * i));
+}
+
+void OutputBuffer::flush()
+{
+    if (data.empty())
+        return;
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    flushed += data.size();
+    data.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Output assembled in memory and handed to a stream in large writes, for
+// dumps that would otherwise go through the stream a few bytes at a time.
+// Nothing is written until flushIfFull() or flush(), so a writer may patch
+// bytes it appended earlier (see patchU32()) as long as it has not flushed
+// since.
+class OutputBuffer
+{
+public:
+    static constexpr size_t DefaultFlushSize = size_t(1) << 20;
+
+    explicit OutputBuffer(std::ostream &out, size_t flushSize = DefaultFlushSize) : out(out), flushSize(flushSize) {}
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void append(std::string_view text) { data.append(text.data(), text.size()); }
+    void put(char c) { data.push_back(c); }
+    void appendSpaces(size_t count) { data.append(count, ' '); }
+    void appendInt(int64_t value);
+    void appendUnsigned(uint64_t value);
+    // The double as `std::ostream << value` writes it by default (%g).
+    void appendGeneral(double value);
+    // The shortest text that reads back as exactly value.
+    void appendShortest(double value);
+    // Unsigned LEB128: seven bits per byte, low bits first.
+    void appendVarint(uint64_t value);
+    // value as four little-endian bytes.
+    void appendU32(uint32_t value);
+
+    // Bytes appended since the last flush; positions for patchU32().
+    size_t pending() const { return data.size(); }
+    // Overwrites four bytes at an unflushed position with value, little-endian.
+    void patchU32(size_t position, uint32_t value);
+
+    // Writes the buffer out once it holds at least the flush size. Call it
+    // only where earlier bytes no longer need patching.
+    void flushIfFull()
+    {
+        if (data.size() >= flushSize)
+            flush();
+    }
+    void flush();
+    // Everything appended so far, flushed or not.
+    uint64_t bytesWritten() const { return flushed + data.size(); }
+
+private:
+    std::ostream &out;
+    size_t flushSize;
+    uint64_t flushed = 0;
+    std::string data;
+};
@@ -1,13 +1,186 @@
 #include "parser.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <array>
 #include <stdexcept>
 #include <sstream>
+#include <utility>
 #include <unordered_map>
 
-Parser::Parser(Lexer &lex) : lexer(lex) { advance(); }
+const char *declarationKindSpelling(DeclarationKind kind)
+{
+    return kind == DeclarationKind::Const ? "const" : "let";
+}
+
+const char *typeNameSpelling(TypeName type)
+{
+    switch (type)
+    {
+    case TypeName::Number:
+        return "number";
+    case TypeName::String:
+        return "string";
+    case TypeName::Void:
+        return "void";
+    }
+    return "?";
+}
+
+bool assignsLocal(const ASTNode *node, uint32_t slot)
+{
+    if (const auto *assignment = nodeCast<AssignmentExpression>(node))
+        return (assignment->binding.kind == BindingKind::Local && assignment->binding.slot == slot) ||
+               assignsLocal(assignment->value, slot);
+    if (const auto *binary = nodeCast<BinaryExpression>(node))
+        return assignsLocal(binary->left, slot) || assignsLocal(binary->right, slot);
+    if (const auto *call = nodeCast<CallExpression>(node))
+    {
+        for (const ASTNode *argument : call->arguments)
+            if (assignsLocal(argument, slot))
+                return true;
+        return false;
+    }
+    if (const auto *literal = nodeCast<TemplateLiteral>(node))
+    {
+        for (const ASTNode *expression : literal->expressions)
+            if (assignsLocal(expression, slot))
+                return true;
+        return false;
+    }
+    return false;
+}
+
+namespace
+{
+// Binding strength of the binary operators, loosest first. 0 means the
+// token does not continue an expression.
+enum Precedence : uint8_t
+{
+    NoPrecedence,
+    AssignmentPrecedence,
+    EqualityPrecedence,
+    ComparisonPrecedence,
+    AdditivePrecedence,
+    MultiplicativePrecedence
+};
+
+struct BinaryOperator
+{
+    uint8_t precedence;
+    bool rightAssociative;
+};
+
+// Indexed by TokenKind, which is a byte, so any token can be looked up
+// without a range check.
+constexpr std::array<BinaryOperator, 256> makeOperatorTable()
+{
+    std::array<BinaryOperator, 256> table{};
+    auto set = [&table](TokenKind kind, Precedence precedence, bool rightAssociative = false)
+    { table[static_cast<uint8_t>(kind)] = {precedence, rightAssociative}; };
+    for (TokenKind kind : {TokenKind::Equal, TokenKind::PlusEqual, TokenKind::MinusEqual, TokenKind::StarEqual,
+                           TokenKind::SlashEqual})
+        set(kind, AssignmentPrecedence, true);
+    set(TokenKind::EqualEqual, EqualityPrecedence);
+    set(TokenKind::BangEqual, EqualityPrecedence);
+    for (TokenKind kind : {TokenKind::Less, TokenKind::LessEqual, TokenKind::Greater, TokenKind::GreaterEqual})
+        set(kind, ComparisonPrecedence);
+    set(TokenKind::Plus, AdditivePrecedence);
+    set(TokenKind::Minus, AdditivePrecedence);
+    set(TokenKind::Star, MultiplicativePrecedence);
+    set(TokenKind::Slash, MultiplicativePrecedence);
+    return table;
+}
+
+constexpr std::array<BinaryOperator, 256> OperatorTable = makeOperatorTable();
+
+BinaryOperator binaryOperator(TokenKind kind) { return OperatorTable[static_cast<uint8_t>(kind)]; }
+} // namespace
+
+static TypeName typeNameFor(TokenKind kind)
+{
+    if (kind == TokenKind::KwNumber)
+        return TypeName::Number;
+    if (kind == TokenKind::KwString)
+        return TypeName::String;
+    return TypeName::Void;
+}
+
+Parser::Parser(Lexer &lex) : lexer(lex), diagnostics(&ownDiagnostics), throwOnError(true)
+{
+    lexer.setDiagnostics(diagnostics);
+    advance();
+}
+
+Parser::Parser(Lexer &lex, Diagnostics &sink) : lexer(lex), diagnostics(&sink), throwOnError(false)
+{
+    lexer.setDiagnostics(diagnostics);
+    advance();
+}
+
+Parser::Parser(const TokenTape &tokens, Diagnostics &sink)
+    : lexer(tokens.lexer()), tape(&tokens), diagnostics(&sink), throwOnError(false)
+{
+    advance();
+}
+
+void Parser::advance()
+{
+    previousEnd = tokenEnd(currentToken);
+    if (tape)
+    {
+        // Past the end, EndOfFile repeats as it does from the lexer.
+        size_t index = std::min(tokensRead, tape->size() - 1);
+        currentToken = (*tape)[index];
+        const std::vector<TokenTape::LexError> &lexErrors = tape->errors();
+        for (; nextTapeError < lexErrors.size() && lexErrors[nextTapeError].token == index; nextTapeError++)
+        {
+            const Diagnostic &lexError = lexErrors[nextTapeError].diagnostic;
+            diagnostics->report(lexError.code, lexError.span, lexError.message);
+        }
+    }
+    else
+        currentToken = lexer.nextToken();
+    tokensRead++;
+}
+
+std::string_view Parser::currentText() const { return lexer.text(currentToken); }
 
-void Parser::advance() { currentToken = lexer.nextToken(); }
+Symbol Parser::internCurrentText() { return symbols->intern(currentText()); }
 
-bool Parser::match(const std::string &expected)
+Symbol Parser::internCurrentValue()
+{
+    if (!(currentToken.flags & TokenHasEscapes))
+        return internCurrentText();
+    return symbols->intern(lexer.value(currentToken));
+}
+
+template <typename T>
+ArenaList<T> Parser::finishList(std::vector<T> &stack, size_t start)
+{
+    ArenaList<T> list = arena->copyList(stack.data() + start, stack.size() - start);
+    stack.erase(stack.begin() + start, stack.end());
+    return list;
+}
+
+// Gives node the source span from start to the end of the last token
+// consumed.
+template <typename T>
+T *Parser::spanned(T *node, uint32_t start)
+{
+    node->offset = start;
+    node->length = previousEnd > start ? previousEnd - start : 0;
+    return node;
+}
+
+template <typename T>
+T *Parser::spanned(T *node, const Token &token)
+{
+    node->offset = tokenStart(token);
+    node->length = tokenEnd(token) - node->offset;
+    return node;
+}
+
+bool Parser::match(TokenKind expected)
 {
     if (check(expected))
     {
@@ -16,17 +189,15 @@ bool Parser::match(const std::string &expected)
     }
     return false;
 }
-bool Parser::check(const std::string &expected) const
+bool Parser::check(TokenKind expected) const
 {
-    if (currentToken.type == TokenTypeEnum::EndOfFile)
-        return false;
-    return currentToken.value == expected;
+    return currentToken.kind == expected;
 }
 bool Parser::checkType(TokenTypeEnum expectedType) const
 {
     return currentToken.type == expectedType;
 }
-Token Parser::consume(const std::string &expected, const std::string &errorMsg)
+Token Parser::consume(TokenKind expected, const char *errorMsg)
 {
     if (check(expected))
     {
@@ -34,9 +205,10 @@ Token Parser::consume(const std::string &expected, const std::string &errorMsg)
         advance();
         return token;
     }
-    throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": " + errorMsg);
+    error(DiagnosticCode::ExpectedToken, errorMsg);
+    return currentToken;
 }
-Token Parser::consumeType(TokenTypeEnum expectedType, const std::string &errorMsg)
+Token Parser::consumeType(TokenTypeEnum expectedType, const char *errorMsg)
 {
     if (checkType(expectedType))
     {
@@ -44,228 +216,488 @@ Token Parser::consumeType(TokenTypeEnum expectedType, const std::string &errorMs
         advance();
         return token;
     }
-    throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": " + errorMsg);
+    error(DiagnosticCode::ExpectedToken, errorMsg);
+    return currentToken;
+}
+
+// Only the first error of a statement is reported; the rest are usually
+// consequences of it.
+void Parser::error(DiagnosticCode code, std::string message)
+{
+    if (panicking)
+        return;
+    panicking = true;
+    diagnostics->report(code, SourceSpan{currentToken.offset, currentToken.length, currentToken.line}, std::move(message));
+}
+
+void Parser::errorGot(DiagnosticCode code, const char *expected)
+{
+    if (!panicking)
+        error(code, std::string("Expected ") + expected + ", got '" + lexer.value(currentToken) + "'");
+}
+
+void Parser::throwIfFailed() const
+{
+    if (throwOnError && diagnostics->hasErrors())
+        throw std::runtime_error(formatDiagnostic(diagnostics->first()));
+}
+
+static bool startsStatement(TokenKind kind)
+{
+    return kind == TokenKind::KwLet || kind == TokenKind::KwConst || kind == TokenKind::KwFunction ||
+           kind == TokenKind::KwPrint || kind == TokenKind::KwReturn;
+}
+
+// Parses a statement; if it fails, drops it along with whatever it left on
+// the scratch stacks and skips to where the next statement can start.
+ASTNode *Parser::parseStatementOrRecover()
+{
+    size_t statementStart = tokensRead;
+    size_t nodes = nodeStack.size(), declarators = declaratorStack.size();
+    size_t parameters = parameterStack.size(), segments = segmentStack.size();
+    ASTNode *stmt = parseStatement();
+    if (!panicking)
+        return stmt;
+    nodeStack.erase(nodeStack.begin() + nodes, nodeStack.end());
+    declaratorStack.erase(declaratorStack.begin() + declarators, declaratorStack.end());
+    parameterStack.erase(parameterStack.begin() + parameters, parameterStack.end());
+    segmentStack.erase(segmentStack.begin() + segments, segmentStack.end());
+    synchronize(statementStart);
+    return nullptr;
+}
+
+// Stops after a ';', before a '}' or a statement keyword, or after a
+// balanced {...} group (the body of a declaration whose header failed). A
+// statement that failed on its first token skips at least that token, so
+// a stray '}' at top level cannot stall the parse.
+void Parser::synchronize(size_t statementStart)
+{
+    panicking = false;
+    bool moved = tokensRead != statementStart;
+    while (currentToken.type != TokenTypeEnum::EndOfFile)
+    {
+        if (match(TokenKind::Semicolon))
+            return;
+        if (moved && (check(TokenKind::RBrace) || startsStatement(currentToken.kind)))
+            return;
+        if (check(TokenKind::LBrace))
+        {
+            int depth = 0;
+            do
+            {
+                depth += check(TokenKind::LBrace) ? 1 : check(TokenKind::RBrace) ? -1 : 0;
+                advance();
+            } while (depth > 0 && currentToken.type != TokenTypeEnum::EndOfFile);
+            return;
+        }
+        advance();
+        moved = true;
+    }
 }
 
-std::unique_ptr<Program> Parser::parse() { return parseProgram(); }
+std::unique_ptr<Program> Parser::parse()
+{
+    std::unique_ptr<Program> program = parseProgram();
+    throwIfFailed();
+    return program;
+}
+
+void Parser::attach(Program &program)
+{
+    arena = &program.arena;
+    symbols = &program.symbols;
+}
+
+ASTNode *Parser::parseTopLevelStatement()
+{
+    ASTNode *stmt = parseStatementOrRecover();
+    throwIfFailed();
+    return stmt;
+}
+
+size_t Parser::parseEach(const std::function<void(Program &)> &onStatement)
+{
+    Program program;
+    attach(program);
+    size_t count = 0;
+    while (currentToken.type != TokenTypeEnum::EndOfFile)
+    {
+        lexer.release(currentToken);
+        program.arena.reset();
+        program.symbols.clear();
+        ASTNode *stmt = parseStatementOrRecover();
+        throwIfFailed();
+        if (!stmt)
+            continue;
+        program.body = arena->copyList(&stmt, 1);
+        count++;
+        onStatement(program);
+    }
+    program.body = ArenaList<ASTNode *>();
+    return count;
+}
 
 std::unique_ptr<Program> Parser::parseProgram()
 {
-    std::vector<std::unique_ptr<ASTNode>> statements;
+    BASE_TRACE_SCOPE("Parser::parseProgram", "parser");
+    auto program = std::make_unique<Program>();
+    arena = &program->arena;
+    symbols = &program->symbols;
+    size_t start = nodeStack.size();
     while (currentToken.type != TokenTypeEnum::EndOfFile)
     {
-        auto stmt = parseStatement();
+        ASTNode *stmt = parseStatementOrRecover();
         if (stmt)
-            statements.push_back(std::move(stmt));
+            nodeStack.push_back(stmt);
     }
-    return std::make_unique<Program>(std::move(statements));
+    program->body = finishList(nodeStack, start);
+    return program;
 }
 
-std::unique_ptr<ASTNode> Parser::parseStatement()
+ASTNode *Parser::parseStatement()
 {
-    if (currentToken.value == "let" || currentToken.value == "const")
+    BASE_TRACE_SCOPE("Parser::parseStatement", "parser");
+    if (check(TokenKind::KwLet) || check(TokenKind::KwConst))
         return parseVariableDeclaration();
-    if (currentToken.value == "function")
+    if (check(TokenKind::KwFunction))
         return parseFunctionDeclaration();
-    if (currentToken.value == "print")
+    if (check(TokenKind::KwPrint))
     {
         // Built-in print statement
-        int line = currentToken.line;
+        Token keyword = currentToken;
+        int line = keyword.line;
         advance();
-        consume("(", "Expected '(' after 'print'");
-        auto arg = parseExpression();
-        consume(")", "Expected ')' after print argument");
-        consume(";", "Expected ';' after print statement");
-        std::vector<std::unique_ptr<ASTNode>> args;
-        args.push_back(std::move(arg));
-        auto callee = std::make_unique<IdentifierExpression>("print", line);
-        return std::make_unique<ExpressionStatement>(
-            std::make_unique<CallExpression>(std::move(callee), std::move(args), line),
-            line);
+        consume(TokenKind::LParen, "Expected '(' after 'print'");
+        ASTNode *arg = parseExpression();
+        consume(TokenKind::RParen, "Expected ')' after print argument");
+        ArenaList<ASTNode *> args = arena->copyList(&arg, 1);
+        auto callee = spanned(arena->make<IdentifierExpression>(symbols->intern("print"), line), keyword);
+        auto call = spanned(arena->make<CallExpression>(callee, args, line), callee->offset);
+        consume(TokenKind::Semicolon, "Expected ';' after print statement");
+        return spanned(arena->make<ExpressionStatement>(call, line), callee->offset);
     }
-    if (currentToken.value == "return")
+    if (check(TokenKind::KwReturn))
     {
         int line = currentToken.line;
+        uint32_t start = tokenStart(currentToken);
         advance();
-        std::unique_ptr<ASTNode> arg = nullptr;
+        ASTNode *arg = nullptr;
         // void fonksiyonlarda return; olabilir, diğerlerinde return <expr>;
-        if (!check(";"))
+        if (!check(TokenKind::Semicolon))
         {
             arg = parseExpression();
         }
-        consume(";", "Expected ';' after return statement");
-        return std::make_unique<ReturnStatement>(std::move(arg), line);
+        consume(TokenKind::Semicolon, "Expected ';' after return statement");
+        return spanned(arena->make<ReturnStatement>(arg, line), start);
     }
-    if (check("{"))
+    if (check(TokenKind::LBrace))
         return parseBlockStatement();
     return parseExpressionStatement();
 }
 
-std::unique_ptr<VariableDeclaration> Parser::parseVariableDeclaration()
+VariableDeclaration *Parser::parseVariableDeclaration()
 {
-    std::string kind = currentToken.value;
+    BASE_TRACE_SCOPE("Parser::parseVariableDeclaration", "parser");
+    DeclarationKind kind = check(TokenKind::KwConst) ? DeclarationKind::Const : DeclarationKind::Let;
+    uint32_t start = tokenStart(currentToken);
     advance();
-    std::vector<VariableDeclarator> declarations;
+    size_t declarators = declaratorStack.size();
     do
     {
-        std::string typeAnnotation;
-        if (currentToken.type == TokenTypeEnum::Keyword && (currentToken.value == "number" || currentToken.value == "string"))
+        TypeName typeAnnotation;
+        if (check(TokenKind::KwNumber) || check(TokenKind::KwString))
         {
-            typeAnnotation = currentToken.value;
+            typeAnnotation = typeNameFor(currentToken.kind);
             advance();
         }
         else
-            throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected type annotation, got '" + currentToken.value + "'");
+        {
+            errorGot(DiagnosticCode::ExpectedTypeAnnotation, "type annotation");
+            return nullptr;
+        }
         if (currentToken.type != TokenTypeEnum::Identifier)
-            throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected identifier, got '" + currentToken.value + "'");
-        std::string name = currentToken.value;
+        {
+            errorGot(DiagnosticCode::ExpectedIdentifier, "identifier");
+            return nullptr;
+        }
+        Symbol name = internCurrentText();
         advance();
-        consume("=", "Assignment is required in variable declaration");
-        auto init = parseExpression();
-        declarations.emplace_back(name, std::move(init), typeAnnotation);
-    } while (match(","));
-    consume(";", "Expected ';' after variable declaration");
-    return std::make_unique<VariableDeclaration>(kind, std::move(declarations), currentToken.line);
+        consume(TokenKind::Equal, "Assignment is required in variable declaration");
+        ASTNode *init = parseExpression();
+        declaratorStack.emplace_back(name, init, typeAnnotation);
+    } while (!panicking && match(TokenKind::Comma));
+    consume(TokenKind::Semicolon, "Expected ';' after variable declaration");
+    if (panicking)
+        return nullptr;
+    ArenaList<VariableDeclarator> declarations = finishList(declaratorStack, declarators);
+    return spanned(arena->make<VariableDeclaration>(kind, declarations, currentToken.line), start);
 }
 
-std::unique_ptr<FunctionDeclaration> Parser::parseFunctionDeclaration()
+FunctionDeclaration *Parser::parseFunctionDeclaration()
 {
+    BASE_TRACE_SCOPE("Parser::parseFunctionDeclaration", "parser");
+    uint32_t start = tokenStart(currentToken);
     advance();
-    std::string returnType;
-    if (currentToken.type == TokenTypeEnum::Keyword && (currentToken.value == "number" || currentToken.value == "string" || currentToken.value == "void"))
+    TypeName returnType;
+    if (check(TokenKind::KwNumber) || check(TokenKind::KwString) || check(TokenKind::KwVoid))
     {
-        returnType = currentToken.value;
+        returnType = typeNameFor(currentToken.kind);
         advance();
     }
     else
-        throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected return type, got '" + currentToken.value + "'");
+    {
+        errorGot(DiagnosticCode::ExpectedReturnType, "return type");
+        return nullptr;
+    }
     if (currentToken.type != TokenTypeEnum::Identifier)
-        throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected function name, got '" + currentToken.value + "'");
-    std::string name = currentToken.value;
+    {
+        errorGot(DiagnosticCode::ExpectedFunctionName, "function name");
+        return nullptr;
+    }
+    Symbol name = internCurrentText();
     advance();
-    consume("(", "Expected '(' after function name");
-    std::vector<Parameter> params = parseParameterList();
-    consume(")", "Expected ')' after parameters");
-    auto body = parseBlockStatement();
-    return std::make_unique<FunctionDeclaration>(name, std::move(params), std::unique_ptr<BlockStatement>(static_cast<BlockStatement *>(body.release())), currentToken.line, returnType);
+    consume(TokenKind::LParen, "Expected '(' after function name");
+    ArenaList<Parameter> params = parseParameterList();
+    consume(TokenKind::RParen, "Expected ')' after parameters");
+    if (panicking)
+        return nullptr;
+    BlockStatement *body = parseBlockStatement();
+    if (panicking)
+        return nullptr;
+    return spanned(arena->make<FunctionDeclaration>(name, params, body, currentToken.line, returnType), start);
 }
 
-std::unique_ptr<BlockStatement> Parser::parseBlockStatement()
+BlockStatement *Parser::parseBlockStatement()
 {
+    BASE_TRACE_SCOPE("Parser::parseBlockStatement", "parser");
     int line = currentToken.line;
-    consume("{", "Expected '{'");
-    std::vector<std::unique_ptr<ASTNode>> statements;
-    while (!check("}") && currentToken.type != TokenTypeEnum::EndOfFile)
+    uint32_t start = tokenStart(currentToken);
+    consume(TokenKind::LBrace, "Expected '{'");
+    if (panicking)
+        return nullptr;
+    size_t statements = nodeStack.size();
+    while (!check(TokenKind::RBrace) && currentToken.type != TokenTypeEnum::EndOfFile)
     {
-        auto stmt = parseStatement();
+        ASTNode *stmt = parseStatementOrRecover();
         if (stmt)
-            statements.push_back(std::move(stmt));
+            nodeStack.push_back(stmt);
+    }
+    consume(TokenKind::RBrace, "Expected '}'");
+    if (panicking)
+    {
+        nodeStack.erase(nodeStack.begin() + statements, nodeStack.end());
+        return nullptr;
     }
-    consume("}", "Expected '}'");
-    return std::make_unique<BlockStatement>(std::move(statements), line);
+    return spanned(arena->make<BlockStatement>(finishList(nodeStack, statements), line), start);
 }
 
-std::unique_ptr<ASTNode> Parser::parseExpressionStatement()
+ASTNode *Parser::parseExpressionStatement()
 {
+    BASE_TRACE_SCOPE("Parser::parseExpressionStatement", "parser");
     int line = currentToken.line;
-    auto expr = parseExpression();
-    consume(";", "Expected ';' after expression");
-    return std::make_unique<ExpressionStatement>(std::move(expr), line);
+    uint32_t start = tokenStart(currentToken);
+    ASTNode *expr = parseExpression();
+    consume(TokenKind::Semicolon, "Expected ';' after expression");
+    return spanned(arena->make<ExpressionStatement>(expr, line), start);
 }
 
-std::unique_ptr<ASTNode> Parser::parseExpression()
+ASTNode *Parser::parseExpression()
 {
+    BASE_TRACE_SCOPE("Parser::parseExpression", "parser");
     return parseBinaryExpression();
 }
 
-std::unique_ptr<ASTNode> Parser::parseBinaryExpression(int minPrec)
+// Parses an expression whose operators all bind tighter than minPrec.
+ASTNode *Parser::parseBinaryExpression(int minPrec)
+{
+    return parseOperators(parsePrimaryExpression(), minPrec);
+}
+
+// Precedence climbing over OperatorTable. A run of operators of one level,
+// such as a + b - c, is folded in this loop; the parser only recurses where
+// a tighter operator (or a right-associative one) takes the right operand.
+ASTNode *Parser::parseOperators(ASTNode *left, int minPrec)
 {
-    auto left = parsePrimaryExpression();
-    while (currentToken.type == TokenTypeEnum::Symbol &&
-           (currentToken.value == "+" || currentToken.value == "-" ||
-            currentToken.value == "*" || currentToken.value == "/"))
+    while (!panicking)
     {
-        std::string op = currentToken.value;
+        BinaryOperator current = binaryOperator(currentToken.kind);
+        if (current.precedence <= minPrec)
+            break;
+        TokenKind op = currentToken.kind;
         int line = currentToken.line;
+        const IdentifierExpression *target = nullptr;
+        if (current.precedence == AssignmentPrecedence)
+        {
+            target = nodeCast<IdentifierExpression>(left);
+            if (!target)
+            {
+                error(DiagnosticCode::InvalidAssignmentTarget, "Invalid assignment target");
+                break;
+            }
+        }
         advance();
-        auto right = parsePrimaryExpression();
-        left = std::make_unique<BinaryExpression>(std::move(left), op, std::move(right), line);
+        ASTNode *right = parsePrimaryExpression();
+        BinaryOperator next = binaryOperator(currentToken.kind);
+        if (next.precedence > current.precedence)
+            right = parseOperators(right, current.precedence);
+        else if (next.precedence == current.precedence && current.rightAssociative)
+            right = parseOperators(right, current.precedence - 1);
+        if (target)
+            left = spanned(arena->make<AssignmentExpression>(target->name, op, right, line), target->offset);
+        else
+            left = spanned(arena->make<BinaryExpression>(left, op, right, line), left->offset);
     }
     return left;
 }
 
-std::unique_ptr<ASTNode> Parser::parsePrimaryExpression()
+ASTNode *Parser::parsePrimaryExpression()
 {
     int line = currentToken.line;
+    uint32_t start = tokenStart(currentToken);
     if (currentToken.type == TokenTypeEnum::Number)
     {
-        double value = std::stod(currentToken.value);
+        double value = lexer.numberValue(currentToken);
         advance();
-        return std::make_unique<LiteralExpression>(value, line);
+        return spanned(arena->make<LiteralExpression>(value, line), start);
     }
+    if (currentToken.type == TokenTypeEnum::TemplateLiteral && currentText().find("${") != std::string_view::npos)
+        return parseTemplateLiteral();
     if (currentToken.type == TokenTypeEnum::String || currentToken.type == TokenTypeEnum::TemplateLiteral)
     {
-        std::string value = currentToken.value;
+        Symbol value = internCurrentValue();
         advance();
-        return std::make_unique<LiteralExpression>(value, line);
+        return spanned(arena->make<LiteralExpression>(value, line), start);
     }
     if (currentToken.type == TokenTypeEnum::Identifier)
     {
-        std::string name = currentToken.value;
+        Symbol name = internCurrentText();
         advance();
-        if (match("("))
-            return parseCallExpression(std::make_unique<IdentifierExpression>(name, line));
-        return std::make_unique<IdentifierExpression>(name, line);
+        auto identifier = spanned(arena->make<IdentifierExpression>(name, line), start);
+        if (match(TokenKind::LParen))
+            return parseCallExpression(identifier);
+        return identifier;
     }
-    if (match("("))
+    if (match(TokenKind::LParen))
     {
-        auto expr = parseExpression();
-        consume(")", "Expected ')' after expression");
+        ASTNode *expr = parseExpression();
+        consume(TokenKind::RParen, "Expected ')' after expression");
         return expr;
     }
-    throw std::runtime_error("Parse error at line " + std::to_string(line) + ": Unexpected token '" + currentToken.value + "'");
+    error(DiagnosticCode::UnexpectedToken, "Unexpected token '" + lexer.value(currentToken) + "'");
+    // Stands in for the missing operand; the statement is dropped anyway.
+    return spanned(arena->make<LiteralExpression>(0.0, line), currentToken);
 }
 
-std::unique_ptr<ASTNode> Parser::parseCallExpression(std::unique_ptr<ASTNode> callee)
+// Splits the raw text of a template literal at its ${} placeholders. Each
+// placeholder is parsed by a nested parser over the text that follows it,
+// which stops at the closing '}'.
+ASTNode *Parser::parseTemplateLiteral()
 {
+    BASE_TRACE_SCOPE("Parser::parseTemplateLiteral", "parser");
     int line = currentToken.line;
-    auto args = parseArgumentList();
-    consume(")", "Expected ')' after arguments");
-    return std::make_unique<CallExpression>(std::move(callee), std::move(args), line);
+    uint32_t start = tokenStart(currentToken);
+    std::string_view raw = currentText();
+    size_t segmentStart = segmentStack.size();
+    size_t expressionStart = nodeStack.size();
+    uint32_t textLength = 0;
+    auto addSegment = [&](std::string_view text)
+    {
+        std::string decoded = Lexer::decodeEscapes(text);
+        segmentStack.emplace_back(symbols->intern(decoded), static_cast<uint32_t>(decoded.size()));
+        textLength += static_cast<uint32_t>(decoded.size());
+    };
+
+    size_t textStart = 0;
+    int placeholderLine = line;
+    for (size_t i = 0; i < raw.size();)
+    {
+        if (raw[i] == '\\')
+        {
+            placeholderLine += i + 1 < raw.size() && raw[i + 1] == '\n';
+            i += 2;
+            continue;
+        }
+        if (raw[i] != '$' || i + 1 >= raw.size() || raw[i + 1] != '{')
+        {
+            placeholderLine += raw[i] == '\n';
+            i++;
+            continue;
+        }
+        addSegment(raw.substr(textStart, i - textStart));
+        std::string_view rest = raw.substr(i + 2);
+        uint32_t restOffset = currentToken.offset + static_cast<uint32_t>(i + 2);
+        Lexer innerLexer(rest, placeholderLine, restOffset);
+        Parser inner(innerLexer, *diagnostics);
+        inner.arena = arena;
+        inner.symbols = symbols;
+        nodeStack.push_back(inner.parseExpression());
+        if (!inner.check(TokenKind::RBrace))
+            inner.error(DiagnosticCode::UnclosedTemplatePlaceholder, "Expected '}' after template expression");
+        if (inner.panicking)
+        {
+            panicking = true;
+            break;
+        }
+        size_t end = i + 2 + (inner.currentToken.offset - restOffset) + 1;
+        for (; i < end; i++)
+            placeholderLine += raw[i] == '\n';
+        textStart = end;
+    }
+    addSegment(raw.substr(textStart));
+    advance();
+
+    ArenaList<TemplateSegment> segments = finishList(segmentStack, segmentStart);
+    ArenaList<ASTNode *> expressions = finishList(nodeStack, expressionStart);
+    return spanned(arena->make<TemplateLiteral>(segments, expressions, textLength, line), start);
 }
 
-std::vector<std::unique_ptr<ASTNode>> Parser::parseArgumentList()
+ASTNode *Parser::parseCallExpression(ASTNode *callee)
 {
-    std::vector<std::unique_ptr<ASTNode>> args;
-    while (!check(")") && currentToken.type != TokenTypeEnum::EndOfFile)
+    BASE_TRACE_SCOPE("Parser::parseCallExpression", "parser");
+    int line = currentToken.line;
+    ArenaList<ASTNode *> args = parseArgumentList();
+    consume(TokenKind::RParen, "Expected ')' after arguments");
+    return spanned(arena->make<CallExpression>(callee, args, line), callee->offset);
+}
+
+ArenaList<ASTNode *> Parser::parseArgumentList()
+{
+    size_t start = nodeStack.size();
+    while (!panicking && !check(TokenKind::RParen) && currentToken.type != TokenTypeEnum::EndOfFile)
     {
-        args.push_back(parseExpression());
-        if (!check(")"))
-            consume(",", "Expected ',' or ')' in argument list");
+        nodeStack.push_back(parseExpression());
+        if (!check(TokenKind::RParen))
+            consume(TokenKind::Comma, "Expected ',' or ')' in argument list");
     }
-    return args;
+    return finishList(nodeStack, start);
 }
 
-std::vector<Parameter> Parser::parseParameterList()
+ArenaList<Parameter> Parser::parseParameterList()
 {
-    std::vector<Parameter> params;
-    while (!check(")") && currentToken.type != TokenTypeEnum::EndOfFile)
+    size_t start = parameterStack.size();
+    while (!panicking && !check(TokenKind::RParen) && currentToken.type != TokenTypeEnum::EndOfFile)
     {
-        std::string paramType;
-        if (currentToken.type == TokenTypeEnum::Keyword && (currentToken.value == "number" || currentToken.value == "string"))
+        TypeName paramType;
+        if (check(TokenKind::KwNumber) || check(TokenKind::KwString))
         {
-            paramType = currentToken.value;
+            paramType = typeNameFor(currentToken.kind);
             advance();
         }
         else
-            throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected parameter type, got '" + currentToken.value + "'");
+        {
+            errorGot(DiagnosticCode::ExpectedParameterType, "parameter type");
+            break;
+        }
         if (currentToken.type != TokenTypeEnum::Identifier)
-            throw std::runtime_error("Parse error at line " + std::to_string(currentToken.line) + ": Expected parameter name, got '" + currentToken.value + "'");
-        std::string name = currentToken.value;
+        {
+            errorGot(DiagnosticCode::ExpectedParameterName, "parameter name");
+            break;
+        }
+        Symbol name = internCurrentText();
         advance();
-        params.emplace_back(name, paramType);
-        if (!check(")"))
-            consume(",", "Expected ',' or ')' in parameter list");
+        parameterStack.emplace_back(name, paramType);
+        if (!check(TokenKind::RParen))
+            consume(TokenKind::Comma, "Expected ',' or ')' in parameter list");
     }
-    return params;
-}
\ No newline at end of file
+    return finishList(parameterStack, start);
+}
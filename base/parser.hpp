@@ -1,141 +1,364 @@
 ﻿#pragma once
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include "arena.hpp"
+#include "interner.hpp"
 #include "lexer.hpp"
+#include "token_tape.hpp"
 
-// AST Base
+// AST nodes live in the Program's arena and refer to each other with plain
+// pointers. Names and string literals are Symbols in the Program's interner.
+// Nodes hold no owning members, so a whole tree is freed at once.
+enum class DeclarationKind : uint8_t
+{
+    Let,
+    Const
+};
+
+enum class TypeName : uint8_t
+{
+    Number,
+    String,
+    Void
+};
+
+const char *declarationKindSpelling(DeclarationKind kind);
+const char *typeNameSpelling(TypeName type);
+
+// Where a name lives, filled in by the Checker (checker.hpp). A local is a
+// register of the frame of the function that declares it (functions do not
+// see each other's locals), a global is a module slot and a function is an
+// index into Module::functions.
+enum class BindingKind : uint8_t
+{
+    Unresolved,
+    Local,
+    Global,
+    Function,
+    Print // the built-in print()
+};
+
+struct Binding
+{
+    BindingKind kind = BindingKind::Unresolved;
+    uint32_t slot = 0;
+};
+
+#define BASE_AST_NODES(X)   \
+    X(Program)              \
+    X(LiteralExpression)    \
+    X(IdentifierExpression) \
+    X(VariableDeclaration)  \
+    X(FunctionDeclaration)  \
+    X(BlockStatement)       \
+    X(ReturnStatement)      \
+    X(ExpressionStatement)  \
+    X(BinaryExpression)     \
+    X(AssignmentExpression) \
+    X(CallExpression)       \
+    X(TemplateLiteral)
+
+enum class NodeKind : uint8_t
+{
+#define BASE_NODE_KIND(type) type,
+    BASE_AST_NODES(BASE_NODE_KIND)
+#undef BASE_NODE_KIND
+};
+
+// AST Base. Nodes carry a kind tag instead of a vtable; use nodeCast<T>() or
+// an ASTVisitor (ast_visitor.hpp) to get at the concrete type. valueType is
+// the static type of an expression once checked; statements are Void.
+// offset and length give the source text the node was parsed from, for
+// diagnostics; nodes made by later passes have an empty span.
 struct ASTNode
 {
-    virtual ~ASTNode() = default;
+    int line;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    NodeKind nodeKind;
+    TypeName valueType = TypeName::Void;
+
+protected:
+    ASTNode(NodeKind k, int l) : line(l), nodeKind(k) {}
 };
 
+template <typename T>
+T *nodeCast(ASTNode *node)
+{
+    return node && node->nodeKind == T::Kind ? static_cast<T *>(node) : nullptr;
+}
+
+template <typename T>
+const T *nodeCast(const ASTNode *node)
+{
+    return node && node->nodeKind == T::Kind ? static_cast<const T *>(node) : nullptr;
+}
+
 struct Program : ASTNode
 {
-    std::vector<std::unique_ptr<ASTNode>> body;
-    Program(std::vector<std::unique_ptr<ASTNode>> b) : body(std::move(b)) {}
+    static constexpr NodeKind Kind = NodeKind::Program;
+    Arena arena;
+    Interner symbols;
+    ArenaList<ASTNode *> body;
+    // Set by the Checker: module sizes, counting the top-level code as
+    // function 0.
+    uint32_t globalCount = 0;
+    uint32_t functionCount = 0;
+    Program() : ASTNode(Kind, 1) {}
 };
 
 struct LiteralExpression : ASTNode
 {
-    std::string strValue;
-    double numValue{};
-    bool isString = false, isNumber = false;
-    LiteralExpression(const std::string &v, int) : strValue(v), isString(true) {}
-    LiteralExpression(double v, int) : numValue(v), isNumber(true) {}
+    static constexpr NodeKind Kind = NodeKind::LiteralExpression;
+    bool isString;
+    union
+    {
+        double numValue;
+        Symbol strValue;
+    };
+    LiteralExpression(Symbol v, int l) : ASTNode(Kind, l), isString(true), strValue(v) { valueType = TypeName::String; }
+    LiteralExpression(double v, int l) : ASTNode(Kind, l), isString(false), numValue(v) { valueType = TypeName::Number; }
 };
 
 struct IdentifierExpression : ASTNode
 {
-    std::string name;
-    IdentifierExpression(const std::string &n, int) : name(n) {}
+    static constexpr NodeKind Kind = NodeKind::IdentifierExpression;
+    Symbol name;
+    Binding binding;
+    IdentifierExpression(Symbol n, int l) : ASTNode(Kind, l), name(n) {}
 };
 
 struct VariableDeclarator
 {
-    std::string name;
-    std::unique_ptr<ASTNode> init;
-    std::string type;
-    VariableDeclarator(std::string n, std::unique_ptr<ASTNode> i, std::string t)
-        : name(std::move(n)), init(std::move(i)), type(std::move(t)) {}
+    Symbol name;
+    ASTNode *init; // null for a global declaration the dead-code pass found unreachable
+    TypeName type;
+    Binding binding; // Local or Global
+    VariableDeclarator(Symbol n, ASTNode *i, TypeName t) : name(n), init(i), type(t) {}
 };
 
 struct VariableDeclaration : ASTNode
 {
-    std::string kind;
-    std::vector<VariableDeclarator> declarations;
-    int line;
-    VariableDeclaration(std::string k, std::vector<VariableDeclarator> d, int l)
-        : kind(std::move(k)), declarations(std::move(d)), line(l) {}
+    static constexpr NodeKind Kind = NodeKind::VariableDeclaration;
+    DeclarationKind kind;
+    ArenaList<VariableDeclarator> declarations;
+    VariableDeclaration(DeclarationKind k, ArenaList<VariableDeclarator> d, int l)
+        : ASTNode(Kind, l), kind(k), declarations(d) {}
 };
 
 struct Parameter
 {
-    std::string name;
-    std::string type;
-    Parameter(std::string n, std::string t) : name(std::move(n)), type(std::move(t)) {}
+    Symbol name;
+    TypeName type;
+    Parameter(Symbol n, TypeName t) : name(n), type(t) {}
 };
 
 struct BlockStatement;
 struct FunctionDeclaration : ASTNode
 {
-    std::string name;
-    std::vector<Parameter> params;
-    std::unique_ptr<BlockStatement> body;
-    int line;
-    std::string returnType;
-    FunctionDeclaration(std::string n, std::vector<Parameter> p, std::unique_ptr<BlockStatement> b, int l, std::string rt)
-        : name(std::move(n)), params(std::move(p)), body(std::move(b)), line(l), returnType(std::move(rt)) {}
+    static constexpr NodeKind Kind = NodeKind::FunctionDeclaration;
+    TypeName returnType;
+    Symbol name;
+    ArenaList<Parameter> params;
+    BlockStatement *body;
+    uint32_t index = 0; // in Module::functions, set by the Checker
+    FunctionDeclaration(Symbol n, ArenaList<Parameter> p, BlockStatement *b, int l, TypeName rt)
+        : ASTNode(Kind, l), returnType(rt), name(n), params(p), body(b) {}
 };
 
 struct BlockStatement : ASTNode
 {
-    std::vector<std::unique_ptr<ASTNode>> body;
-    int line;
-    BlockStatement(std::vector<std::unique_ptr<ASTNode>> b, int l) : body(std::move(b)), line(l) {}
+    static constexpr NodeKind Kind = NodeKind::BlockStatement;
+    ArenaList<ASTNode *> body;
+    BlockStatement(ArenaList<ASTNode *> b, int l) : ASTNode(Kind, l), body(b) {}
 };
 
 struct ReturnStatement : ASTNode
 {
-    std::unique_ptr<ASTNode> argument;
-    int line;
-    ReturnStatement(std::unique_ptr<ASTNode> arg, int l)
-        : argument(std::move(arg)), line(l) {}
+    static constexpr NodeKind Kind = NodeKind::ReturnStatement;
+    ASTNode *argument;
+    ReturnStatement(ASTNode *arg, int l) : ASTNode(Kind, l), argument(arg) {}
 };
 
 struct ExpressionStatement : ASTNode
 {
-    std::unique_ptr<ASTNode> expression;
-    int line;
-    ExpressionStatement(std::unique_ptr<ASTNode> e, int l) : expression(std::move(e)), line(l) {}
+    static constexpr NodeKind Kind = NodeKind::ExpressionStatement;
+    ASTNode *expression;
+    ExpressionStatement(ASTNode *e, int l) : ASTNode(Kind, l), expression(e) {}
 };
 
 struct BinaryExpression : ASTNode
 {
-    std::unique_ptr<ASTNode> left;
-    std::string op;
-    std::unique_ptr<ASTNode> right;
-    int line;
-    BinaryExpression(std::unique_ptr<ASTNode> l, std::string o, std::unique_ptr<ASTNode> r, int li)
-        : left(std::move(l)), op(std::move(o)), right(std::move(r)), line(li) {}
+    static constexpr NodeKind Kind = NodeKind::BinaryExpression;
+    TokenKind op;
+    ASTNode *left;
+    ASTNode *right;
+    BinaryExpression(ASTNode *l, TokenKind o, ASTNode *r, int li)
+        : ASTNode(Kind, li), op(o), left(l), right(r) {}
+};
+
+// `name = value` or a compound assignment such as `name += value`. The
+// value of the expression is the value assigned.
+struct AssignmentExpression : ASTNode
+{
+    static constexpr NodeKind Kind = NodeKind::AssignmentExpression;
+    TokenKind op; // Equal, PlusEqual, MinusEqual, StarEqual or SlashEqual
+    Symbol name;
+    Binding binding;
+    ASTNode *value;
+    AssignmentExpression(Symbol n, TokenKind o, ASTNode *v, int l) : ASTNode(Kind, l), op(o), name(n), value(v) {}
+
+    // The arithmetic operator of a compound assignment (Plus for +=), or
+    // Equal for a plain one.
+    TokenKind binaryOperator() const
+    {
+        switch (op)
+        {
+        case TokenKind::PlusEqual:
+            return TokenKind::Plus;
+        case TokenKind::MinusEqual:
+            return TokenKind::Minus;
+        case TokenKind::StarEqual:
+            return TokenKind::Star;
+        case TokenKind::SlashEqual:
+            return TokenKind::Slash;
+        default:
+            return TokenKind::Equal;
+        }
+    }
 };
 
 struct CallExpression : ASTNode
 {
-    std::unique_ptr<ASTNode> callee;
-    std::vector<std::unique_ptr<ASTNode>> arguments;
-    int line;
-    CallExpression(std::unique_ptr<ASTNode> c, std::vector<std::unique_ptr<ASTNode>> a, int l)
-        : callee(std::move(c)), arguments(std::move(a)), line(l) {}
+    static constexpr NodeKind Kind = NodeKind::CallExpression;
+    ASTNode *callee;
+    ArenaList<ASTNode *> arguments;
+    CallExpression(ASTNode *c, ArenaList<ASTNode *> a, int l)
+        : ASTNode(Kind, l), callee(c), arguments(a) {}
+};
+
+// Constant text of a template literal, escapes decoded.
+struct TemplateSegment
+{
+    Symbol text;
+    uint32_t length;
+    TemplateSegment(Symbol t, uint32_t n) : text(t), length(n) {}
 };
 
+// A backtick string with ${} placeholders. segments has one more entry than
+// expressions: segment i comes before expression i, the last one after all
+// of them. Backtick strings without placeholders are LiteralExpressions.
+struct TemplateLiteral : ASTNode
+{
+    static constexpr NodeKind Kind = NodeKind::TemplateLiteral;
+    ArenaList<TemplateSegment> segments;
+    ArenaList<ASTNode *> expressions;
+    uint32_t textLength; // sum of the segment lengths
+    TemplateLiteral(ArenaList<TemplateSegment> s, ArenaList<ASTNode *> e, uint32_t n, int l)
+        : ASTNode(Kind, l), segments(s), expressions(e), textLength(n) {}
+};
+
+// Whether evaluating the checked expression node may assign the local in
+// register slot of its function. Calls cannot, as functions do not see each
+// other's locals. Back ends that read a local operand in place use this to
+// copy it first when a later operand assigns it.
+bool assignsLocal(const ASTNode *node, uint32_t slot);
+
+// Syntax errors never unwind the parser. Each is reported with a code and a
+// span, and the parser enters panic mode: further errors are suppressed
+// and the broken statement is dropped, up to the next ';', the '}' closing
+// the enclosing block, or a keyword that starts a statement. One linear
+// pass therefore yields every independent error in the input.
 class Parser
 {
 public:
+    // Throws std::runtime_error with the first diagnostic when parse() or
+    // parseTopLevelStatement() finishes with errors.
     Parser(Lexer &lex);
+    // Reports into diagnostics and never throws for a syntax error; parse()
+    // returns the statements that parsed cleanly.
+    Parser(Lexer &lex, Diagnostics &diagnostics);
+    // Reads the tokens of tape instead of lexing, in collecting mode. The
+    // lexer's diagnostics kept on the tape are reported as the parser reaches
+    // their tokens, in the order a lexing parse would report them.
+    Parser(const TokenTape &tape, Diagnostics &diagnostics);
     std::unique_ptr<Program> parse();
 
+    // Statement-at-a-time parsing for callers that assemble the program body
+    // themselves (see incremental.hpp). attach() directs new nodes into the
+    // program's arena and interner; parseTopLevelStatement() then parses one
+    // statement.
+    void attach(Program &program);
+    ASTNode *parseTopLevelStatement();
+    // Parses one top-level statement at a time and passes each to
+    // onStatement as the only statement of a Program. The statement and its
+    // symbols are released when the callback returns, and a streaming lexer
+    // may drop the input before the next statement, so memory is bounded by
+    // the largest statement rather than by the input. Returns the number of
+    // statements.
+    size_t parseEach(const std::function<void(Program &)> &onStatement);
+    // The next unconsumed token.
+    const Token &peekToken() const { return currentToken; }
+    // Tokens taken from the lexer so far, for --stats.
+    size_t tokenCount() const { return tokensRead; }
+
 private:
     Lexer &lexer;
+    const TokenTape *tape = nullptr;
+    size_t nextTapeError = 0;
     Token currentToken;
+    Arena *arena = nullptr;
+    Interner *symbols = nullptr;
+    size_t tokensRead = 0;
+    uint32_t previousEnd = 0; // where the last consumed token ends
+    Diagnostics ownDiagnostics;
+    Diagnostics *diagnostics;
+    bool throwOnError;
+    bool panicking = false;
+
+    // Scratch stacks for lists under construction; finished lists are copied
+    // into the arena so no per-list vector outlives the parse.
+    std::vector<ASTNode *> nodeStack;
+    std::vector<VariableDeclarator> declaratorStack;
+    std::vector<Parameter> parameterStack;
+    std::vector<TemplateSegment> segmentStack;
 
     void advance();
-    bool match(const std::string &expected);
-    bool check(const std::string &expected) const;
+    std::string_view currentText() const;
+    Symbol internCurrentText();
+    Symbol internCurrentValue();
+    template <typename T>
+    ArenaList<T> finishList(std::vector<T> &stack, size_t start);
+    template <typename T>
+    T *spanned(T *node, uint32_t start);
+    template <typename T>
+    T *spanned(T *node, const Token &token);
+    bool match(TokenKind expected);
+    bool check(TokenKind expected) const;
     bool checkType(TokenTypeEnum expectedType) const;
-    Token consume(const std::string &expected, const std::string &errorMsg);
-    Token consumeType(TokenTypeEnum expectedType, const std::string &errorMsg);
+    Token consume(TokenKind expected, const char *errorMsg);
+    Token consumeType(TokenTypeEnum expectedType, const char *errorMsg);
+    void error(DiagnosticCode code, std::string message);
+    void errorGot(DiagnosticCode code, const char *expected);
+    void throwIfFailed() const;
+    ASTNode *parseStatementOrRecover();
+    void synchronize(size_t statementStart);
 
     std::unique_ptr<Program> parseProgram();
-    std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<VariableDeclaration> parseVariableDeclaration();
-    std::unique_ptr<FunctionDeclaration> parseFunctionDeclaration();
-    std::unique_ptr<BlockStatement> parseBlockStatement();
-    std::unique_ptr<ASTNode> parseExpressionStatement();
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parseBinaryExpression(int minPrec = 0);
-    std::unique_ptr<ASTNode> parsePrimaryExpression();
-    std::unique_ptr<ASTNode> parseCallExpression(std::unique_ptr<ASTNode> callee);
-    std::vector<std::unique_ptr<ASTNode>> parseArgumentList();
-    std::vector<Parameter> parseParameterList();
-};
\ No newline at end of file
+    ASTNode *parseStatement();
+    VariableDeclaration *parseVariableDeclaration();
+    FunctionDeclaration *parseFunctionDeclaration();
+    BlockStatement *parseBlockStatement();
+    ASTNode *parseExpressionStatement();
+    ASTNode *parseExpression();
+    ASTNode *parseBinaryExpression(int minPrec = 0);
+    ASTNode *parseOperators(ASTNode *left, int minPrec);
+    ASTNode *parsePrimaryExpression();
+    ASTNode *parseTemplateLiteral();
+    ASTNode *parseCallExpression(ASTNode *callee);
+    ArenaList<ASTNode *> parseArgumentList();
+    ArenaList<Parameter> parseParameterList();
+};
@@ -0,0 +1,251 @@
+#include "profile.hpp"
+#include "ast_visitor.hpp"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace profile
+{
+uint64_t now()
+{
+    // Offset by one so that a real timestamp is never mistaken for "not started".
+    return static_cast<uint64_t>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                   .count()) +
+           1;
+}
+
+size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+namespace
+{
+class NodeCounter : public ASTVisitor<NodeCounter, size_t>
+{
+public:
+    size_t visitProgram(const Program *node) { return 1 + list(node->body); }
+    size_t visitLiteralExpression(const LiteralExpression *) { return 1; }
+    size_t visitIdentifierExpression(const IdentifierExpression *) { return 1; }
+    size_t visitVariableDeclaration(const VariableDeclaration *node)
+    {
+        size_t n = 1;
+        for (const VariableDeclarator &decl : node->declarations)
+            n += visit(decl.init);
+        return n;
+    }
+    size_t visitFunctionDeclaration(const FunctionDeclaration *node) { return 1 + visit(node->body); }
+    size_t visitBlockStatement(const BlockStatement *node) { return 1 + list(node->body); }
+    size_t visitReturnStatement(const ReturnStatement *node) { return 1 + (node->argument ? visit(node->argument) : 0); }
+    size_t visitExpressionStatement(const ExpressionStatement *node) { return 1 + visit(node->expression); }
+    size_t visitBinaryExpression(const BinaryExpression *node) { return 1 + visit(node->left) + visit(node->right); }
+    size_t visitAssignmentExpression(const AssignmentExpression *node) { return 1 + visit(node->value); }
+    size_t visitCallExpression(const CallExpression *node) { return 1 + visit(node->callee) + list(node->arguments); }
+    size_t visitTemplateLiteral(const TemplateLiteral *node) { return 1 + list(node->expressions); }
+
+private:
+    size_t list(const ArenaList<ASTNode *> &nodes)
+    {
+        size_t n = 0;
+        for (const ASTNode *node : nodes)
+            n += visit(node);
+        return n;
+    }
+};
+
+struct TraceEvent
+{
+    const char *name;
+    const char *category;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Every recording thread appends to its own buffer; the buffers are owned
+// here so they outlive pool workers and are read once recording is over.
+struct ThreadBuffer
+{
+    uint32_t id;
+    size_t dropped = 0;
+    std::vector<TraceEvent> events;
+};
+
+// About 100 MB of JSON per thread, which is what the trace viewers cope with.
+constexpr size_t MaxSpansPerThread = size_t(1) << 20;
+
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+uint64_t traceStart = 0;
+thread_local ThreadBuffer *threadBuffer = nullptr;
+} // namespace
+
+size_t countNodes(const ASTNode *root) { return NodeCounter().visit(root); }
+
+static void registerThread()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(std::make_unique<ThreadBuffer>());
+    buffers.back()->id = static_cast<uint32_t>(buffers.size() - 1);
+    threadBuffer = buffers.back().get();
+}
+
+// The calling thread becomes thread 0, "main", in the trace.
+void startTrace()
+{
+    if (!threadBuffer)
+        registerThread();
+    traceStart = now();
+    tracing = true;
+}
+
+void record(const char *name, const char *category, uint64_t start, uint64_t end)
+{
+    if (!threadBuffer)
+        registerThread();
+    if (threadBuffer->events.size() >= MaxSpansPerThread)
+    {
+        threadBuffer->dropped++;
+        return;
+    }
+    threadBuffer->events.push_back({name, category, start, end});
+}
+
+bool writeTrace(const std::string &path, size_t &dropped)
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    dropped = 0;
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    std::fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", file);
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : buffers)
+    {
+        dropped += buffer->dropped;
+        std::fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s %u\"}}",
+                     first ? "" : ",\n", buffer->id, buffer->id == 0 ? "main" : "worker", buffer->id);
+        first = false;
+        // Microseconds since startTrace(), with nanosecond precision.
+        for (const TraceEvent &event : buffer->events)
+            std::fprintf(file,
+                         ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, "
+                         "\"dur\": %.3f}",
+                         event.name, event.category, buffer->id, (event.start - traceStart) / 1e3,
+                         (event.end - event.start) / 1e3);
+    }
+    std::fputs("\n]}\n", file);
+    return std::fclose(file) == 0;
+}
+
+Phase &Stats::phase(const char *name)
+{
+    for (Phase &phase : phases)
+        if (std::string_view(phase.name) == name)
+            return phase;
+    phases.push_back(Phase{name});
+    return phases.back();
+}
+
+static std::string formatBytes(uint64_t bytes)
+{
+    char text[32];
+    if (bytes < 1024)
+        std::snprintf(text, sizeof(text), "%llu B", static_cast<unsigned long long>(bytes));
+    else if (bytes < 1024 * 1024)
+        std::snprintf(text, sizeof(text), "%.1f KB", bytes / 1024.0);
+    else
+        std::snprintf(text, sizeof(text), "%.1f MB", bytes / (1024.0 * 1024.0));
+    return text;
+}
+
+static std::string formatCount(size_t count)
+{
+    return count ? std::to_string(count) : "-";
+}
+
+void Stats::report(std::ostream &out) const
+{
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-14s %12s %10s %10s %12s %12s\n", "phase", "time (ms)", "tokens", "nodes",
+                  "allocated", "peak RSS");
+    out << line;
+    uint64_t totalTime = 0, totalBytes = 0;
+    for (const Phase &phase : phases)
+    {
+        totalTime += phase.nanoseconds;
+        totalBytes += phase.bytesAllocated;
+        std::snprintf(line, sizeof(line), "%-14s %12.3f %10s %10s %12s %12s\n", phase.name, phase.nanoseconds / 1e6,
+                      formatCount(phase.tokens).c_str(), formatCount(phase.nodes).c_str(),
+                      formatBytes(phase.bytesAllocated).c_str(),
+                      phase.peakResident ? formatBytes(phase.peakResident).c_str() : "-");
+        out << line;
+    }
+    size_t peak = peakResidentBytes();
+    std::snprintf(line, sizeof(line), "%-14s %12.3f %10s %10s %12s %12s\n", "total", totalTime / 1e6, "", "",
+                  formatBytes(totalBytes).c_str(), peak ? formatBytes(peak).c_str() : "-");
+    out << line;
+    for (const Phase &phase : phases)
+    {
+        if (!phase.bytesWritten || !phase.nanoseconds)
+            continue;
+        std::snprintf(line, sizeof(line), "%s wrote %s at %.1f MB/s\n", phase.name,
+                      formatBytes(phase.bytesWritten).c_str(), phase.bytesWritten * 1e3 / phase.nanoseconds);
+        out << line;
+    }
+}
+
+ScopedPhase::ScopedPhase(Stats &stats, const char *name)
+    : stats(stats), name(name), start(stats.isEnabled() || tracing ? now() : 0), allocatedAtStart(allocatedBytes),
+      parent(stats.active)
+{
+    stats.active = this;
+    if (stats.isEnabled())
+        stats.phase(name);
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    stats.active = parent;
+    if (!start)
+        return;
+    uint64_t end = now();
+    if (tracing)
+        record(name, "phase", start, end);
+    if (!stats.isEnabled())
+        return;
+    uint64_t nanoseconds = end - start;
+    uint64_t bytes = allocatedBytes - allocatedAtStart;
+    if (parent)
+    {
+        parent->childNanoseconds += nanoseconds;
+        parent->childBytes += bytes;
+    }
+    Phase &phase = stats.phase(name);
+    phase.nanoseconds += nanoseconds - childNanoseconds;
+    phase.bytesAllocated += bytes - childBytes;
+    phase.peakResident = peakResidentBytes();
+}
+} // namespace profile
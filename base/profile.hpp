@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Instrumentation behind `--stats` and `--trace`. BASE_TRACE_SCOPE marks a
+// span for the Chrome trace (chrome://tracing, Perfetto) and
+// BASE_COUNT_ALLOCATION feeds the allocation counter. Building with
+// BASE_PROFILE=0 compiles both to nothing and the driver rejects the options.
+//
+// Heap allocations are only counted with BASE_COUNT_HEAP=1, which makes the
+// driver replace the global operator new; otherwise the counter sees arena
+// chunks alone.
+#ifndef BASE_PROFILE
+#define BASE_PROFILE 1
+#endif
+#ifndef BASE_COUNT_HEAP
+#define BASE_COUNT_HEAP 0
+#endif
+
+struct ASTNode;
+
+namespace profile
+{
+constexpr bool Available = BASE_PROFILE != 0;
+
+// Monotonic clock in nanoseconds; never 0.
+uint64_t now();
+
+// Bytes allocated by this thread so far: arena chunks, and operator new in
+// the driver with BASE_COUNT_HEAP. Never decreases, so a phase's share is a difference.
+inline thread_local uint64_t allocatedBytes = 0;
+inline void countAllocation(size_t bytes) { allocatedBytes += bytes; }
+
+// Peak resident set size of the process so far, or 0 where unknown.
+size_t peakResidentBytes();
+
+size_t countNodes(const ASTNode *root);
+
+// Set by startTrace(); spans are only recorded while it is true. Set it
+// before starting threads that record.
+inline bool tracing = false;
+
+void startTrace();
+void record(const char *name, const char *category, uint64_t start, uint64_t end);
+// Writes the recorded spans as trace-event JSON. Returns false if the file
+// cannot be written; dropped is set to the number of spans past the limit.
+bool writeTrace(const std::string &path, size_t &dropped);
+
+class Span
+{
+public:
+    Span(const char *name, const char *category) : name(name), category(category), start(tracing ? now() : 0) {}
+    ~Span()
+    {
+        if (start)
+            record(name, category, start, now());
+    }
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+private:
+    const char *name;
+    const char *category;
+    uint64_t start;
+};
+
+struct Phase
+{
+    const char *name;
+    uint64_t nanoseconds = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    uint64_t bytesAllocated = 0;
+    size_t peakResident = 0;
+    uint64_t bytesWritten = 0; // output of dump phases, reported in MB/s
+};
+
+class ScopedPhase;
+
+// Per-phase totals for --stats. A phase entered more than once (streamed
+// input prints each statement as it is parsed) adds up; phases report in
+// the order they were first entered. Time and allocations of a phase
+// entered inside another count only for the inner one.
+class Stats
+{
+public:
+    explicit Stats(bool enabled) : enabled(enabled) {}
+    bool isEnabled() const { return enabled; }
+    Phase &phase(const char *name);
+    void report(std::ostream &out) const;
+
+private:
+    friend ScopedPhase;
+    bool enabled;
+    std::vector<Phase> phases;
+    ScopedPhase *active = nullptr;
+};
+
+// Times a phase for the stats and as a "phase" span in the trace.
+class ScopedPhase
+{
+public:
+    ScopedPhase(Stats &stats, const char *name);
+    ~ScopedPhase();
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+private:
+    Stats &stats;
+    const char *name;
+    uint64_t start;
+    uint64_t allocatedAtStart;
+    ScopedPhase *parent;
+    uint64_t childNanoseconds = 0;
+    uint64_t childBytes = 0;
+};
+} // namespace profile
+
+#if BASE_PROFILE
+#define BASE_PROFILE_CONCAT2(a, b) a##b
+#define BASE_PROFILE_CONCAT(a, b) BASE_PROFILE_CONCAT2(a, b)
+#define BASE_TRACE_SCOPE(name, category) ::profile::Span BASE_PROFILE_CONCAT(traceSpan, __LINE__)(name, category)
+#define BASE_COUNT_ALLOCATION(bytes) ::profile::countAllocation(bytes)
+#else
+#define BASE_TRACE_SCOPE(name, category) ((void)0)
+#define BASE_COUNT_ALLOCATION(bytes) ((void)0)
+#endif
@@ -0,0 +1,132 @@
+#include "source_buffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceBuffer::~SourceBuffer() { close(); }
+
+SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept { *this = std::move(other); }
+
+SourceBuffer &SourceBuffer::operator=(SourceBuffer &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    close();
+    mapped = other.mapped;
+    length = other.length;
+    storage = std::move(other.storage);
+    contents = mapped ? other.contents : storage.data();
+    other.contents = nullptr;
+    other.length = 0;
+    other.mapped = false;
+    return *this;
+}
+
+bool SourceBuffer::open(const std::string &path)
+{
+    close();
+    return map(path) || read(path);
+}
+
+void SourceBuffer::close()
+{
+#ifndef _WIN32
+    if (mapped && length > 0)
+        munmap(const_cast<char *>(contents), length);
+#endif
+    contents = nullptr;
+    length = 0;
+    mapped = false;
+    storage.clear();
+}
+
+bool SourceBuffer::map(const std::string &path)
+{
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        mapped = true;
+        return true;
+    }
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    contents = static_cast<const char *>(addr);
+    length = static_cast<size_t>(st.st_size);
+    mapped = true;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool SourceBuffer::read(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0)
+    {
+        // Not seekable (a pipe or device): fall back to chunked reads.
+        file.clear();
+        char chunk[1 << 16];
+        while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+            storage.append(chunk, static_cast<size_t>(file.gcount()));
+    }
+    else if (size > 0)
+    {
+        file.seekg(0, std::ios::beg);
+        storage.resize(static_cast<size_t>(size));
+        file.read(&storage[0], size);
+        // Text-mode newline translation can make the read shorter than the file.
+        storage.resize(static_cast<size_t>(file.gcount()));
+    }
+    contents = storage.data();
+    length = storage.size();
+    return true;
+}
+
+SourceStream::SourceStream(std::istream &input, size_t chunkSize) : input(input), chunkSize(chunkSize) {}
+
+bool SourceStream::fill(uint64_t keepFrom)
+{
+    if (ended)
+        return false;
+    size_t drop = keepFrom > start ? static_cast<size_t>(std::min<uint64_t>(keepFrom - start, length)) : 0;
+    if (drop > 0)
+    {
+        std::memmove(buffer.data(), buffer.data() + drop, length - drop);
+        length -= drop;
+        start += drop;
+    }
+    if (buffer.size() < length + chunkSize)
+        buffer.resize(length + chunkSize);
+    input.read(buffer.data() + length, static_cast<std::streamsize>(chunkSize));
+    size_t count = static_cast<size_t>(input.gcount());
+    length += count;
+    if (count == 0)
+        ended = true;
+    return count > 0;
+}
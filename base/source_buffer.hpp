@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only contents of a source file. Where available the file is
+// memory-mapped; otherwise it is loaded with a single bulk read. Lexers
+// borrow the view, so the buffer must outlive them.
+class SourceBuffer
+{
+public:
+    SourceBuffer() = default;
+    ~SourceBuffer();
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    SourceBuffer(SourceBuffer &&other) noexcept;
+    SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+
+    bool open(const std::string &path);
+    void close();
+
+    std::string_view view() const { return std::string_view(contents, length); }
+    size_t size() const { return length; }
+    bool isMapped() const { return mapped; }
+
+private:
+    const char *contents = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::string storage;
+
+    bool map(const std::string &path);
+    bool read(const std::string &path);
+};
+
+// Source text that arrives in pieces, such as a pipe. Only a window of the
+// input is held: the lexer asks for more with fill() and names the first
+// byte it still needs, so memory is bounded by what the reader keeps plus
+// one chunk, not by the size of the input.
+class SourceStream
+{
+public:
+    explicit SourceStream(std::istream &input, size_t chunkSize = 64 * 1024);
+    SourceStream(const SourceStream &) = delete;
+    SourceStream &operator=(const SourceStream &) = delete;
+
+    // The bytes held, and the offset of the first one in the whole input.
+    std::string_view window() const { return std::string_view(buffer.data(), length); }
+    uint64_t windowStart() const { return start; }
+
+    // Drops the bytes before input offset keepFrom and appends the next
+    // chunk. The window may move, even when nothing is dropped. Returns
+    // false at end of input.
+    bool fill(uint64_t keepFrom);
+    bool atEnd() const { return ended; }
+
+    // Total bytes read so far.
+    uint64_t bytesRead() const { return start + length; }
+
+private:
+    std::istream &input;
+    size_t chunkSize;
+    std::vector<char> buffer;
+    size_t length = 0;
+    uint64_t start = 0;
+    bool ended = false;
+};
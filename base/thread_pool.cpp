@@ -0,0 +1,130 @@
+#include "thread_pool.hpp"
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (size_t i = 0; i < threads; i++)
+        workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 1; i < threads; i++)
+        this->threads.emplace_back(&WorkStealingPool::threadMain, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)> &task)
+{
+    {
+        // A worker that woke too late for the previous batch may still be
+        // looking for work; wait for it before refilling the deques.
+        std::unique_lock<std::mutex> lock(stateMutex);
+        idle.wait(lock, [&] { return busy == 0; });
+        size_t n = workers.size();
+        for (size_t w = 0; w < n; w++)
+        {
+            std::lock_guard<std::mutex> dequeLock(workers[w]->mutex);
+            for (size_t i = w * count / n; i < (w + 1) * count / n; i++)
+                workers[w]->tasks.push_back(i);
+        }
+        currentTask = &task;
+        firstError = nullptr;
+        generation++;
+    }
+    wake.notify_all();
+
+    work(0, task);
+
+    std::exception_ptr error;
+    {
+        // Deques only shrink during a batch, so once the caller finds them all
+        // empty every task has been claimed; wait for the claimed ones.
+        std::unique_lock<std::mutex> lock(stateMutex);
+        idle.wait(lock, [&] { return busy == 0; });
+        currentTask = nullptr;
+        error = firstError;
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void WorkStealingPool::threadMain(size_t index)
+{
+    size_t seen = 0;
+    for (;;)
+    {
+        const std::function<void(size_t)> *task;
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            task = currentTask;
+            if (!task)
+                continue;
+            busy++;
+        }
+        work(index, *task);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            busy--;
+        }
+        idle.notify_all();
+    }
+}
+
+void WorkStealingPool::work(size_t index, const std::function<void(size_t)> &task)
+{
+    size_t next;
+    while (take(index, next) || steal(index, next))
+    {
+        try
+        {
+            task(next);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (!firstError)
+                firstError = std::current_exception();
+        }
+    }
+}
+
+bool WorkStealingPool::take(size_t index, size_t &task)
+{
+    Worker &worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    task = worker.tasks.back();
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t index, size_t &task)
+{
+    size_t n = workers.size();
+    for (size_t i = 1; i < n; i++)
+    {
+        Worker &victim = *workers[(index + i) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
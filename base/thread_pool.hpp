@@ -0,0 +1,55 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs batches of independent tasks on a fixed set of threads. Each worker
+// owns a deque of task indices: it takes work from the back of its own deque
+// and, once that is empty, steals from the front of the others', so workers
+// that draw short tasks keep busy until the whole batch is done.
+class WorkStealingPool
+{
+public:
+    // threads == 0 uses one thread per hardware core.
+    explicit WorkStealingPool(size_t threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    size_t threadCount() const { return workers.size(); }
+
+    // Calls task(i) for every i in [0, count) and returns once all calls have
+    // finished. The calling thread works as one of the workers. If tasks
+    // throw, the first exception is rethrown after the batch has finished.
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers; // workers[0] is the caller
+    std::vector<std::thread> threads;
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    const std::function<void(size_t)> *currentTask = nullptr;
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    std::exception_ptr firstError;
+
+    void threadMain(size_t index);
+    void work(size_t index, const std::function<void(size_t)> &task);
+    bool take(size_t index, size_t &task);
+    bool steal(size_t index, size_t &task);
+};
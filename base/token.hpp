@@ -1,18 +1,122 @@
 #pragma once
 
-#include <string>
+#include <cstdint>
 
-enum class TokenTypeEnum {
+enum class TokenTypeEnum : uint8_t {
     Identifier,
-    TemplateLiteral,
+    Keyword,
     Number,
     String,
-    Keyword,
+    TemplateLiteral,
     Symbol,
     EndOfFile
 };
+
+// Every keyword and operator has its own TokenKind so the parser compares
+// integers rather than strings. The lists below are the single source of
+// truth for the kind enum and for tokenKindSpelling().
+#define BASE_KEYWORDS(X)          \
+    X(KwLet, "let")               \
+    X(KwConst, "const")           \
+    X(KwFunction, "function")     \
+    X(KwReturn, "return")         \
+    X(KwNumber, "number")         \
+    X(KwString, "string")         \
+    X(KwVoid, "void")             \
+    X(KwIf, "if")                 \
+    X(KwElse, "else")             \
+    X(KwFor, "for")               \
+    X(KwWhile, "while")           \
+    X(KwBreak, "break")           \
+    X(KwContinue, "continue")     \
+    X(KwPrint, "print")
+
+#define BASE_OPERATORS(X)         \
+    X(EqualEqual, "==")           \
+    X(BangEqual, "!=")            \
+    X(LessEqual, "<=")            \
+    X(GreaterEqual, ">=")         \
+    X(PlusEqual, "+=")            \
+    X(MinusEqual, "-=")           \
+    X(StarEqual, "*=")            \
+    X(SlashEqual, "/=")           \
+    X(PlusPlus, "++")             \
+    X(MinusMinus, "--")           \
+    X(LParen, "(")                \
+    X(RParen, ")")                \
+    X(LBrace, "{")                \
+    X(RBrace, "}")                \
+    X(LBracket, "[")              \
+    X(RBracket, "]")              \
+    X(Comma, ",")                 \
+    X(Semicolon, ";")             \
+    X(Colon, ":")                 \
+    X(Dot, ".")                   \
+    X(Plus, "+")                  \
+    X(Minus, "-")                 \
+    X(Star, "*")                  \
+    X(Slash, "/")                 \
+    X(Percent, "%")               \
+    X(Equal, "=")                 \
+    X(Less, "<")                  \
+    X(Greater, ">")               \
+    X(Bang, "!")                  \
+    X(Question, "?")
+
+enum class TokenKind : uint8_t {
+    Identifier,
+    Number,
+    String,
+    TemplateLiteral,
+    Symbol, // any other single character
+    EndOfFile,
+#define BASE_TOKEN_KIND(name, text) name,
+    BASE_KEYWORDS(BASE_TOKEN_KIND)
+    BASE_OPERATORS(BASE_TOKEN_KIND)
+#undef BASE_TOKEN_KIND
+};
+
+inline const char *tokenKindSpelling(TokenKind kind) {
+    switch (kind) {
+#define BASE_TOKEN_KIND(name, text) case TokenKind::name: return text;
+        BASE_KEYWORDS(BASE_TOKEN_KIND)
+        BASE_OPERATORS(BASE_TOKEN_KIND)
+#undef BASE_TOKEN_KIND
+        case TokenKind::Identifier: return "identifier";
+        case TokenKind::Number: return "number literal";
+        case TokenKind::String: return "string literal";
+        case TokenKind::TemplateLiteral: return "template literal";
+        case TokenKind::Symbol: return "symbol";
+        case TokenKind::EndOfFile: return "end of file";
+    }
+    return "?";
+}
+
+enum TokenFlags : uint8_t {
+    TokenHasEscapes = 1 << 0,
+    // How a number token is spelled, so Lexer::numberValue() can pick the
+    // cheapest exact conversion. A plain decimal integer has none of these.
+    TokenNumberHex = 1 << 1,        // 0x prefix
+    TokenNumberFraction = 1 << 2,   // '.' or an exponent
+    TokenNumberSeparators = 1 << 3  // '_' between digits
+};
+
+// A token does not own its text: offset/length point back into the lexer's
+// source. String and template tokens span their contents without the quotes
+// and only need decoding when TokenHasEscapes is set.
 struct Token {
-    TokenTypeEnum type;
-    std::string value;
-    int line;
-};
\ No newline at end of file
+    TokenTypeEnum type = TokenTypeEnum::EndOfFile;
+    TokenKind kind = TokenKind::EndOfFile;
+    uint8_t flags = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    int line = 0;
+};
+static_assert(sizeof(Token) <= 16, "Token should stay compact");
+
+// The source text of a token, quotes included.
+inline bool tokenQuoted(const Token &token) {
+    return token.type == TokenTypeEnum::String || token.type == TokenTypeEnum::TemplateLiteral;
+}
+inline uint32_t tokenStart(const Token &token) { return tokenQuoted(token) ? token.offset - 1 : token.offset; }
+inline uint32_t tokenEnd(const Token &token) { return token.offset + token.length + (tokenQuoted(token) ? 1 : 0); }
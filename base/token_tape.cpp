@@ -0,0 +1,41 @@
+#include "token_tape.hpp"
+#include "output_buffer.hpp"
+#include "profile.hpp"
+#include <string_view>
+
+TokenTape::TokenTape(Lexer &lexer) : source(&lexer)
+{
+    BASE_TRACE_SCOPE("TokenTape::TokenTape", "lexer");
+    Diagnostics diagnostics;
+    lexer.setDiagnostics(&diagnostics);
+    tokens.reserve(4096);
+    do
+    {
+        tokens.push_back(lexer.nextToken());
+        for (size_t i = lexErrors.size(); i < diagnostics.size(); i++)
+            lexErrors.push_back({tokens.size() - 1, diagnostics.all()[i]});
+    } while (tokens.back().type != TokenTypeEnum::EndOfFile);
+    lexer.setDiagnostics(nullptr);
+}
+
+uint64_t TokenTape::dump(std::ostream &stream) const
+{
+    OutputBuffer out(stream);
+    for (const Token &token : tokens)
+    {
+        out.append("Token: type=");
+        out.appendInt(static_cast<int>(token.type));
+        out.append(", value='");
+        std::string_view text = source->text(token);
+        if (token.flags & TokenHasEscapes)
+            out.append(Lexer::decodeEscapes(text));
+        else
+            out.append(text);
+        out.append("', line=");
+        out.appendInt(token.line);
+        out.put('\n');
+        out.flushIfFull();
+    }
+    out.flush();
+    return out.bytesWritten();
+}
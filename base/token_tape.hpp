@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "diagnostics.hpp"
+#include "lexer.hpp"
+
+// Every token of an in-memory source, lexed in one pass into contiguous
+// storage. The token dump prints it and the parser reads it in place of the
+// lexer, so a file that is both dumped and parsed is lexed only once.
+class TokenTape
+{
+public:
+    // A diagnostic of the lexer and the index of the token it was reported
+    // for, so the parser can report it when it reaches that token.
+    struct LexError
+    {
+        size_t token;
+        Diagnostic diagnostic;
+    };
+
+    // Lexes what is left of lexer's input, through EndOfFile. Malformed
+    // tokens never throw: they are lexed as the nearest well-formed token
+    // and their diagnostics are kept in errors(). The lexer must outlive the
+    // tape; it supplies the tokens' text.
+    explicit TokenTape(Lexer &lexer);
+
+    Lexer &lexer() const { return *source; }
+    size_t size() const { return tokens.size(); }
+    const Token &operator[](size_t i) const { return tokens[i]; }
+    const Token *begin() const { return tokens.data(); }
+    const Token *end() const { return tokens.data() + tokens.size(); }
+    const std::vector<LexError> &errors() const { return lexErrors; }
+
+    // Writes one "Token: type=..., value='...', line=..." line per token
+    // through an OutputBuffer, so out sees a few large writes. Returns the
+    // number of bytes written.
+    uint64_t dump(std::ostream &out) const;
+
+private:
+    Lexer *source;
+    std::vector<Token> tokens;
+    std::vector<LexError> lexErrors;
+};
@@ -0,0 +1,32 @@
+#include "value.hpp"
+#include <cmath>
+#include <cstdio>
+
+size_t formatNumber(double value, char *buffer)
+{
+    const char *special = nullptr;
+    if (std::isnan(value))
+        special = "NaN";
+    else if (std::isinf(value))
+        special = value > 0 ? "Infinity" : "-Infinity";
+    else if (value == 0)
+        special = "0"; // also for -0
+    if (special)
+    {
+        size_t length = std::strlen(special);
+        std::memcpy(buffer, special, length + 1);
+        return length;
+    }
+    int length;
+    if (value == std::trunc(value) && std::fabs(value) < 1e15)
+        length = std::snprintf(buffer, NumberBufferSize, "%.0f", value);
+    else
+        length = std::snprintf(buffer, NumberBufferSize, "%.15g", value);
+    return static_cast<size_t>(length);
+}
+
+std::string formatNumber(double value)
+{
+    char buffer[NumberBufferSize];
+    return std::string(buffer, formatNumber(value, buffer));
+}
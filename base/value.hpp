@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+
+// Immutable, reference-counted string used by the VM. The characters follow
+// the header in the same allocation.
+struct StringObject
+{
+    uint32_t refCount;
+    uint32_t length;
+    char chars[1];
+
+    std::string_view view() const { return std::string_view(chars, length); }
+
+    // Returns a string with refCount 1 and uninitialized contents.
+    static StringObject *allocate(size_t length)
+    {
+        auto *str = static_cast<StringObject *>(std::malloc(offsetof(StringObject, chars) + length + 1));
+        if (!str)
+            throw std::bad_alloc();
+        str->refCount = 1;
+        str->length = static_cast<uint32_t>(length);
+        str->chars[length] = '\0';
+        return str;
+    }
+
+    static StringObject *create(std::string_view text)
+    {
+        StringObject *str = allocate(text.size());
+        if (!text.empty())
+            std::memcpy(str->chars, text.data(), text.size());
+        return str;
+    }
+};
+
+inline void retain(StringObject *str) { str->refCount++; }
+
+inline void release(StringObject *str)
+{
+    if (--str->refCount == 0)
+        std::free(str);
+}
+
+enum class ValueType : uint8_t
+{
+    Void,
+    Number,
+    String
+};
+
+// A VM value. Copies are shallow; ownership of string references is managed
+// explicitly by the VM through retain()/release().
+struct Value
+{
+    ValueType type;
+    union
+    {
+        double number;
+        StringObject *string;
+    };
+
+    Value() : type(ValueType::Void), number(0) {}
+    static Value fromNumber(double n)
+    {
+        Value v;
+        v.type = ValueType::Number;
+        v.number = n;
+        return v;
+    }
+    static Value fromString(StringObject *s)
+    {
+        Value v;
+        v.type = ValueType::String;
+        v.string = s;
+        return v;
+    }
+
+    bool isNumber() const { return type == ValueType::Number; }
+    bool isString() const { return type == ValueType::String; }
+};
+
+// Formats a number the way print() and string concatenation show it:
+// integers without a fraction, other values with up to 15 significant digits.
+// The buffer form writes at most NumberBufferSize bytes and returns the length.
+constexpr size_t NumberBufferSize = 32;
+size_t formatNumber(double value, char *buffer);
+std::string formatNumber(double value);
@@ -0,0 +1,443 @@
+#include "vm.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// GCC and Clang dispatch through a table of label addresses, which gives
+// every opcode its own indirect branch; other compilers use a switch.
+// Define BASE_VM_SWITCH_DISPATCH to force the switch.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(BASE_VM_SWITCH_DISPATCH)
+#define BASE_VM_COMPUTED_GOTO 1
+#endif
+
+namespace {
+
+inline void setNumber(Value &dst, double number)
+{
+    if (dst.isString())
+        release(dst.string);
+    dst.type = ValueType::Number;
+    dst.number = number;
+}
+
+inline void setValue(Value &dst, const Value &src)
+{
+    if (src.isString())
+        retain(src.string);
+    if (dst.isString())
+        release(dst.string);
+    dst = src;
+}
+
+// Takes over a reference the caller already holds.
+inline void moveValue(Value &dst, Value src)
+{
+    if (dst.isString())
+        release(dst.string);
+    dst = src;
+}
+
+inline void clearValue(Value &value)
+{
+    if (value.isString())
+        release(value.string);
+    value.type = ValueType::Void;
+}
+
+// Text of a value as print() shows it; numbers are formatted into buffer,
+// which must hold NumberBufferSize bytes.
+std::string_view valueText(const Value &value, char *buffer)
+{
+    switch (value.type)
+    {
+    case ValueType::String:
+        return value.string->view();
+    case ValueType::Number:
+        return std::string_view(buffer, formatNumber(value.number, buffer));
+    default:
+        return "void";
+    }
+}
+
+const char *operatorSpelling(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::Add:
+    case Opcode::AddK:
+    case Opcode::Concat:
+        return "+";
+    case Opcode::Sub:
+    case Opcode::SubK:
+        return "-";
+    case Opcode::Mul:
+    case Opcode::MulK:
+        return "*";
+    case Opcode::Eq:
+        return "==";
+    case Opcode::Ne:
+        return "!=";
+    case Opcode::Lt:
+        return "<";
+    case Opcode::Le:
+        return "<=";
+    case Opcode::Gt:
+        return ">";
+    case Opcode::Ge:
+        return ">=";
+    default:
+        return "/";
+    }
+}
+
+} // namespace
+
+VM::VM(const Module &module, std::FILE *output, const NativeCode *native)
+    : module(module), output(output), native(native), nativeEnabled(native && native->functionCount() > 0),
+      stack(StackSize), globals(module.globalNames.size())
+{
+    outputBuffer.reserve(OutputBufferSize);
+    frames.reserve(64);
+}
+
+VM::~VM()
+{
+    flush();
+    for (Value &value : stack)
+        clearValue(value);
+    for (Value &value : globals)
+        clearValue(value);
+}
+
+void VM::flush()
+{
+    if (!outputBuffer.empty())
+    {
+        std::fwrite(outputBuffer.data(), 1, outputBuffer.size(), output);
+        outputBuffer.clear();
+    }
+    std::fflush(output);
+}
+
+void VM::error(const Function *function, const Instruction *ip, const std::string &message)
+{
+    flush();
+    int line = function->lines[ip - 1 - function->code.data()];
+    throw std::runtime_error("Runtime error at line " + std::to_string(line) + ": " + message);
+}
+
+void VM::print(const Value &value)
+{
+    char buffer[NumberBufferSize];
+    std::string_view text = valueText(value, buffer);
+    outputBuffer.append(text.data(), text.size());
+    outputBuffer.push_back('\n');
+    if (outputBuffer.size() >= OutputBufferSize)
+        flush();
+}
+
+void VM::arithmetic(Opcode op, Value &dst, const Value &x, const Value &y, const Function *function, const Instruction *ip)
+{
+    if (x.type == ValueType::Void || y.type == ValueType::Void)
+        error(function, ip, std::string("Void value used as an operand of '") + operatorSpelling(op) + "'");
+    if (op != Opcode::Add && op != Opcode::AddK && op != Opcode::Concat)
+        error(function, ip, std::string("Operands of '") + operatorSpelling(op) + "' must be numbers");
+    concatenate(dst, x, y);
+}
+
+// One allocation of the exact result size.
+void VM::concatenate(Value &dst, const Value &x, const Value &y)
+{
+    char leftBuffer[NumberBufferSize], rightBuffer[NumberBufferSize];
+    std::string_view left = valueText(x, leftBuffer);
+    std::string_view right = valueText(y, rightBuffer);
+    StringObject *result = StringObject::allocate(left.size() + right.size());
+    std::memcpy(result->chars, left.data(), left.size());
+    std::memcpy(result->chars + left.size(), right.data(), right.size());
+    moveValue(dst, Value::fromString(result));
+}
+
+// Comparisons that are not of two numbers. Strings compare bytewise; a
+// string and a number are never equal and cannot be ordered.
+void VM::compare(Opcode op, Value &dst, const Value &x, const Value &y, const Function *function, const Instruction *ip)
+{
+    if (x.type == ValueType::Void || y.type == ValueType::Void)
+        error(function, ip, std::string("Void value used as an operand of '") + operatorSpelling(op) + "'");
+    bool holds;
+    if (x.type != y.type)
+    {
+        if (op != Opcode::Eq && op != Opcode::Ne)
+            error(function, ip, std::string("Operands of '") + operatorSpelling(op) + "' must be two numbers or two strings");
+        holds = op == Opcode::Ne;
+    }
+    else
+    {
+        int order = x.string->view().compare(y.string->view());
+        switch (op)
+        {
+        case Opcode::Eq:
+            holds = order == 0;
+            break;
+        case Opcode::Ne:
+            holds = order != 0;
+            break;
+        case Opcode::Lt:
+            holds = order < 0;
+            break;
+        case Opcode::Le:
+            holds = order <= 0;
+            break;
+        case Opcode::Gt:
+            holds = order > 0;
+            break;
+        default:
+            holds = order >= 0;
+            break;
+        }
+    }
+    setNumber(dst, holds ? 1 : 0);
+}
+
+void VM::renderTemplate(const Template &info, Value *values)
+{
+    // Measure every part first so the result is allocated once, at its
+    // exact size, and filled in a single pass.
+    size_t count = info.segmentLengths.size() - 1;
+    if (templateParts.size() < count)
+    {
+        templateParts.resize(count);
+        numberText.resize(count * NumberBufferSize);
+    }
+    size_t length = info.text.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        templateParts[i] = valueText(values[i], &numberText[i * NumberBufferSize]);
+        length += templateParts[i].size();
+    }
+    StringObject *result = StringObject::allocate(length);
+    char *out = result->chars;
+    const char *text = info.text.data();
+    for (size_t i = 0;; i++)
+    {
+        std::memcpy(out, text, info.segmentLengths[i]);
+        out += info.segmentLengths[i];
+        text += info.segmentLengths[i];
+        if (i == count)
+            break;
+        std::memcpy(out, templateParts[i].data(), templateParts[i].size());
+        out += templateParts[i].size();
+    }
+    moveValue(values[0], Value::fromString(result));
+}
+
+// Runs the call of function index whose arguments start at base in native
+// code, if it has some and they are all numbers, leaving the result in
+// base[0] as a returning call would. The stack budget is what the VM's own
+// limits leave; native code that runs out gives up, and is not used again,
+// so that the call is redone here and fails as the VM fails.
+bool VM::callNative(uint32_t index, Value *base)
+{
+    const void *code = native->function(index);
+    if (!code)
+        return false;
+    const Function &callee = module.functions[index];
+    double args[NativeCode::MaxParams] = {};
+    for (uint32_t i = 0; i < callee.numParams; i++)
+    {
+        if (!base[i].isNumber())
+            return false;
+        args[i] = base[i].number;
+    }
+    size_t registersLeft = static_cast<size_t>(stack.data() + stack.size() - base);
+    size_t callsLeft = MaxCallDepth - frames.size();
+    size_t budget = std::min(registersLeft * NativeCode::BytesPerRegister, callsLeft * NativeCode::BytesPerCall);
+    double result;
+    if (!native->call(code, args, &result, budget))
+    {
+        nativeEnabled = false;
+        return false;
+    }
+    setNumber(base[0], result);
+    for (uint32_t i = 1; i < callee.numParams; i++)
+        clearValue(base[i]);
+    return true;
+}
+
+void VM::run()
+{
+    const Value *constants = module.constants.data();
+    const Function *fn = &module.functions[Module::MainFunction];
+    const Instruction *ip = fn->code.data();
+    Value *regs = stack.data();
+    Value *stackEnd = stack.data() + stack.size();
+    Instruction ins;
+    Value result;
+
+#ifdef BASE_VM_COMPUTED_GOTO
+    static const void *const dispatchTable[] = {
+#define BASE_OPCODE_LABEL(name) &&op_##name,
+        BASE_OPCODES(BASE_OPCODE_LABEL)
+#undef BASE_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH()                                      \
+    do                                                     \
+    {                                                      \
+        ins = *ip++;                                       \
+        goto *dispatchTable[static_cast<uint8_t>(ins.op)]; \
+    } while (0)
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+#define VM_ARITHMETIC(name, op, rhs)                                          \
+    VM_CASE(name)                                                             \
+    {                                                                         \
+        const Value &x = regs[ins.b];                                         \
+        const Value &y = rhs;                                                 \
+        if (x.isNumber() && y.isNumber())                                     \
+            setNumber(regs[ins.a], x.number op y.number);                     \
+        else                                                                  \
+            arithmetic(Opcode::name, regs[ins.a], x, y, fn, ip);              \
+        VM_DISPATCH();                                                        \
+    }
+
+#define VM_COMPARE(name, op)                                                  \
+    VM_CASE(name)                                                             \
+    {                                                                         \
+        const Value &x = regs[ins.b];                                         \
+        const Value &y = regs[ins.c];                                         \
+        if (x.isNumber() && y.isNumber())                                     \
+            setNumber(regs[ins.a], x.number op y.number ? 1 : 0);             \
+        else                                                                  \
+            compare(Opcode::name, regs[ins.a], x, y, fn, ip);                 \
+        VM_DISPATCH();                                                        \
+    }
+
+#ifdef BASE_VM_COMPUTED_GOTO
+    VM_DISPATCH();
+#else
+dispatch:
+    ins = *ip++;
+    switch (ins.op)
+    {
+#endif
+    VM_CASE(LoadK)
+    {
+        setValue(regs[ins.a], constants[ins.bx()]);
+        VM_DISPATCH();
+    }
+    VM_CASE(LoadVoid)
+    {
+        clearValue(regs[ins.a]);
+        VM_DISPATCH();
+    }
+    VM_CASE(Move)
+    {
+        setValue(regs[ins.a], regs[ins.b]);
+        VM_DISPATCH();
+    }
+    VM_CASE(GetGlobal)
+    {
+        // A global is only void until its declaration has run.
+        const Value &global = globals[ins.bx()];
+        if (global.type == ValueType::Void)
+            error(fn, ip, "Global '" + module.globalNames[ins.bx()] + "' is used before its declaration has run");
+        setValue(regs[ins.a], global);
+        VM_DISPATCH();
+    }
+    VM_CASE(SetGlobal)
+    {
+        setValue(globals[ins.bx()], regs[ins.a]);
+        VM_DISPATCH();
+    }
+    VM_ARITHMETIC(Add, +, regs[ins.c])
+    VM_ARITHMETIC(Sub, -, regs[ins.c])
+    VM_ARITHMETIC(Mul, *, regs[ins.c])
+    VM_ARITHMETIC(Div, /, regs[ins.c])
+    VM_ARITHMETIC(AddK, +, constants[ins.c])
+    VM_ARITHMETIC(SubK, -, constants[ins.c])
+    VM_ARITHMETIC(MulK, *, constants[ins.c])
+    VM_ARITHMETIC(DivK, /, constants[ins.c])
+    VM_CASE(Concat)
+    {
+        // The Checker proved one side a string; only a global read before
+        // its declaration can still be void.
+        const Value &x = regs[ins.b];
+        const Value &y = regs[ins.c];
+        if (x.type != ValueType::Void && y.type != ValueType::Void)
+            concatenate(regs[ins.a], x, y);
+        else
+            arithmetic(Opcode::Concat, regs[ins.a], x, y, fn, ip);
+        VM_DISPATCH();
+    }
+    VM_COMPARE(Eq, ==)
+    VM_COMPARE(Ne, !=)
+    VM_COMPARE(Lt, <)
+    VM_COMPARE(Le, <=)
+    VM_COMPARE(Gt, >)
+    VM_COMPARE(Ge, >=)
+    VM_CASE(Call)
+    {
+        const Function *callee = &module.functions[ins.bx()];
+        Value *base = regs + ins.a;
+        if (base + callee->numRegisters > stackEnd || frames.size() >= MaxCallDepth)
+            error(fn, ip, "Stack overflow in call to '" + callee->name + "'");
+        if (nativeEnabled && callNative(ins.bx(), base))
+            VM_DISPATCH();
+        frames.push_back({fn, ip, regs});
+        fn = callee;
+        ip = callee->code.data();
+        regs = base;
+        VM_DISPATCH();
+    }
+    VM_CASE(Template)
+    {
+        renderTemplate(module.templates[ins.bx()], regs + ins.a);
+        VM_DISPATCH();
+    }
+    VM_CASE(Print)
+    {
+        print(regs[ins.a]);
+        VM_DISPATCH();
+    }
+    VM_CASE(Return)
+    {
+        // Keep the result alive while the frame's registers are cleared.
+        result = regs[ins.a];
+        if (result.isString())
+            retain(result.string);
+        goto doReturn;
+    }
+    VM_CASE(ReturnVoid)
+    {
+        result = Value();
+        goto doReturn;
+    }
+#ifndef BASE_VM_COMPUTED_GOTO
+    }
+#endif
+
+doReturn:
+    // Registers above the active frame are always void, so a callee never
+    // sees stale strings from an earlier call.
+    for (uint32_t i = 0; i < fn->numRegisters; i++)
+        clearValue(regs[i]);
+    if (frames.empty())
+    {
+        clearValue(result);
+        flush();
+        return;
+    }
+    regs[0] = result;
+    fn = frames.back().function;
+    ip = frames.back().ip;
+    regs = frames.back().base;
+    frames.pop_back();
+    VM_DISPATCH();
+
+#undef VM_COMPARE
+#undef VM_ARITHMETIC
+#undef VM_DISPATCH
+#undef VM_CASE
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bytecode.hpp"
+#include "jit.hpp"
+
+// Executes a compiled Module. Registers of all active calls share one stack:
+// a call's arguments are the caller's top registers and become the callee's
+// first registers, so calls copy nothing. print() output is buffered and
+// written to the output stream in large blocks. Functions that have native
+// code run as such when called with numbers.
+class VM
+{
+public:
+    explicit VM(const Module &module, std::FILE *output = stdout, const NativeCode *native = nullptr);
+    ~VM();
+    VM(const VM &) = delete;
+    VM &operator=(const VM &) = delete;
+
+    // Runs the top-level code. Throws std::runtime_error on runtime errors,
+    // after flushing the output produced so far.
+    void run();
+
+    static constexpr size_t StackSize = 1 << 18; // registers
+    static constexpr size_t MaxCallDepth = 1 << 16;
+
+private:
+    struct Frame
+    {
+        const Function *function;
+        const Instruction *ip;
+        Value *base;
+    };
+
+    const Module &module;
+    std::FILE *output;
+    const NativeCode *native;
+    bool nativeEnabled;
+    std::string outputBuffer;
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+    std::vector<Frame> frames;
+    std::vector<std::string_view> templateParts;
+    std::vector<char> numberText;
+
+    static constexpr size_t OutputBufferSize = 64 * 1024;
+
+    [[noreturn]] void error(const Function *function, const Instruction *ip, const std::string &message);
+    void arithmetic(Opcode op, Value &dst, const Value &x, const Value &y, const Function *function, const Instruction *ip);
+    void concatenate(Value &dst, const Value &x, const Value &y);
+    void compare(Opcode op, Value &dst, const Value &x, const Value &y, const Function *function, const Instruction *ip);
+    void renderTemplate(const Template &info, Value *values);
+    bool callNative(uint32_t index, Value *base);
+    void print(const Value &value);
+    void flush();
+};
@@ -0,0 +1,91 @@
+// Cold and warm start on a generated program, or on a file given as the
+// first argument: a full parse, loading the tree from its cached image, and
+// the lookup that `base check` does on a hit.
+//
+//   cmake --build build --target ast_cache_bench
+#include "ast_cache.hpp"
+#include "source_buffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static std::string makeProgram(size_t bytes)
+{
+    static const char *snippet =
+        "const string name = \"Mark\";\n"
+        "let number age = 14, number height = 180;\n"
+        "function number add(number a, number b) {\n"
+        "  return a + b * a - b / 2;\n"
+        "}\n"
+        "function void greet(string name, string surname, number age) {\n"
+        "  print(`${name} is ${age}`);\n"
+        "  return;\n"
+        "}\n"
+        "greet(name, \"Rober\", add(age, 1));\n";
+    std::string src;
+    src.reserve(bytes + 512);
+    while (src.size() < bytes)
+        src += snippet;
+    return src;
+}
+
+template <typename F>
+static double bestOf(F f)
+{
+    double best = 1e300;
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    SourceBuffer file;
+    std::string generated;
+    std::string_view src;
+    if (argc > 1)
+    {
+        if (!file.open(argv[1]))
+        {
+            std::fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+        src = file.view();
+    }
+    else
+    {
+        generated = makeProgram(8 << 20);
+        src = generated;
+    }
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "base-cache-bench";
+    AstCache cache(dir, "bench");
+    {
+        Lexer lexer(src);
+        Parser parser(lexer);
+        cache.store(src, *parser.parse());
+    }
+
+    double parse = bestOf([&] {
+        Lexer lexer(src);
+        Parser parser(lexer);
+        parser.parse();
+    });
+    double load = bestOf([&] {
+        if (!cache.load(src))
+            std::fprintf(stderr, "cache miss\n");
+    });
+    double lookup = bestOf([&] { cache.contains(src); });
+    double hash = bestOf([&] { hashBytes(src); });
+    std::printf("%.1f MB source: parse %.2f ms  load %.2f ms  lookup %.2f ms  (hash %.2f ms)\n", src.size() / 1e6,
+                parse, load, lookup, hash);
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    return 0;
+}
@@ -0,0 +1,401 @@
+#include "corpus.hpp"
+#include <cstdio>
+
+static const char *const Words[] = {
+    "total", "count", "index", "price", "amount", "width", "height", "offset", "scale", "ratio",
+    "name",  "label", "title", "user",  "order",  "item",  "value",  "limit",  "delta", "result"};
+static const size_t WordCount = sizeof(Words) / sizeof(Words[0]);
+static const size_t MaxNames = 1024;
+
+const char *corpusKindName(CorpusKind kind)
+{
+    switch (kind)
+    {
+    case CorpusKind::Declarations:
+        return "declarations";
+    case CorpusKind::Expressions:
+        return "expressions";
+    case CorpusKind::Templates:
+        return "templates";
+    case CorpusKind::Comments:
+        return "comments";
+    case CorpusKind::Numbers:
+        return "numbers";
+    case CorpusKind::Mixed:
+        return "mixed";
+    }
+    return "?";
+}
+
+const std::vector<CorpusKind> &allCorpusKinds()
+{
+    static const std::vector<CorpusKind> kinds = {CorpusKind::Declarations, CorpusKind::Expressions,
+                                                  CorpusKind::Templates, CorpusKind::Comments, CorpusKind::Numbers,
+                                                  CorpusKind::Mixed};
+    return kinds;
+}
+
+bool parseCorpusKind(std::string_view name, CorpusKind &kind)
+{
+    for (CorpusKind candidate : allCorpusKinds())
+        if (name == corpusKindName(candidate))
+        {
+            kind = candidate;
+            return true;
+        }
+    return false;
+}
+
+bool parseByteSize(std::string_view text, size_t &bytes)
+{
+    size_t value = 0, i = 0;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++)
+        value = value * 10 + static_cast<size_t>(text[i] - '0');
+    if (i == 0)
+        return false;
+    std::string_view suffix = text.substr(i);
+    if (suffix == "K" || suffix == "k")
+        value <<= 10;
+    else if (suffix == "M" || suffix == "m")
+        value <<= 20;
+    else if (suffix == "G" || suffix == "g")
+        value <<= 30;
+    else if (!suffix.empty())
+        return false;
+    bytes = value;
+    return true;
+}
+
+std::string formatByteSize(size_t bytes)
+{
+    static const char Suffixes[] = {'G', 'M', 'K'};
+    for (int i = 0; i < 3; i++)
+    {
+        size_t unit = size_t(1) << (10 * (3 - i));
+        if (bytes >= unit && bytes % unit == 0)
+            return std::to_string(bytes / unit) + Suffixes[i];
+    }
+    return std::to_string(bytes);
+}
+
+CorpusGenerator::CorpusGenerator(CorpusKind kind, uint64_t seed) : kind(kind), state(seed) {}
+
+// splitmix64
+uint64_t CorpusGenerator::next()
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+uint32_t CorpusGenerator::below(uint32_t n) { return static_cast<uint32_t>(next() % n); }
+
+std::string CorpusGenerator::newName(const char *type)
+{
+    std::string name = std::string(Words[below(WordCount)]) + type + std::to_string(counter++);
+    if (names.size() < MaxNames)
+        names.push_back(name);
+    else
+        names[below(MaxNames)] = name;
+    return name;
+}
+
+const std::string &CorpusGenerator::anyName()
+{
+    if (names.empty())
+        newName("Init");
+    return names[below(static_cast<uint32_t>(names.size()))];
+}
+
+void CorpusGenerator::generate(std::string &out, size_t bytes)
+{
+    size_t target = out.size() + bytes;
+    while (out.size() < target)
+        statement(out);
+}
+
+void CorpusGenerator::statement(std::string &out)
+{
+    switch (kind)
+    {
+    case CorpusKind::Declarations:
+        if (chance(70))
+            declaration(out);
+        else
+            function(out);
+        break;
+    case CorpusKind::Expressions:
+        out += "let number " + newName("Expr") + " = ";
+        expression(out, 8 + static_cast<int>(below(40)));
+        out += ";\n";
+        break;
+    case CorpusKind::Templates:
+        out += "print(";
+        templateLiteral(out, 200 + below(1800));
+        out += ");\n";
+        break;
+    case CorpusKind::Comments:
+        comment(out);
+        if (chance(40))
+            comment(out);
+        declaration(out);
+        break;
+    case CorpusKind::Numbers:
+        tableRow(out);
+        break;
+    case CorpusKind::Mixed:
+    {
+        uint32_t pick = below(100);
+        if (pick < 35)
+            declaration(out);
+        else if (pick < 60)
+            function(out);
+        else if (pick < 75)
+        {
+            out += "print(" + anyName() + " + ";
+            expression(out, 1 + static_cast<int>(below(6)));
+            out += ");\n";
+        }
+        else if (pick < 85)
+        {
+            out += "print(";
+            templateLiteral(out, 20 + below(120));
+            out += ");\n";
+        }
+        else
+            comment(out);
+        break;
+    }
+    }
+}
+
+void CorpusGenerator::declaration(std::string &out)
+{
+    out += chance(30) ? "const " : "let ";
+    int count = chance(80) ? 1 : 2 + static_cast<int>(below(3));
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            out += ", ";
+        if (chance(30))
+        {
+            out += "string " + newName("Text") + " = ";
+            stringLiteral(out);
+        }
+        else
+        {
+            out += "number " + newName("") + " = ";
+            expression(out, static_cast<int>(below(4)));
+        }
+    }
+    out += ";\n";
+}
+
+void CorpusGenerator::function(std::string &out)
+{
+    static const char *const Types[] = {"number", "string", "void"};
+    const char *returnType = Types[below(3)];
+    std::string name = std::string(Words[below(WordCount)]) + "Fn" + std::to_string(counter++);
+    functions.push_back(name);
+    if (functions.size() > MaxNames)
+        functions.erase(functions.begin());
+    out += std::string("function ") + returnType + " " + name + "(";
+    uint32_t params = below(4);
+    for (uint32_t i = 0; i < params; i++)
+    {
+        if (i > 0)
+            out += ", ";
+        out += std::string(chance(75) ? "number " : "string ") + Words[below(WordCount)] + "P" + std::to_string(i);
+    }
+    out += ") {\n";
+    uint32_t body = below(5);
+    for (uint32_t i = 0; i < body; i++)
+    {
+        out += "    ";
+        if (chance(60))
+            declaration(out);
+        else
+        {
+            out += "print(";
+            expression(out, static_cast<int>(below(5)));
+            out += ");\n";
+        }
+    }
+    if (returnType[0] == 'v')
+        out += "    return;\n";
+    else if (returnType[0] == 's')
+    {
+        out += "    return ";
+        stringLiteral(out);
+        out += ";\n";
+    }
+    else
+    {
+        out += "    return ";
+        expression(out, static_cast<int>(below(6)));
+        out += ";\n";
+    }
+    out += "}\n";
+}
+
+// Grows linearly with depth: every level wraps one sub-expression.
+void CorpusGenerator::expression(std::string &out, int depth)
+{
+    static const char Operators[] = {'+', '-', '*', '/'};
+    if (depth <= 0)
+    {
+        atom(out);
+        return;
+    }
+    uint32_t shape = below(functions.empty() ? 8 : 10);
+    if (shape < 5)
+    {
+        atom(out);
+        out += ' ';
+        out += Operators[below(4)];
+        out += ' ';
+        expression(out, depth - 1);
+    }
+    else if (shape < 8)
+    {
+        out += '(';
+        expression(out, depth - 1);
+        out += ") ";
+        out += Operators[below(4)];
+        out += ' ';
+        atom(out);
+    }
+    else
+    {
+        out += functions[below(static_cast<uint32_t>(functions.size()))];
+        out += '(';
+        expression(out, depth - 1);
+        out += ", ";
+        atom(out);
+        out += ')';
+    }
+}
+
+void CorpusGenerator::atom(std::string &out)
+{
+    if (chance(45))
+        number(out);
+    else
+        out += anyName();
+}
+
+void CorpusGenerator::number(std::string &out)
+{
+    char text[32];
+    if (chance(70))
+        std::snprintf(text, sizeof(text), "%u", below(100000));
+    else
+        std::snprintf(text, sizeof(text), "%u.%02u", below(1000), below(100));
+    out += text;
+}
+
+// One row of a data table: a const declaration of 4 to 12 cells.
+void CorpusGenerator::tableRow(std::string &out)
+{
+    out += "const ";
+    uint32_t columns = 4 + below(9);
+    for (uint32_t i = 0; i < columns; i++)
+    {
+        if (i > 0)
+            out += ", ";
+        out += "number " + newName("Cell") + " = ";
+        anyNumber(out);
+    }
+    out += ";\n";
+}
+
+// A number in any notation: integer, decimal, exponent, hex or with digit
+// separators.
+void CorpusGenerator::anyNumber(std::string &out)
+{
+    char text[48];
+    uint32_t pick = below(100);
+    if (pick < 40)
+    {
+        number(out);
+        return;
+    }
+    if (pick < 55)
+        std::snprintf(text, sizeof(text), "%u.%04ue%s%u", below(10), below(10000), chance(50) ? "-" : "", below(30));
+    else if (pick < 70)
+        std::snprintf(text, sizeof(text), "0x%X", static_cast<uint32_t>(next()));
+    else if (pick < 85)
+        std::snprintf(text, sizeof(text), "%u_%03u_%03u", 1 + below(999), below(1000), below(1000));
+    else
+        std::snprintf(text, sizeof(text), "%u.%09u", below(100000), below(1000000000));
+    out += text;
+}
+
+void CorpusGenerator::stringLiteral(std::string &out)
+{
+    out += '"';
+    words(out, 4 + below(40));
+    if (chance(20))
+        out += "\\t\\\"quoted\\\"";
+    out += '"';
+}
+
+void CorpusGenerator::templateLiteral(std::string &out, size_t length)
+{
+    out += '`';
+    size_t start = out.size();
+    while (out.size() - start < length)
+    {
+        words(out, 10 + below(60));
+        uint32_t pick = below(10);
+        if (pick < 5)
+        {
+            out += " ${";
+            expression(out, static_cast<int>(below(3)));
+            out += "} ";
+        }
+        else if (pick < 7)
+            out += '\n';
+        else if (pick < 8)
+            out += "\\n\\t";
+        else
+            out += "\\`";
+    }
+    out += '`';
+}
+
+void CorpusGenerator::comment(std::string &out)
+{
+    if (chance(50))
+    {
+        uint32_t lines = 1 + below(4);
+        for (uint32_t i = 0; i < lines; i++)
+        {
+            out += "// ";
+            words(out, 20 + below(60));
+            out += '\n';
+        }
+        return;
+    }
+    out += "/*\n";
+    uint32_t lines = 2 + below(8);
+    for (uint32_t i = 0; i < lines; i++)
+    {
+        out += " * ";
+        words(out, 20 + below(60));
+        out += '\n';
+    }
+    out += " */\n";
+}
+
+void CorpusGenerator::words(std::string &out, size_t length)
+{
+    size_t start = out.size();
+    while (out.size() - start < length)
+    {
+        if (out.size() > start)
+            out += ' ';
+        out += Words[below(WordCount)];
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Deterministic generator of Base programs for front-end benchmarks. The
+// output always parses but is not meant to type-check or run. The same
+// kind, seed and size give the same bytes on every platform: the
+// generator uses its own PRNG rather than <random> distributions, whose
+// output is implementation-defined.
+enum class CorpusKind
+{
+    Declarations, // let/const declarations and small functions
+    Expressions,  // deeply nested arithmetic, calls and parentheses
+    Templates,    // long, multi-line template literals with placeholders
+    Comments,     // mostly line and block comments around short statements
+    Numbers,      // data tables: long declarations of numbers in every notation
+    Mixed         // all of the above but Numbers in proportions of typical code
+};
+
+const char *corpusKindName(CorpusKind kind);
+bool parseCorpusKind(std::string_view name, CorpusKind &kind);
+const std::vector<CorpusKind> &allCorpusKinds();
+
+// Parses sizes such as 512, 64K, 16M or 1G (powers of 1024).
+bool parseByteSize(std::string_view text, size_t &bytes);
+std::string formatByteSize(size_t bytes);
+
+class CorpusGenerator
+{
+public:
+    CorpusGenerator(CorpusKind kind, uint64_t seed);
+
+    // Appends whole top-level statements to out until at least bytes more
+    // bytes have been written. Calling it repeatedly continues the same
+    // program, so large corpora can be written out in pieces.
+    void generate(std::string &out, size_t bytes);
+
+private:
+    CorpusKind kind;
+    uint64_t state;
+    size_t counter = 0;
+    std::vector<std::string> names;
+    std::vector<std::string> functions;
+
+    uint64_t next();
+    uint32_t below(uint32_t n);
+    bool chance(uint32_t percent) { return below(100) < percent; }
+
+    std::string newName(const char *type);
+    const std::string &anyName();
+    void statement(std::string &out);
+    void declaration(std::string &out);
+    void function(std::string &out);
+    void expression(std::string &out, int depth);
+    void atom(std::string &out);
+    void number(std::string &out);
+    void tableRow(std::string &out);
+    void anyNumber(std::string &out);
+    void stringLiteral(std::string &out);
+    void templateLiteral(std::string &out, size_t length);
+    void comment(std::string &out);
+    void words(std::string &out, size_t length);
+};
@@ -0,0 +1,69 @@
+// Writes a generated Base program of a given kind and size to a file, in
+// pieces, so corpora up to gigabytes never have to fit in memory.
+//
+//   base_corpus [--kind mixed] [--size 1M] [--seed 1] <output file>
+//
+// Kinds: declarations, expressions, templates, comments, numbers, mixed.
+#include "corpus.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    CorpusKind kind = CorpusKind::Mixed;
+    size_t size = 1 << 20;
+    uint64_t seed = 1;
+    const char *output = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--kind" && hasValue && parseCorpusKind(argv[i + 1], kind))
+            i++;
+        else if (arg == "--size" && hasValue && parseByteSize(argv[i + 1], size))
+            i++;
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg[0] != '-' && !output)
+            output = argv[i];
+        else
+        {
+            std::fprintf(stderr, "usage: base_corpus [--kind K] [--size N[K|M|G]] [--seed N] <output file>\n");
+            return 1;
+        }
+    }
+    if (!output)
+    {
+        std::fprintf(stderr, "usage: base_corpus [--kind K] [--size N[K|M|G]] [--seed N] <output file>\n");
+        return 1;
+    }
+
+    std::FILE *file = std::fopen(output, "wb");
+    if (!file)
+    {
+        std::fprintf(stderr, "cannot open %s\n", output);
+        return 1;
+    }
+    CorpusGenerator generator(kind, seed);
+    const size_t piece = 4 << 20;
+    std::string buffer;
+    size_t written = 0;
+    while (written < size)
+    {
+        buffer.clear();
+        generator.generate(buffer, std::min(piece, size - written));
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+        {
+            std::fprintf(stderr, "cannot write %s\n", output);
+            std::fclose(file);
+            return 1;
+        }
+        written += buffer.size();
+    }
+    std::fclose(file);
+    std::fprintf(stderr, "%s: %zu bytes of %s (seed %llu)\n", output, written, corpusKindName(kind),
+                 static_cast<unsigned long long>(seed));
+    return 0;
+}
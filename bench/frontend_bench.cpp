@@ -0,0 +1,338 @@
+// Front-end throughput on generated corpora: Lexer, Parser and the text,
+// JSON and binary AST writers for every corpus kind and size, reporting
+// tokens/s, AST nodes/s, bytes/s (of source, and of output for the
+// writers), peak RSS and heap allocations per node. Results are written as
+// JSON, one result object per line, and can be compared against a stored
+// run:
+//
+//   frontend_bench [--sizes 1K,64K,1M,16M] [--kinds mixed,...] [--seed N]
+//                  [--json out.json] [--baseline old.json] [--tolerance 10]
+//
+// With --baseline, every phase whose bytes/s dropped by more than tolerance
+// percent is reported and the exit status is 1. Sizes run in ascending
+// order; peak RSS is the process peak so far, so each entry bounds the
+// memory of the largest corpus measured up to that point.
+#include "ast_output.hpp"
+#include "corpus.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+// Heap allocations, counted by wrapping malloc where the C library allows it
+// (which also sees the arena's chunks) and operator new elsewhere.
+static size_t allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+#else
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+#endif
+
+static long peakRssKb()
+{
+#ifdef __unix__
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// Swallows the writers' output, counting it.
+class CountingBuffer : public std::streambuf
+{
+public:
+    size_t bytes = 0;
+
+protected:
+    int overflow(int c) override
+    {
+        bytes++;
+        return c;
+    }
+    std::streamsize xsputn(const char *, std::streamsize n) override
+    {
+        bytes += static_cast<size_t>(n);
+        return n;
+    }
+};
+
+struct Measurement
+{
+    double seconds = 1e300; // best run
+    size_t allocations = 0; // in one run
+    size_t items = 0;       // tokens or nodes
+    size_t outputBytes = 0;
+    long peakRssKb = 0;
+};
+
+// Repeats f until about a fifth of a second has passed, at least once.
+template <typename F>
+static Measurement measure(F f)
+{
+    Measurement m;
+    double total = 0;
+    for (int run = 0; run < 1000 && (run < 3 || total < 0.2); run++)
+    {
+        size_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        size_t items = f();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        m.allocations = allocations - before;
+        m.items = items;
+        m.seconds = std::min(m.seconds, elapsed);
+        total += elapsed;
+        if (elapsed > 2.0)
+            break;
+    }
+    m.peakRssKb = peakRssKb();
+    return m;
+}
+
+struct Result
+{
+    std::string corpus;
+    std::string size;
+    std::string phase;
+    size_t bytes;
+    Measurement m;
+    const char *itemName; // "tokens" or "nodes"
+};
+
+static std::string toJson(const Result &r)
+{
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\"corpus\": \"" << r.corpus << "\", \"size\": \"" << r.size << "\", \"phase\": \"" << r.phase
+        << "\", \"bytes\": " << r.bytes << ", \"seconds\": " << r.m.seconds << ", \"" << r.itemName
+        << "\": " << r.m.items << ", \"" << r.itemName << "_per_s\": " << r.m.items / r.m.seconds
+        << ", \"bytes_per_s\": " << r.bytes / r.m.seconds << ", \"allocations\": " << r.m.allocations
+        << ", \"allocations_per_" << (r.itemName[0] == 't' ? "token" : "node")
+        << "\": " << static_cast<double>(r.m.allocations) / std::max<size_t>(r.m.items, 1)
+        << ", \"peak_rss_kb\": " << r.m.peakRssKb;
+    if (r.m.outputBytes)
+        out << ", \"output_bytes\": " << r.m.outputBytes << ", \"output_bytes_per_s\": " << r.m.outputBytes / r.m.seconds;
+    out << "}";
+    return out.str();
+}
+
+// Raw text of a field in one of our own result lines.
+static std::string jsonField(const std::string &line, const std::string &key)
+{
+    std::string quoted = "\"" + key + "\": ";
+    size_t at = line.find(quoted);
+    if (at == std::string::npos)
+        return "";
+    at += quoted.size();
+    if (line[at] == '"')
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+// Compares bytes/s with a stored run; returns the number of regressions.
+static int compareWithBaseline(const std::vector<Result> &results, const char *path, double tolerance)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::fprintf(stderr, "cannot open baseline %s\n", path);
+        return 1;
+    }
+    std::map<std::tuple<std::string, std::string, std::string>, double> baseline;
+    for (std::string line; std::getline(in, line);)
+        if (line.find("\"phase\"") != std::string::npos)
+            baseline[{jsonField(line, "corpus"), jsonField(line, "size"), jsonField(line, "phase")}] =
+                std::atof(jsonField(line, "bytes_per_s").c_str());
+
+    int regressions = 0;
+    std::fprintf(stderr, "\n%-13s %5s %-8s %12s %12s %8s\n", "corpus", "size", "phase", "base MB/s", "now MB/s", "change");
+    for (const Result &r : results)
+    {
+        auto it = baseline.find({r.corpus, r.size, r.phase});
+        if (it == baseline.end() || it->second <= 0)
+            continue;
+        double now = r.bytes / r.m.seconds;
+        double change = (now / it->second - 1) * 100;
+        bool regressed = change < -tolerance;
+        regressions += regressed;
+        std::fprintf(stderr, "%-13s %5s %-8s %12.1f %12.1f %+7.1f%%%s\n", r.corpus.c_str(), r.size.c_str(),
+                     r.phase.c_str(), it->second / 1e6, now / 1e6, change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+static std::vector<std::string> splitList(const std::string &text)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(text);
+    for (std::string item; std::getline(stream, item, ',');)
+        items.push_back(item);
+    return items;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> sizes = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+    std::vector<CorpusKind> kinds = allCorpusKinds();
+    uint64_t seed = 1;
+    const char *jsonPath = nullptr;
+    const char *baselinePath = nullptr;
+    double tolerance = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = hasValue;
+        if (arg == "--sizes" && hasValue)
+        {
+            sizes.clear();
+            for (const std::string &item : splitList(argv[++i]))
+            {
+                size_t size;
+                ok = ok && parseByteSize(item, size);
+                sizes.push_back(size);
+            }
+            std::sort(sizes.begin(), sizes.end());
+        }
+        else if (arg == "--kinds" && hasValue)
+        {
+            kinds.clear();
+            for (const std::string &item : splitList(argv[++i]))
+            {
+                CorpusKind kind;
+                ok = ok && parseCorpusKind(item, kind);
+                kinds.push_back(kind);
+            }
+        }
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--json" && hasValue)
+            jsonPath = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            baselinePath = argv[++i];
+        else if (arg == "--tolerance" && hasValue)
+            tolerance = std::atof(argv[++i]);
+        else
+            ok = false;
+        if (!ok)
+        {
+            std::fprintf(stderr, "usage: frontend_bench [--sizes 1K,64K,1M,16M] [--kinds mixed,...] [--seed N]\n"
+                                 "                      [--json out.json] [--baseline old.json] [--tolerance 10]\n");
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    std::fprintf(stderr, "%-13s %5s %-8s %10s %14s %10s %12s %10s %10s\n", "corpus", "size", "phase", "MB/s",
+                 "items/s", "allocs", "allocs/item", "peak RSS", "out MB/s");
+    for (size_t size : sizes)
+        for (CorpusKind kind : kinds)
+        {
+            std::string src;
+            src.reserve(size + 4096);
+            CorpusGenerator(kind, seed).generate(src, size);
+            std::string label = formatByteSize(size);
+
+            Measurement lex = measure([&] {
+                Lexer lexer(src);
+                size_t tokens = 0;
+                while (lexer.nextToken().type != TokenTypeEnum::EndOfFile)
+                    tokens++;
+                return tokens;
+            });
+            std::unique_ptr<Program> program;
+            Measurement parse = measure([&] {
+                program.reset();
+                Lexer lexer(src);
+                Parser parser(lexer);
+                program = parser.parse();
+                return size_t(0);
+            });
+            parse.items = profile::countNodes(program.get());
+            size_t first = results.size();
+            results.push_back({corpusKindName(kind), label, "lexer", src.size(), lex, "tokens"});
+            results.push_back({corpusKindName(kind), label, "parser", src.size(), parse, "nodes"});
+            // The text writer keeps its old phase name so stored baselines
+            // still compare.
+            for (AstFormat format : {AstFormat::Text, AstFormat::Json, AstFormat::Binary})
+            {
+                CountingBuffer sink;
+                std::ostream stream(&sink);
+                Measurement write = measure([&] {
+                    sink.bytes = 0;
+                    OutputBuffer out(stream);
+                    writeAst(out, format, program.get(), program->symbols);
+                    return parse.items;
+                });
+                write.outputBytes = sink.bytes;
+                const char *phase = format == AstFormat::Text ? "printer" : astFormatName(format);
+                results.push_back({corpusKindName(kind), label, phase, src.size(), write, "nodes"});
+            }
+            for (size_t i = first; i < results.size(); i++)
+            {
+                const Result &r = results[i];
+                std::fprintf(stderr, "%-13s %5s %-8s %10.1f %14.0f %10zu %12.3f %8ld KB", r.corpus.c_str(),
+                             r.size.c_str(), r.phase.c_str(), r.bytes / r.m.seconds / 1e6, r.m.items / r.m.seconds,
+                             r.m.allocations, static_cast<double>(r.m.allocations) / std::max<size_t>(r.m.items, 1),
+                             r.m.peakRssKb);
+                if (r.m.outputBytes)
+                    std::fprintf(stderr, " %10.1f", r.m.outputBytes / r.m.seconds / 1e6);
+                std::fprintf(stderr, "\n");
+            }
+        }
+
+    std::ofstream file;
+    if (jsonPath)
+        file.open(jsonPath);
+    std::ostream &out = jsonPath ? file : std::cout;
+    out << "{\"benchmark\": \"frontend\", \"seed\": " << seed << ", \"scanner\": \"" << charScanner().name
+        << "\", \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+        out << "  " << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    out << "]}\n";
+
+    if (baselinePath && compareWithBaseline(results, baselinePath, tolerance) > 0)
+        return 1;
+    return 0;
+}
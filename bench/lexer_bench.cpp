@@ -0,0 +1,74 @@
+// Lexer and parser throughput on a keyword-heavy corpus, or on a file given
+// as the first argument.
+//
+//   cmake --build build --target lexer_bench
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source_buffer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static std::string makeKeywordCorpus(size_t bytes)
+{
+    static const char *snippet =
+        "const string name = \"Mark\";\n"
+        "let number age = 14, number height = 180;\n"
+        "function number add(number a, number b) {\n"
+        "  return a + b * a - b / 2;\n"
+        "}\n"
+        "function void greet(string name, string surname, number age) {\n"
+        "  print(name);\n"
+        "  return;\n"
+        "}\n"
+        "greet(name, \"Rober\", add(age, 1));\n";
+    std::string src;
+    src.reserve(bytes + 512);
+    while (src.size() < bytes)
+        src += snippet;
+    return src;
+}
+
+int main(int argc, char *argv[])
+{
+    SourceBuffer file;
+    std::string generated;
+    std::string_view src;
+    if (argc > 1)
+    {
+        if (!file.open(argv[1]))
+        {
+            std::fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+        src = file.view();
+    }
+    else
+    {
+        generated = makeKeywordCorpus(32 << 20);
+        src = generated;
+    }
+
+    const int runs = 5;
+    double bestLex = 1e300, bestParse = 1e300;
+    size_t tokens = 0;
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(src);
+        tokens = 0;
+        while (lexer.nextToken().type != TokenTypeEnum::EndOfFile)
+            tokens++;
+        auto lexed = std::chrono::steady_clock::now();
+        Lexer parseLexer(src);
+        Parser parser(parseLexer);
+        auto program = parser.parse();
+        auto parsed = std::chrono::steady_clock::now();
+        bestLex = std::min(bestLex, std::chrono::duration<double>(lexed - start).count());
+        bestParse = std::min(bestParse, std::chrono::duration<double>(parsed - lexed).count());
+    }
+    std::printf("bytes %zu, tokens %zu\n", src.size(), tokens);
+    std::printf("lex:         %8.2f ms  %8.2f Mtokens/s  %8.2f MB/s\n", bestLex * 1e3, tokens / bestLex / 1e6, src.size() / bestLex / 1e6);
+    std::printf("lex + parse: %8.2f ms  %8.2f Mtokens/s\n", bestParse * 1e3, tokens / bestParse / 1e6);
+    return 0;
+}
@@ -0,0 +1,48 @@
+// Measures the cost of Lexer::peek() for sources of increasing size.
+// Peeking must stay constant-time per call no matter how large the input is.
+//
+//   cmake --build build --target lookahead_bench
+#include "lexer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+static std::string makeSource(size_t bytes)
+{
+    static const char *snippet =
+        "let number total = 1 + 2 * 3;\n"
+        "function number add(number a, number b) {\n"
+        "  // sum of both\n"
+        "  return a + b;\n"
+        "}\n"
+        "print(`Hello ${name}`);\n";
+    std::string src;
+    src.reserve(bytes + 128);
+    while (src.size() < bytes)
+        src += snippet;
+    return src;
+}
+
+int main()
+{
+    std::printf("%12s %12s %14s\n", "bytes", "tokens", "ns/peek");
+    for (size_t bytes = 1 << 10; bytes <= (size_t(1) << 26); bytes <<= 2)
+    {
+        std::string src = makeSource(bytes);
+        Lexer lexer(src);
+        size_t tokens = 0, peeks = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (lexer.peek().type != TokenTypeEnum::EndOfFile)
+        {
+            // Look a few tokens ahead before consuming each one, as a parser would.
+            volatile uint32_t sink = lexer.peek(1).offset + lexer.peek(2).offset + lexer.peek(3).offset;
+            (void)sink;
+            peeks += 4;
+            lexer.nextToken();
+            tokens++;
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%12zu %12zu %14.2f\n", src.size(), tokens, elapsed / peeks);
+    }
+    return 0;
+}
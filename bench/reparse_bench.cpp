@@ -0,0 +1,84 @@
+// Incremental reparse latency for single-character edits in a 100k-line
+// program, against a full parse of the same text. Each kind of edit is made
+// and then undone at random places.
+//
+//   cmake --build build --target reparse_bench
+#include "incremental.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+static std::string makeProgram(size_t lines)
+{
+    static const char *snippet =
+        "const string name = \"Mark\";\n"
+        "let number age = 14, number height = 180;\n"
+        "function number add(number a, number b) {\n"
+        "  return a + b * a - b / 2;\n"
+        "}\n"
+        "function void greet(string name, string surname, number age) {\n"
+        "  print(`${name} is ${age}`);\n"
+        "  return;\n"
+        "}\n"
+        "greet(name, \"Rober\", add(age, 1));\n";
+    std::string src;
+    for (size_t line = 0; line < lines; line += 10)
+        src += snippet;
+    return src;
+}
+
+static double microseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Makes `edits` edits at random occurrences of c, each followed by its undo,
+// and reports the mean and worst reparse time of the edits.
+static void measure(IncrementalParser &parser, const char *label, char c, uint32_t removed, std::string_view inserted)
+{
+    const int edits = 2000;
+    std::mt19937 rng(42);
+    std::string removedText;
+    double total = 0, worst = 0;
+    size_t parsed = 0;
+    for (int i = 0; i < edits; i++)
+    {
+        std::string_view text = parser.text();
+        size_t at = text.find(c, rng() % text.size());
+        if (at == std::string_view::npos)
+            at = text.find(c);
+        uint32_t offset = static_cast<uint32_t>(at) + (removed == 0 ? 1 : 0);
+        removedText = std::string(text.substr(offset, removed));
+
+        auto start = std::chrono::steady_clock::now();
+        parser.edit({offset, removed, inserted});
+        double elapsed = microseconds(start);
+        total += elapsed;
+        worst = std::max(worst, elapsed);
+        parsed += parser.statementsParsed();
+        parser.edit({offset, static_cast<uint32_t>(inserted.size()), removedText});
+    }
+    std::printf("%-22s mean %7.1f us  worst %7.1f us  %5.2f statements reparsed\n", label, total / edits, worst,
+                static_cast<double>(parsed) / edits);
+}
+
+int main()
+{
+    IncrementalParser parser(makeProgram(100000));
+    double full = 1e300;
+    for (int run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        parser.parse();
+        full = std::min(full, microseconds(start));
+    }
+    std::printf("full parse of %zu bytes: %.1f us, %zu statements\n", parser.text().size(), full,
+                parser.program()->body.size());
+
+    measure(parser, "replace a digit", '4', 1, "7");
+    measure(parser, "type into a name", 'h', 0, "x");
+    measure(parser, "insert a line break", ';', 0, "\n");
+    return 0;
+}
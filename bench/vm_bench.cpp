@@ -0,0 +1,264 @@
+// Bytecode VM throughput. The language has no conditionals yet, so recursive
+// fib is written as a ladder of functions, fibK() calling fib(K-1) and
+// fib(K-2), which performs the same calls as fib(K) would. The arithmetic
+// workload does a few floating-point operations per call through the same
+// call tree, and the string workload builds strings by concatenation. The
+// numeric ladders also run with native code for their functions (jit.hpp).
+// A naive AST walker runs the fib ladder for comparison, and both ladders
+// are also built ahead of time with `base build`'s C back end ($CC, or cc)
+// and timed as executables, process start-up included. With a file as the
+// first argument, runs that program instead.
+//
+//   cmake --build build --target vm_bench
+#include "ast_visitor.hpp"
+#include "c_generator.hpp"
+#include "checker.hpp"
+#include "compiler.hpp"
+#include "jit.hpp"
+#include "source_buffer.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+static const char *NullDevice = "NUL";
+#else
+static const char *NullDevice = "/dev/null";
+#endif
+
+static const int FibDepth = 27;
+static const int StringDepth = 22;
+
+static std::string makeFibLadder()
+{
+    std::string src = "function number fib0(number n) { return n - n; }\n"
+                      "function number fib1(number n) { return n - n + 1; }\n";
+    for (int k = 2; k <= FibDepth; k++)
+        src += "function number fib" + std::to_string(k) + "(number n) { return fib" + std::to_string(k - 1) +
+               "(n) + fib" + std::to_string(k - 2) + "(n); }\n";
+    src += "print(fib" + std::to_string(FibDepth) + "(0));\n";
+    return src;
+}
+
+static std::string makeArithLadder()
+{
+    std::string src = "function number arith0(number x) { return x * 0.5 + 1; }\n"
+                      "function number arith1(number x) { let number y = x * x; return y / (y + 1) - x; }\n";
+    for (int k = 2; k <= FibDepth; k++)
+        src += "function number arith" + std::to_string(k) + "(number x) { let number y = x * 1.0001 + 0.25; return arith" +
+               std::to_string(k - 1) + "(y) - arith" + std::to_string(k - 2) + "(y * 0.5) * (y < 3) + y / 3; }\n";
+    src += "print(arith" + std::to_string(FibDepth) + "(1));\n";
+    return src;
+}
+
+static std::string makeStringLadder()
+{
+    std::string src = "function string str0(string s, number n) { return s + n; }\n"
+                      "function string str1(string s, number n) { return s + \"-\" + n; }\n";
+    for (int k = 2; k <= StringDepth; k++)
+        src += "function string str" + std::to_string(k) + "(string s, number n) { return str" + std::to_string(k - 1) +
+               "(s + \"a\", n + 1) + str" + std::to_string(k - 2) + "(\"b\", n * 2); }\n";
+    src += "print(str" + std::to_string(StringDepth) + "(\"\", 0));\n";
+    return src;
+}
+
+// Calls made by the top-level call of a ladder of the given depth.
+static double ladderCalls(int depth)
+{
+    double a = 1, b = 1;
+    for (int k = 2; k <= depth; k++)
+        std::swap(a, b), b = a + b + 1;
+    return depth == 0 ? 1 : b;
+}
+
+// Tree walker over the AST with name lookups at run time, numbers only.
+class TreeWalker : public ASTVisitor<TreeWalker, double>
+{
+public:
+    explicit TreeWalker(const Program *program)
+    {
+        for (const ASTNode *stmt : program->body)
+            if (const auto *fn = nodeCast<FunctionDeclaration>(stmt))
+                functions[fn->name] = fn;
+    }
+
+    double call(const FunctionDeclaration *fn, const std::vector<double> &args)
+    {
+        std::unordered_map<Symbol, double> scope;
+        for (size_t i = 0; i < args.size(); i++)
+            scope[fn->params[i].name] = args[i];
+        scopes.push_back(&scope);
+        double result = 0;
+        for (const ASTNode *stmt : fn->body->body)
+            if (const auto *ret = nodeCast<ReturnStatement>(stmt))
+            {
+                result = visit(ret->argument);
+                break;
+            }
+        scopes.pop_back();
+        return result;
+    }
+
+    double visitLiteralExpression(const LiteralExpression *node) { return node->numValue; }
+    double visitIdentifierExpression(const IdentifierExpression *node) { return scopes.back()->at(node->name); }
+    double visitBinaryExpression(const BinaryExpression *node)
+    {
+        double left = visit(node->left), right = visit(node->right);
+        switch (node->op)
+        {
+        case TokenKind::Plus:
+            return left + right;
+        case TokenKind::Minus:
+            return left - right;
+        case TokenKind::Star:
+            return left * right;
+        default:
+            return left / right;
+        }
+    }
+    double visitAssignmentExpression(const AssignmentExpression *) { return 0; }
+    double visitCallExpression(const CallExpression *node)
+    {
+        std::vector<double> args;
+        for (const ASTNode *arg : node->arguments)
+            args.push_back(visit(arg));
+        return call(functions.at(nodeCast<IdentifierExpression>(node->callee)->name), args);
+    }
+    double visitProgram(const Program *) { return 0; }
+    double visitVariableDeclaration(const VariableDeclaration *) { return 0; }
+    double visitFunctionDeclaration(const FunctionDeclaration *) { return 0; }
+    double visitBlockStatement(const BlockStatement *) { return 0; }
+    double visitReturnStatement(const ReturnStatement *) { return 0; }
+    double visitExpressionStatement(const ExpressionStatement *) { return 0; }
+    double visitTemplateLiteral(const TemplateLiteral *) { return 0; }
+
+private:
+    std::unordered_map<Symbol, const FunctionDeclaration *> functions;
+    std::vector<std::unordered_map<Symbol, double> *> scopes;
+};
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best-of-runs compile and execution times of src, output discarded. With
+// jit, compiling includes generating native code.
+static void runVM(const char *label, const std::string &src, double calls, bool jit = false)
+{
+    const int runs = 5;
+    double bestCompile = 1e300, bestRun = 1e300;
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Lexer lexer(src);
+        Parser parser(lexer);
+        std::unique_ptr<Program> program = parser.parse();
+        Diagnostics diagnostics;
+        if (!Checker::check(*program, diagnostics))
+            throw std::runtime_error(formatDiagnostic(diagnostics.first()));
+        Module module = Compiler::compile(program.get());
+        NativeCode native;
+        if (jit)
+            native = NativeCode::compile(program.get(), module);
+        bestCompile = std::min(bestCompile, seconds(start));
+
+        std::FILE *sink = std::fopen(NullDevice, "w");
+        start = std::chrono::steady_clock::now();
+        {
+            VM vm(module, sink, &native);
+            vm.run();
+        }
+        bestRun = std::min(bestRun, seconds(start));
+        std::fclose(sink);
+    }
+    std::printf("%-14s compile %8.2f ms  run %8.2f ms", label, bestCompile * 1e3, bestRun * 1e3);
+    if (calls > 0)
+        std::printf("  %7.1f Mcalls/s", calls / bestRun / 1e6);
+    std::printf("\n");
+}
+
+// Best-of-runs time to generate and compile src to an executable, and to run
+// it with output discarded. Skipped if the C compiler fails.
+static void runAOT(const char *label, const std::string &src, double calls)
+{
+    Lexer lexer(src);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    Diagnostics diagnostics;
+    if (!Checker::check(*program, diagnostics))
+        throw std::runtime_error(formatDiagnostic(diagnostics.first()));
+    std::filesystem::path executable = std::filesystem::temp_directory_path() / "base-vm-bench-aot";
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        buildExecutable(CGenerator::generate(program.get()), executable, defaultCCompiler());
+    }
+    catch (const std::runtime_error &error)
+    {
+        std::printf("%-14s skipped: %s\n", label, error.what());
+        return;
+    }
+    double build = seconds(start);
+
+    const int runs = 5;
+    double bestRun = 1e300;
+    std::string command = "\"" + executable.string() + "\" > " + NullDevice;
+    for (int run = 0; run < runs; run++)
+    {
+        start = std::chrono::steady_clock::now();
+        if (std::system(command.c_str()) != 0)
+            throw std::runtime_error(std::string(label) + ": executable failed");
+        bestRun = std::min(bestRun, seconds(start));
+    }
+    std::error_code ignored;
+    std::filesystem::remove(executable, ignored);
+    std::printf("%-14s build   %8.2f ms  run %8.2f ms", label, build * 1e3, bestRun * 1e3);
+    if (calls > 0)
+        std::printf("  %7.1f Mcalls/s", calls / bestRun / 1e6);
+    std::printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        SourceBuffer file;
+        if (!file.open(argv[1]))
+        {
+            std::fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+        runVM(argv[1], std::string(file.view()), 0);
+        return 0;
+    }
+
+    std::string fib = makeFibLadder();
+    runVM("fib ladder", fib, ladderCalls(FibDepth));
+    runVM("fib JIT", fib, ladderCalls(FibDepth), true);
+    std::string arith = makeArithLadder();
+    runVM("arith ladder", arith, ladderCalls(FibDepth));
+    runVM("arith JIT", arith, ladderCalls(FibDepth), true);
+    runVM("string ladder", makeStringLadder(), ladderCalls(StringDepth));
+
+    Lexer lexer(fib);
+    Parser parser(lexer);
+    std::unique_ptr<Program> program = parser.parse();
+    const auto *top = nodeCast<FunctionDeclaration>(program->body[FibDepth]);
+    TreeWalker walker(program.get());
+    auto start = std::chrono::steady_clock::now();
+    double result = walker.call(top, {0});
+    double elapsed = seconds(start);
+    std::printf("%-14s                       run %8.2f ms  %7.1f Mcalls/s  (fib = %.0f)\n", "tree walker",
+                elapsed * 1e3, ladderCalls(FibDepth) / elapsed / 1e6, result);
+
+    runAOT("fib AOT", fib, ladderCalls(FibDepth));
+    runAOT("string AOT", makeStringLadder(), ladderCalls(StringDepth));
+    return 0;
+}
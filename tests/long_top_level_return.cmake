@@ -0,0 +1,17 @@
+# Writes long_top_level_return.base and its .out to generated_programs: a
+# top level long enough for base build to split its C into several
+# functions, with a return in a block in one of the later ones.
+
+set(program "// Generated by tests/long_top_level_return.cmake.\n")
+set(expected "")
+foreach(i RANGE 2999)
+    string(APPEND program "print(${i});\n")
+    string(APPEND expected "${i}\n")
+endforeach()
+string(APPEND program "{\n    let string s = \"block\";\n    print(s);\n    return;\n}\n")
+string(APPEND expected "block\n")
+foreach(i RANGE 3000 5999)
+    string(APPEND program "print(${i});\n")
+endforeach()
+file(WRITE ${generated_programs}/long_top_level_return.base "${program}")
+file(WRITE ${generated_programs}/long_top_level_return.out "${expected}")
@@ -0,0 +1,49 @@
+# Runs one test program through every back end and compares what each
+# prints, standard error included, with the expected output stored next to
+# the program: base run at -O0, base run as is and without native code, and
+# the executable base build makes of it.
+#
+#   cmake -DBASE=<base executable> -DPROGRAM=<file.base> -DWORK=<scratch dir> -P run_program.cmake
+
+get_filename_component(name "${PROGRAM}" NAME_WE)
+get_filename_component(directory "${PROGRAM}" DIRECTORY)
+file(READ "${directory}/${name}.out" expected)
+file(MAKE_DIRECTORY "${WORK}")
+
+# Output of one command as it is written to .out files: standard output,
+# then standard error, then the exit status if it is not 0.
+function(capture result)
+    execute_process(COMMAND ${ARGN} OUTPUT_VARIABLE out ERROR_VARIABLE err RESULT_VARIABLE status)
+    set(text "${out}${err}")
+    if(NOT status EQUAL 0)
+        string(APPEND text "[exit ${status}]\n")
+    endif()
+    set(${result} "${text}" PARENT_SCOPE)
+endfunction()
+
+set(failed FALSE)
+function(compare label actual)
+    if(NOT actual STREQUAL expected)
+        message("${label} printed:\n${actual}\nexpected:\n${expected}")
+        set(failed TRUE PARENT_SCOPE)
+    endif()
+endfunction()
+
+capture(actual "${BASE}" run --no-cache -O0 "${PROGRAM}")
+compare("base run -O0" "${actual}")
+capture(actual "${BASE}" run --no-cache "${PROGRAM}")
+compare("base run" "${actual}")
+capture(actual "${BASE}" run --no-cache --no-jit "${PROGRAM}")
+compare("base run --no-jit" "${actual}")
+
+set(executable "${WORK}/${name}${CMAKE_EXECUTABLE_SUFFIX}")
+execute_process(COMMAND "${BASE}" build --no-cache -o "${executable}" "${PROGRAM}" RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "base build failed on ${PROGRAM}")
+endif()
+capture(actual "${executable}")
+compare("base build" "${actual}")
+
+if(failed)
+    message(FATAL_ERROR "${PROGRAM} printed something else")
+endif()